@@ -12,16 +12,26 @@
 #include "cursorControls.h"
 #include "searchMode.h" //For control - F search
 #include "infoBar.h"
+#include "viewport.h"
+#include "damageTracker.h"
+#include "frameScheduler.h"
+#include "fileSave.h"
+#include "searchWorker.h"
+#include "trigramIndex.h"
+#include "editJournal.h"
+#include "mappedText.h"
 
 #include <algorithm> 
 
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
+LRESULT HandleWindowMessage(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
     //avoid bottleneck by using threads or other multitasking
     switch(uMsg){
         case WM_CREATE:
         {
-            textBuffer.push_back(L"");
+            textBuffer.clear();
             setOriginal(textBuffer, hwnd);
+            UndoHistory::removeStaleSpills();
+            bool recovered = ResumeJournal(hwnd, L""); // An untitled document left by a crash
             font = CreateFont(
                 -14, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
                 OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY,
@@ -36,24 +46,26 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
             }
 
             calcTextMetrics(hwnd);
-            UpdateScrollBars(hwnd);
             CreateCaret(hwnd, NULL, 2, charHeight);
             //Gain focus immediately, so show immediately
             ShowCaret(hwnd);
-            UpdateCaretPosition(hwnd);
+            ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
             InitInfoBar(hwnd);
+            if (recovered) {
+                MessageBox(hwnd, L"Unsaved changes from the last session were recovered, but not their undo history.", L"Text Editor", MB_ICONINFORMATION | MB_OK);
+            }
             break;
         }
         case WM_SIZE:
         {
-            calcTextMetrics(hwnd); 
-            UpdateScrollBars(hwnd);
-            UpdateCaretPosition(hwnd);
+            calcFontMetrics(hwnd); 
+            ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
             UpdateInfoBar(hwnd);
-            InvalidateRect(hwnd, NULL, TRUE); 
+            DamageAll();
             break;
         }
         case WM_PAINT: {
+            FlushFrame(hwnd); // Layout scheduled by a batched key burst lands before painting
             PAINTSTRUCT ps;
             HDC hdc = BeginPaint(hwnd, &ps);
             HFONT hOldFont = (HFONT)SelectObject(hdc, font);
@@ -73,11 +85,21 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
             SetTextColor(hdc, GetSysColor(COLOR_WINDOWTEXT));
             SetBkMode(hdc, TRANSPARENT);  // Important for selection visibility
             
-            for (int i = scrollOffsetY; i < textBuffer.size(); ++i) {
+            // Only the lines and columns inside the paint rect are fetched and drawn
+            LineRange lines = VisibleLineRange(ps.rcPaint.top, ps.rcPaint.bottom, charHeight,
+                                               scrollOffsetY, textBuffer.lineCount());
+            for (int i = lines.first; i < lines.last; ++i) {
                 int screenLineY = (i - scrollOffsetY) * charHeight;
-                if (screenLineY >= 0 && screenLineY < ps.rcPaint.bottom) {
-                    TextOutW(hdc, -scrollOffsetX, screenLineY, 
-                            textBuffer[i].c_str(), textBuffer[i].length());
+                int lineLength = textBuffer.lineLength(i);
+                ColumnRange cols = VisibleColumnRange(ps.rcPaint.left, ps.rcPaint.right,
+                                                      fixedPitch ? charWidth : 0, scrollOffsetX, lineLength);
+                if (cols.first > 0 && IsLowSurrogate(textBuffer.charAt(i, cols.first))) cols.first--;
+                if (cols.last < lineLength && IsLowSurrogate(textBuffer.charAt(i, cols.last))) cols.last++;
+                if (cols.last > cols.first) {
+                    std::wstring span = textBuffer.getRange(textBuffer.lineStart(i) + cols.first,
+                                                            cols.last - cols.first);
+                    TextOutW(hdc, cols.first * charWidth - scrollOffsetX, screenLineY, 
+                            span.c_str(), span.length());
                 }
             }
             if (isSearchMode) {
@@ -96,7 +118,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
         }
         case WM_SETFOCUS:
         {
-            UpdateCaretPosition(hwnd); // Ensure caret is at correct position in case window was resized
+            ScheduleLayout(LAYOUT_CARET); // Ensure caret is at correct position in case window was resized
             ShowCaret(hwnd); // Make the caret visible when the window gains focus
             break;
         }
@@ -120,6 +142,14 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
         }
         case WM_DESTROY:
         {
+            WaitForBackgroundSave(); // Don't exit with a save half written
+            undoHistory.detach();    // Completes the side file for next time
+            CloseJournal();          // The user has saved or discarded the edits by now
+            CancelMappedIndex();
+            StopSearch();
+            CancelTrigramIndex();
+            ReleaseSearchBrushes();
+            releaseMeasureDC();
             if (font != NULL) {
                 DeleteObject(font);
                 font = NULL; // Set to NULL after deleting
@@ -128,6 +158,27 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
             PostQuitMessage(0);
             return 0;
         }
+        case WM_SEARCH_RESULTS:
+        {
+            ReceiveSearchResults(hwnd, lParam);
+            return 0;
+        }
+        case WM_INDEX_READY:
+        {
+            FinishTrigramIndex(hwnd, lParam);
+            UpdateInfoBar(hwnd);
+            return 0;
+        }
+        case WM_FILE_INDEXED:
+        {
+            ReceiveFileIndex(hwnd, lParam);
+            return 0;
+        }
+        case WM_SAVE_COMPLETE:
+        {
+            FinishBackgroundSave(hwnd, wParam, lParam);
+            return 0;
+        }
         case WM_CHAR:
         {
             wchar_t ch = (wchar_t)wParam;
@@ -151,6 +202,12 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
                     case 'Z':  // Ctrl+Z
                         PerformUndo(hwnd);
                         break;
+                    case 'Y':  // Ctrl+Y
+                        PerformRedo(hwnd);
+                        break;
+                    case 'B':  // Ctrl+B
+                        SwitchRedoBranch(hwnd);
+                        break;
                     case 'F':{
                         if(!isSearchMode){
                             ActivateSearchMode(hwnd);
@@ -159,6 +216,24 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
                         }
                         break;
                         }
+                    case 'H':
+                        ShowReplace(hwnd);
+                        break;
+                    case 'R':
+                        if (isSearchMode) {
+                            ToggleRegexSearch(hwnd);
+                        }
+                        break;
+                    case 'I':
+                        if (isSearchMode) {
+                            ToggleIgnoreCase(hwnd);
+                        }
+                        break;
+                    case 'W':
+                        if (isSearchMode) {
+                            ToggleWholeWord(hwnd);
+                        }
+                        break;
                     case 'A':{
                         showInfoBar = !showInfoBar;
                         ShowHideInfoBar(hwnd);
@@ -178,15 +253,15 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
                         caretCol--;
                     }else if (caretLine>0){
                         caretLine--;
-                        caretCol = textBuffer[caretLine].length();
+                        caretCol = textBuffer.lineLength(caretLine);
                     }
                     break;
                 }
                 case VK_RIGHT:{
                     trackCaret = true; 
-                    if(caretCol<textBuffer[caretLine].length()){
+                    if(caretCol<textBuffer.lineLength(caretLine)){
                         caretCol++;
-                    }else if (caretLine<textBuffer.size()-1){
+                    }else if (caretLine<textBuffer.lineCount()-1){
                         caretLine++;
                         caretCol = 0;
                     }
@@ -194,13 +269,13 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
                 }
                 case VK_DOWN:{
                     trackCaret = true; 
-                    if (caretLine < textBuffer.size()-1){
+                    if (caretLine < textBuffer.lineCount()-1){
                         caretLine++;
-                        if(caretCol>textBuffer[caretLine].length()){
-                            caretCol = textBuffer[caretLine].length();
+                        if(caretCol>textBuffer.lineLength(caretLine)){
+                            caretCol = textBuffer.lineLength(caretLine);
                         }
-                    }else {
-                        textBuffer.push_back(L"");
+                    }else if (!MappedIndexBuilding()) {
+                        SplitLine(caretLine, textBuffer.lineLength(caretLine));
                         caretLine++;
                         isModifiedTag(textBuffer, hwnd);
                     }
@@ -210,17 +285,15 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
                     trackCaret = true; 
                     if (caretLine >0){
                         caretLine--;
-                        if (caretCol>textBuffer[caretLine].length()){
-                            caretCol = textBuffer[caretLine].length();
+                        if (caretCol>textBuffer.lineLength(caretLine)){
+                            caretCol = textBuffer.lineLength(caretLine);
                         }
                     }
                     break;
                 }
             }
-            //Update display after any textBuffer or caret position change
-            UpdateScrollBars(hwnd);
-            InvalidateRect(hwnd, NULL, TRUE); 
-            UpdateCaretPosition(hwnd); 
+            //Update display after any textBuffer or caret position change, edits and scrolling record their own damage
+            ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
             break;
         }
         case WM_MOUSEMOVE: {
@@ -270,18 +343,19 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
             if (!IsClipboardFormatAvailable(CF_UNICODETEXT)) {
                 return 0;}
 
+            // Copied out so the clipboard is released before the edit
+            std::wstring clipboardText;
             OpenClipboard(hwnd);
             HGLOBAL hMem = GetClipboardData(CF_UNICODETEXT);
             if (hMem) {
-                LPCWSTR clipboardText = (LPCWSTR)GlobalLock(hMem);
-                if (clipboardText) {
-                    // Insert at caret position
-                    InsertTextAt(caretLine, caretCol, clipboardText);
+                LPCWSTR text = (LPCWSTR)GlobalLock(hMem);
+                if (text) {
+                    clipboardText = text;
                     GlobalUnlock(hMem);
                 }
             }
             CloseClipboard();
-            InvalidateRect(hwnd, NULL, TRUE);
+            pasteCase(std::move(clipboardText), hwnd);
             return 0;
         }
         case WM_COMMAND:
@@ -319,4 +393,18 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
         
     }
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
+}
+
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam){
+    LRESULT result = HandleWindowMessage(hwnd, uMsg, wParam, lParam);
+    if (uMsg == WM_PAINT || uMsg == WM_DESTROY || uMsg == WM_NCDESTROY) {
+        return result;
+    }
+    // Under key auto-repeat the next key is already queued, fold it into the same layout pass
+    if ((uMsg == WM_CHAR || uMsg == WM_KEYDOWN) && KeyboardInputPending(hwnd)) {
+        return result;
+    }
+    // Layout runs once and everything the message changed is invalidated in one go
+    FlushFrame(hwnd);
+    return result;
 }
\ No newline at end of file
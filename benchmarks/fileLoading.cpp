@@ -0,0 +1,150 @@
+// Load throughput of a generated UTF-8 log (100 MB unless a size is given), through the
+// loader's stages one at a time, against the std::wifstream and std::getline loader it
+// replaced. The file is written to the current directory and deleted afterwards.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/fileLoading.cpp textEncoding.cpp pieceTable.cpp mappedText.cpp charScan.cpp -o fileLoading.exe
+fileLoading.exe [MB] [crlf]
+*/
+#define NOMINMAX
+
+#include "textEncoding.h"
+#include "pieceTable.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+// Mostly ASCII with the odd accented letter and arrow, like real logs
+static bool WriteLog(const wchar_t* path, size_t bytes, bool crlf) {
+    const char* levels[] = {"INFO", "INFO", "WARN", "ERROR"};
+    const char* users[] = {"jose", "jos\xC3\xA9", "zoe", "z\xC3\xB6\xC3\xA9", "ana"};
+    std::mt19937 random(1);
+    auto below = [&](unsigned n) { return (unsigned)(random() % n); };
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    std::string block;
+    size_t written = 0;
+    bool ok = true;
+    while (ok && written < bytes) {
+        char line[160];
+        int length = snprintf(line, sizeof(line), "2024-03-12 %02u:%02u:%02u %s user=%s request %u \xE2\x86\x92 took %ums%s",
+                              below(24), below(60), below(60), levels[below(4)], users[below(5)], below(100000),
+                              below(900), crlf ? "\r\n" : "\n");
+        block.append(line, length);
+        if (block.size() >= 1 << 20 || written + block.size() >= bytes) {
+            DWORD done = 0;
+            ok = WriteFile(file, block.data(), (DWORD)block.size(), &done, NULL) && done == block.size();
+            written += block.size();
+            block.clear();
+        }
+    }
+    CloseHandle(file);
+    return ok;
+}
+
+static std::string Narrow(const wchar_t* path) {
+    std::string narrow;
+    for (const wchar_t* at = path; *at; ++at) narrow += (char)*at;
+    return narrow;
+}
+
+// What LoadTextFromFile used to do: a line at a time through the default locale
+static double OldLoad(const wchar_t* path, size_t& lines) {
+    double start = Seconds();
+    std::vector<std::wstring> buffer;
+    std::wifstream file(Narrow(path));
+    std::wstring line;
+    while (std::getline(file, line)) {
+        buffer.push_back(line);
+    }
+    lines = buffer.size();
+    return Seconds() - start;
+}
+
+struct Stages {
+    double map, decode, normalize, index;
+};
+
+// Decoding a whole file: map, decode, normalize, then index the lines. The loader still does
+// this below LARGE_FILE_BYTES; largeFileOpen.cpp times the larger files it reads in place.
+static bool NewLoad(const wchar_t* path, Stages& stages, PieceTable& buffer) {
+    double start = Seconds();
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const char* view = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    size_t size = (size_t)fileSize.QuadPart;
+    double mapped = Seconds();
+
+    std::wstring text;
+    size_t bomLength;
+    TextEncoding encoding = DetectEncoding(view, size, bomLength);
+    DecodeText(view + bomLength, size - bomLength, encoding, text);
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    double decoded = Seconds();
+
+    NormalizeLineEndings(text);
+    double normalized = Seconds();
+    buffer.load(std::move(text));
+    double indexed = Seconds();
+
+    stages = Stages{mapped - start, decoded - mapped, normalized - decoded, indexed - normalized};
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)atoll(argv[1]) : 100;
+    bool crlf = argc > 2 && strcmp(argv[2], "crlf") == 0;
+    const wchar_t* path = L"fileLoading.log";
+    if (!WriteLog(path, megabytes << 20, crlf)) {
+        printf("Could not write the test file\n");
+        return 1;
+    }
+    double mb = (double)megabytes;
+
+    size_t oldLines = 0;
+    double old = OldLoad(path, oldLines);
+
+    Stages stages;
+    PieceTable buffer;
+    if (!NewLoad(path, stages, buffer)) {
+        printf("Could not map the test file\n");
+        DeleteFileW(path);
+        return 1;
+    }
+    double total = stages.map + stages.decode + stages.normalize + stages.index;
+    printf("%zu MB of UTF-8 with %s line endings, %zu lines\n", megabytes, crlf ? "CRLF" : "LF", buffer.lineCount());
+    printf("%-28s %10s %10s\n", "stage", "ms", "MB/s");
+    printf("%-28s %10.1f %10.0f\n", "open and map", stages.map * 1000, mb / stages.map);
+    printf("%-28s %10.1f %10.0f\n", "detect and decode", stages.decode * 1000, mb / stages.decode);
+    printf("%-28s %10.1f %10.0f\n", "normalize line endings", stages.normalize * 1000, mb / stages.normalize);
+    printf("%-28s %10.1f %10.0f\n", "piece table load", stages.index * 1000, mb / stages.index);
+    printf("%-28s %10.1f %10.0f\n", "new loader", total * 1000, mb / total);
+    printf("%-28s %10.1f %10.0f  (%zu lines)\n", "wifstream and getline", old * 1000, mb / old, oldLines);
+
+    DeleteFileW(path);
+    return 0;
+}
\ No newline at end of file
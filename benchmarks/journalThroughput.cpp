@@ -0,0 +1,170 @@
+// The edit journal on a generated document (16 MB of text unless a size is given): what
+// queueing an edit costs the UI thread, how fast the writer gets the records to disk, and
+// how long replaying them takes after a crash. Run it twice; the first run journals typing
+// and pastes, then exits the way a crash would, leaving the journal next to the document.
+// The second replays it and checks it gives the same text as the edits themselves.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/journalThroughput.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp spillFile.cpp editJournal.cpp -o journalThroughput.exe
+journalThroughput.exe [MB]
+journalThroughput.exe replay [MB]
+*/
+#define NOMINMAX
+
+#include "editJournal.h"
+#include "textEditorGlobals.h" // For textBuffer
+
+#include <windows.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static const wchar_t* DOCUMENT = L"journalThroughput.txt"; // Never written, only its journal is
+
+static std::wstring MakeText(size_t chars) {
+    const wchar_t* words[] = {L"alpha", L"beta", L"gamma", L"delta", L"epsilon", L"zeta", L"eta", L"theta"};
+    std::mt19937 random(1);
+    std::wstring text;
+    text.reserve(chars + 16);
+    while (text.length() < chars) {
+        text += words[random() % 8];
+        text += random() % 10 == 0 ? L'\n' : L' ';
+    }
+    return text;
+}
+
+// The same edits every run, onto text, with the journal told of them when journal is set
+struct Editor {
+    PieceTable& text;
+    bool journal;
+
+    void insert(size_t offset, const wchar_t* chars, size_t count) {
+        text.insertAt(offset, chars, count);
+        if (journal) JournalInsert(offset, chars, count);
+    }
+    void erase(size_t offset, size_t count) {
+        text.eraseAt(offset, count);
+        if (journal) JournalErase(offset, count);
+    }
+};
+
+// A million typed characters in runs at random places, every tenth one backspaced
+static size_t Type(Editor& editor) {
+    std::mt19937 random(2);
+    size_t caret = 0;
+    for (int i = 0; i < 1000000; ++i) {
+        if (i % 50 == 0) caret = random() % editor.text.length();
+        if (i % 10 == 9) {
+            editor.erase(--caret, 1);
+        } else {
+            wchar_t ch = (wchar_t)(L'a' + random() % 26);
+            editor.insert(caret++, &ch, 1);
+        }
+    }
+    return 1000000;
+}
+
+// 200 pastes of 64K characters
+static size_t Paste(Editor& editor) {
+    std::mt19937 random(3);
+    std::wstring clipboard = MakeText(1 << 16);
+    for (int i = 0; i < 200; ++i) {
+        editor.insert(random() % editor.text.length(), clipboard.data(), clipboard.length());
+    }
+    return 200;
+}
+
+static uint64_t JournalBytes() {
+    // Asking for no access opens it alongside the writer's exclusive handle
+    HANDLE file = CreateFileW(JournalPath(DOCUMENT).c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    CloseHandle(file);
+    return (uint64_t)size.QuadPart;
+}
+
+// The writer doesn't say when it has caught up, so this waits until the journal has
+// stopped changing for half a second and gives the time it last changed
+static double Drained(uint64_t& bytes) {
+    bytes = JournalBytes();
+    double changed = Seconds();
+    while (Seconds() - changed < 0.5) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        uint64_t now = JournalBytes();
+        if (now != bytes) {
+            bytes = now;
+            changed = Seconds();
+        }
+    }
+    return changed;
+}
+
+// Against the same edits to a copy of the text with no journal
+template <typename Workload>
+static void Journal(const char* name, Workload workload, PieceTable& copy) {
+    Editor plain{copy, false};
+    double start = Seconds();
+    size_t edits = workload(plain);
+    double unjournaled = Seconds() - start;
+
+    Editor editor{textBuffer, true};
+    start = Seconds();
+    workload(editor);
+    double queued = Seconds() - start;
+    uint64_t bytes;
+    double written = Drained(bytes) - start;
+    printf("%-8s %8zu edits %10.0f %10.0f %12.1f %10.1f\n", name, edits, unjournaled * 1e9 / edits,
+           queued * 1e9 / edits, written * 1000, bytes / 1048576.0);
+}
+
+int main(int argc, char** argv) {
+    bool replay = argc > 1 && strcmp(argv[1], "replay") == 0;
+    int sizeArg = replay ? 2 : 1;
+    size_t megabytes = argc > sizeArg ? (size_t)atoll(argv[sizeArg]) : 16;
+    textBuffer.load(MakeText((megabytes << 20) / sizeof(wchar_t)));
+
+    if (!replay) {
+        PieceTable copy;
+        copy.load(MakeText((megabytes << 20) / sizeof(wchar_t)));
+        StartJournal(DOCUMENT, textBuffer.contentHash(), false);
+        printf("%-23s %10s %10s %12s %10s\n", "", "ns/edit", "journaled", "on disk ms", "journal MB");
+        Journal("typing", Type, copy);
+        Journal("pasting", Paste, copy);
+        printf("Run \"journalThroughput.exe replay%s%s\" to replay it\n", argc > 1 ? " " : "", argc > 1 ? argv[1] : "");
+        fflush(stdout);
+        std::_Exit(0); // As a crash would, with the journal left open and in place
+    }
+
+    PieceTable expected;
+    expected.load(MakeText((megabytes << 20) / sizeof(wchar_t)));
+    Editor editor{expected, false};
+    Type(editor);
+    Paste(editor);
+
+    uint64_t bytes = JournalBytes();
+    double start = Seconds();
+    bool changed = ReplayJournal(DOCUMENT);
+    double seconds = Seconds() - start;
+    printf("Replayed %.1f MB of journal in %.1f ms, %zu characters\n", bytes / 1048576.0, seconds * 1000,
+           textBuffer.length());
+    bool same = changed && textBuffer.contentHash() == expected.contentHash();
+    DeleteFileW(JournalPath(DOCUMENT).c_str());
+    if (!same) {
+        printf("The replayed text isn't the edited text\n");
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,172 @@
+// Opening a large UTF-8 log in place (64, 256 and 1024 MB unless sizes are given) against
+// decoding all of it into the piece table first: the time until the first screen can be
+// drawn, until the background index is complete, and the memory each holds. The first
+// screen should take the same time at every size. Files are written to the current
+// directory and deleted afterwards.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/largeFileOpen.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp -o largeFileOpen.exe -lpsapi
+largeFileOpen.exe [MB...]
+*/
+#define NOMINMAX
+
+#include "mappedText.h"
+#include "pieceTable.h"
+#include "textEncoding.h"
+
+#include <windows.h>
+#include <psapi.h>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static double PrivateMB() {
+    PROCESS_MEMORY_COUNTERS_EX counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters));
+    return counters.PrivateUsage / 1048576.0;
+}
+
+static bool WriteLog(const wchar_t* path, size_t bytes) {
+    const char* words[] = {"INFO", "WARN", "user=jos\xC3\xA9", "request", "\xE2\x86\x92", "took", "12ms", "ok"};
+    std::mt19937 random(1);
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    std::string block;
+    size_t written = 0;
+    bool ok = true;
+    while (ok && written < bytes) {
+        block += words[random() % 8];
+        block += random() % 10 == 0 ? "\r\n" : " ";
+        if (block.size() >= 1 << 20 || written + block.size() >= bytes) {
+            DWORD done = 0;
+            ok = WriteFile(file, block.data(), (DWORD)block.size(), &done, NULL) && done == block.size();
+            written += block.size();
+            block.clear();
+        }
+    }
+    CloseHandle(file);
+    return ok;
+}
+
+// What the window draws first, a screen of lines from the top or the bottom
+static void ReadScreen(const PieceTable& buffer, size_t firstLine) {
+    std::wstring line;
+    for (size_t i = firstLine; i < firstLine + 60 && i < buffer.lineCount(); ++i) {
+        buffer.getLine(i, line);
+    }
+}
+
+struct Timings {
+    double firstScreen, indexed, lastScreen;
+    double firstMB, indexedMB; // Private memory over what the process held before
+};
+
+static bool OpenMapped(HWND hwnd, const wchar_t* path, Timings& timings) {
+    double baseMB = PrivateMB();
+    double start = Seconds();
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    std::shared_ptr<MappedText> mapped = MappedText::map(file, (size_t)size.QuadPart, path);
+    if (!mapped) return false;
+    PieceTable buffer;
+    StartMappedIndex(hwnd, mapped, 60);
+    buffer.loadMapped(mapped);
+    ReadScreen(buffer, 0);
+    timings.firstScreen = Seconds() - start;
+    timings.firstMB = PrivateMB() - baseMB;
+
+    MSG msg;
+    while (MappedIndexBuilding() && GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message != WM_FILE_INDEXED) continue;
+        bool restarted;
+        std::shared_ptr<MappedText> indexed = ReceiveMappedIndex(msg.lParam, restarted);
+        if (indexed && restarted) {
+            buffer.loadMapped(indexed);
+        } else if (indexed) {
+            buffer.mappedGrew();
+        }
+    }
+    timings.indexed = Seconds() - start;
+    double end = Seconds();
+    ReadScreen(buffer, buffer.lineCount() > 60 ? buffer.lineCount() - 60 : 0);
+    timings.lastScreen = Seconds() - end;
+    timings.indexedMB = PrivateMB() - baseMB;
+    return true;
+}
+
+// Decoded whole, as files below LARGE_FILE_BYTES still are
+static bool OpenDecoded(const wchar_t* path, Timings& timings) {
+    double baseMB = PrivateMB();
+    double start = Seconds();
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const char* view = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    std::wstring text;
+    size_t bomLength;
+    TextEncoding encoding = DetectEncoding(view, (size_t)size.QuadPart, bomLength);
+    DecodeText(view + bomLength, (size_t)size.QuadPart - bomLength, encoding, text);
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    NormalizeLineEndings(text);
+    PieceTable buffer;
+    buffer.load(std::move(text));
+    ReadScreen(buffer, 0);
+    timings.firstScreen = timings.indexed = Seconds() - start;
+    double end = Seconds();
+    ReadScreen(buffer, buffer.lineCount() > 60 ? buffer.lineCount() - 60 : 0);
+    timings.lastScreen = Seconds() - end;
+    timings.firstMB = timings.indexedMB = PrivateMB() - baseMB;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) sizes.push_back((size_t)atoll(argv[i]));
+    if (sizes.empty()) sizes = {64, 256, 1024};
+
+    HWND hwnd = CreateWindowExW(0, L"STATIC", L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, NULL, NULL);
+    const wchar_t* path = L"largeFileOpen.log";
+    printf("%8s %-8s %14s %12s %14s %12s %12s\n", "MB", "open", "first screen", "indexed", "last screen",
+           "MB at first", "MB indexed");
+    for (size_t megabytes : sizes) {
+        if (!WriteLog(path, megabytes << 20)) {
+            printf("Could not write the test file\n");
+            return 1;
+        }
+        Timings mapped, decoded;
+        bool ok = OpenMapped(hwnd, path, mapped) && OpenDecoded(path, decoded);
+        DeleteFileW(path);
+        if (!ok) {
+            printf("Could not open the test file\n");
+            return 1;
+        }
+        for (const auto& [name, timings] : {std::make_pair("mapped", mapped), std::make_pair("decoded", decoded)}) {
+            printf("%8zu %-8s %11.2f ms %9.1f ms %11.2f ms %12.1f %12.1f\n", megabytes, name,
+                   timings.firstScreen * 1000, timings.indexed * 1000, timings.lastScreen * 1000, timings.firstMB,
+                   timings.indexedMB);
+        }
+    }
+    DestroyWindow(hwnd);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+// MatchList against the vector splice it replaced: random match lists, each spliced a hundred
+// times with matches added, dropped and lines shifted, comparing the contents, indexing and
+// firstOnLine after every splice. Then the time of a splice near the top of 1M matches for
+// both. Prints the times and "ok", or where it failed.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/matchListCheck.cpp matchList.cpp -o matchListCheck.exe
+matchListCheck.exe
+*/
+#define NOMINMAX
+
+#include "matchList.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::mt19937 randomNumbers(3);
+
+static std::vector<SearchMatch>::iterator FirstOnLine(std::vector<SearchMatch>& matches, int line) {
+    return std::lower_bound(matches.begin(), matches.end(), line,
+                            [](const SearchMatch& match, int value) { return match.line < value; });
+}
+
+// What SpliceLines did before MatchList
+static void VectorSplice(std::vector<SearchMatch>& matches, int line, int removedLines,
+                         const std::vector<SearchMatch>& replacement, int delta) {
+    auto first = FirstOnLine(matches, line);
+    auto last = FirstOnLine(matches, line + removedLines + 1);
+    for (auto it = last; it != matches.end(); ++it) it->line += delta;
+    size_t at = first - matches.begin();
+    matches.erase(first, last);
+    matches.insert(matches.begin() + at, replacement.begin(), replacement.end());
+}
+
+static bool Same(const MatchList& list, const std::vector<SearchMatch>& expected) {
+    if (list.size() != expected.size()) return false;
+    std::vector<SearchMatch> copied;
+    list.copyTo(copied);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        SearchMatch indexed = list[i];
+        if (copied[i].line != expected[i].line || copied[i].col != expected[i].col ||
+            copied[i].length != expected[i].length || indexed.line != expected[i].line ||
+            indexed.col != expected[i].col || indexed.length != expected[i].length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Up to two matches on each of the lines
+static void AddMatches(std::vector<SearchMatch>& matches, int firstLine, int lastLine, int spacing, int length) {
+    for (int line = firstLine; line <= lastLine; ++line) {
+        for (int i = randomNumbers() % 3; i > 0; --i) {
+            matches.push_back(SearchMatch{line, (2 - i) * spacing, length});
+        }
+    }
+}
+
+static bool CheckSplices(int round) {
+    int lines = 1 + randomNumbers() % 200;
+    std::vector<SearchMatch> expected;
+    AddMatches(expected, 0, lines - 1, 5, 2);
+    MatchList list;
+    size_t half = randomNumbers() % (expected.size() + 1); // Streamed in two batches
+    list.append(expected.data(), half);
+    list.append(expected.data() + half, expected.size() - half);
+    if (!Same(list, expected)) {
+        printf("round %d: appended matches differ\n", round);
+        return false;
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        int line = randomNumbers() % (lines + 1);
+        int removedLines = randomNumbers() % 4;
+        int insertedLines = randomNumbers() % 4;
+        std::vector<SearchMatch> replacement;
+        AddMatches(replacement, line, line + insertedLines, 7, 3);
+        int delta = insertedLines - removedLines;
+        VectorSplice(expected, line, removedLines, replacement, delta);
+        list.splice(line, removedLines, replacement, delta);
+        lines = std::max(1, lines + delta);
+
+        int query = (int)(randomNumbers() % (lines + 2)) - 1;
+        if (list.firstOnLine(query) != (size_t)(FirstOnLine(expected, query) - expected.begin())) {
+            printf("round %d, splice %d: firstOnLine(%d) differs\n", round, i, query);
+            return false;
+        }
+        if (!Same(list, expected)) {
+            printf("round %d, splice %d: matches differ\n", round, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// A line typed near the top of a document with a match on every one of 1M lines
+static void TimeSplice() {
+    std::vector<SearchMatch> matches;
+    for (int line = 0; line < 1000000; ++line) matches.push_back(SearchMatch{line, 0, 3});
+    MatchList list;
+    list.append(matches.data(), matches.size());
+    std::vector<SearchMatch> replacement{SearchMatch{10, 0, 3}, SearchMatch{11, 0, 3}};
+
+    double start = Seconds();
+    for (int i = 0; i < 10000; ++i) list.splice(10, 0, replacement, 1);
+    double treap = (Seconds() - start) / 10000;
+    start = Seconds();
+    for (int i = 0; i < 100; ++i) VectorSplice(matches, 10, 0, replacement, 1);
+    double vector = (Seconds() - start) / 100;
+    printf("splice near the top of 1M matches: MatchList %.2f us, vector %.0f us\n", treap * 1e6, vector * 1e6);
+}
+
+int main() {
+    for (int round = 0; round < 300; ++round) {
+        if (!CheckSplices(round)) return 1;
+    }
+    TimeSplice();
+    printf("ok\n");
+    return 0;
+}
\ No newline at end of file
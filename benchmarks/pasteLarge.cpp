@@ -0,0 +1,107 @@
+// A 100 MB paste (or the size given) with CRLF line endings into the middle of a document,
+// through pasteCase with every LinesChanged hook live, then undo and redo of its one entry.
+// Each is timed on its own, and until the search results and the trigram index an edit this
+// large sends back to workers are in again.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/pasteLarge.cpp WindowProc.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp charScan.cpp textEncoding.cpp lineWidths.cpp viewport.cpp damageTracker.cpp frameScheduler.cpp textMetrics.cpp glyphAdvances.cpp updateCaretAndScroll.cpp fileOperations.cpp fileSave.cpp spillFile.cpp editJournal.cpp undoHistory.cpp undoStack.cpp characterCase.cpp isModified.cpp cursorControls.cpp replaceText.cpp searchMode.cpp matchList.cpp searchWorker.cpp regexSearch.cpp trigramIndex.cpp infoBar.cpp -o pasteLarge.exe -municode -lcomdlg32
+pasteLarge.exe [MB] [document lines]
+*/
+#define NOMINMAX
+
+#include "characterCase.h"
+#include "searchMode.h"
+#include "trigramIndex.h"
+#include "undoStack.h"
+#include "textEditorGlobals.h" // For textBuffer and the caret
+#include "textMetrics.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::wstring MakeText(size_t chars, const wchar_t* lineBreak) {
+    const wchar_t* words[] = {L"alpha", L"beta", L"gamma", L"delta", L"epsilon", L"zeta", L"eta", L"theta"};
+    std::mt19937 random(1);
+    std::wstring text;
+    text.reserve(chars + 16);
+    while (text.length() < chars) {
+        text += words[random() % 8];
+        if (random() % 8 == 0) {
+            text += lineBreak;
+        } else {
+            text += L' ';
+        }
+    }
+    return text;
+}
+
+// Until the trigram index is in and the search has streamed all its results
+static void Settle(HWND hwnd) {
+    MSG msg;
+    while ((searchInProgress || TrigramIndexBytes() == 0) && GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message == WM_INDEX_READY) {
+            FinishTrigramIndex(hwnd, msg.lParam);
+        } else if (msg.message == WM_SEARCH_RESULTS) {
+            ReceiveSearchResults(hwnd, msg.lParam);
+        }
+    }
+}
+
+template <typename Action>
+static void Time(HWND hwnd, const char* name, Action action) {
+    double start = Seconds();
+    action();
+    double blocked = Seconds() - start;
+    Settle(hwnd);
+    double settled = Seconds() - start;
+    printf("%-8s %8.1f ms blocked, %8.1f ms until settled, %zu lines, %zu matches of \"%ls\"\n", name,
+           blocked * 1000, settled * 1000, textBuffer.lineCount(), searchMatches.size(), searchQuery.c_str());
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)atoll(argv[1]) : 100;
+    size_t documentChars = argc > 2 ? (size_t)atoll(argv[2]) * 40 : 40000000;
+
+    HWND hwnd = CreateWindowExW(0, L"STATIC", L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, NULL, NULL);
+    textBuffer.load(MakeText(documentChars, L"\n"));
+    calcTextMetrics(hwnd);
+    StartTrigramIndex(hwnd);
+    Settle(hwnd);
+    searchBoxText = L"Search: theta";
+    FindAllMatches(hwnd);
+    Settle(hwnd);
+    uint64_t original = textBuffer.contentHash();
+
+    // Clipboard text is UTF-16, 2 bytes a unit
+    std::wstring clipboard = MakeText((megabytes << 20) / 2, L"\r\n");
+    printf("Pasting %zu characters into %zu lines\n", clipboard.length(), textBuffer.lineCount());
+    caretLine = (int)textBuffer.lineCount() / 2;
+    caretCol = (int)textBuffer.lineLength(caretLine) / 2;
+    Time(hwnd, "paste", [&]() { pasteCase(std::move(clipboard), hwnd); });
+    uint64_t pasted = textBuffer.contentHash();
+    Time(hwnd, "undo", [&]() { PerformUndo(hwnd); });
+    if (textBuffer.contentHash() != original) {
+        printf("Undo didn't give back the original text\n");
+        return 1;
+    }
+    Time(hwnd, "redo", [&]() { PerformRedo(hwnd); });
+    if (textBuffer.contentHash() != pasted) {
+        printf("Redo didn't give back the pasted text\n");
+        return 1;
+    }
+
+    StopSearch();
+    CancelTrigramIndex();
+    DestroyWindow(hwnd);
+    return 0;
+}
\ No newline at end of file
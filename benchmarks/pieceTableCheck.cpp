@@ -0,0 +1,151 @@
+// Random edits to a piece table against the same edits to a std::wstring, with inserts of a
+// few hundred thousand characters so the add buffer spans many chunks. After every edit it
+// compares the text, the content hash with a fresh load of the same text, line starts one
+// at a time and in a walk, and characters. Snapshots taken along the way must still read
+// the text they were taken at after later edits, and on another thread while the edits
+// go on. Prints "ok" or where it failed.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/pieceTableCheck.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp -o pieceTableCheck.exe
+pieceTableCheck.exe
+*/
+#define NOMINMAX
+
+#include "pieceTable.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static std::mt19937 randomNumbers(7);
+
+static std::wstring ReadSnapshot(const TextSnapshot& snapshot) {
+    std::wstring text;
+    snapshot.forEachRun([&](const wchar_t* run, size_t count) { text.append(run, count); });
+    return text;
+}
+
+// A run of 'x' with letters and line breaks scattered through it
+static std::wstring LargeInsert() {
+    size_t count = 100000 + randomNumbers() % 500000;
+    std::wstring text(count, L'x');
+    for (size_t i = 0; i < count; i += 1 + randomNumbers() % 60) {
+        text[i] = randomNumbers() % 3 ? L'\n' : (wchar_t)(L'a' + randomNumbers() % 26);
+    }
+    return text;
+}
+
+// What typing makes, a few characters mostly at the end
+static std::wstring SmallInsert() {
+    std::wstring text;
+    for (int i = 1 + randomNumbers() % 5; i > 0; --i) {
+        text += randomNumbers() % 4 == 0 ? L'\n' : (wchar_t)(L'A' + randomNumbers() % 26);
+    }
+    return text;
+}
+
+static bool Matches(const PieceTable& buffer, const std::wstring& expected) {
+    if (buffer.length() != expected.size() || buffer.getText() != expected) return false;
+    PieceTable fresh;
+    fresh.load(expected);
+    if (fresh.contentHash() != buffer.contentHash()) return false;
+
+    std::vector<size_t> starts(1, 0);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (expected[i] == L'\n') starts.push_back(i + 1);
+    }
+    if (buffer.lineCount() != starts.size()) return false;
+    for (int i = 0; i < 20; ++i) {
+        size_t line = randomNumbers() % starts.size();
+        if (buffer.lineStart(line) != starts[line]) return false;
+        size_t end = line + 1 < starts.size() ? starts[line + 1] - 1 : expected.size();
+        if (end > starts[line]) {
+            size_t col = randomNumbers() % (end - starts[line]);
+            if (buffer.charAt(line, col) != expected[starts[line] + col]) return false;
+        }
+    }
+    size_t line = randomNumbers() % starts.size();
+    size_t count = randomNumbers() % 3000;
+    std::vector<size_t> walked;
+    buffer.lineStarts(line, count, walked);
+    return walked.size() == std::min(count, starts.size() - line) &&
+           std::equal(walked.begin(), walked.end(), starts.begin() + line);
+}
+
+static bool CheckEdits(int round) {
+    PieceTable buffer;
+    std::wstring expected;
+    std::vector<std::pair<TextSnapshot, std::wstring>> snapshots; // And the text each was taken at
+    for (int step = 0; step < 400; ++step) {
+        unsigned edit = randomNumbers() % 8;
+        if (edit == 0) {
+            std::wstring text = LargeInsert();
+            if (randomNumbers() % 2) buffer.reserveInserts(text.size() + randomNumbers() % 1000);
+            size_t offset = randomNumbers() % (expected.size() + 1);
+            buffer.insertAt(offset, text.data(), text.size());
+            expected.insert(offset, text);
+        } else if (edit < 4) {
+            std::wstring text = SmallInsert();
+            size_t offset = randomNumbers() % 2 ? expected.size() : randomNumbers() % (expected.size() + 1);
+            buffer.insertAt(offset, text.data(), text.size());
+            expected.insert(offset, text);
+        } else if (edit < 6 && !expected.empty()) {
+            size_t offset = randomNumbers() % expected.size();
+            size_t count = 1 + randomNumbers() % (randomNumbers() % 4 ? 6 : 200000);
+            count = std::min(count, expected.size() - offset);
+            buffer.eraseAt(offset, count);
+            expected.erase(offset, count);
+        } else if (edit == 6) {
+            snapshots.emplace_back(buffer.snapshot(), expected);
+            if (snapshots.size() > 4) snapshots.erase(snapshots.begin());
+        } else if (edit == 7 && randomNumbers() % 20 == 0) {
+            buffer.clear();
+            expected.clear();
+        }
+        if (!Matches(buffer, expected)) {
+            printf("round %d, step %d: the piece table differs from the same edits to a string\n", round, step);
+            return false;
+        }
+        for (const auto& [snapshot, text] : snapshots) {
+            if (ReadSnapshot(snapshot) != text) {
+                printf("round %d, step %d: a snapshot changed after later edits\n", round, step);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A background save reads its snapshot while typing goes on
+static bool CheckSnapshotThread() {
+    PieceTable buffer;
+    buffer.load(L"start\n");
+    for (int i = 0; i < 200; ++i) {
+        buffer.insertAt(buffer.length(), L"abc\n", 4);
+        TextSnapshot snapshot = buffer.snapshot();
+        std::wstring expected = buffer.getText();
+        bool same = false;
+        std::thread reader([&] { same = ReadSnapshot(snapshot) == expected; });
+        for (int k = 0; k < 50; ++k) buffer.insertAt(buffer.length() / 2, L"xyz", 3);
+        reader.join();
+        if (!same) {
+            printf("snapshot %d read on another thread changed under the edits\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    for (int round = 0; round < 6; ++round) {
+        if (!CheckEdits(round)) return 1;
+    }
+    if (!CheckSnapshotThread()) return 1;
+    printf("ok\n");
+    return 0;
+}
\ No newline at end of file
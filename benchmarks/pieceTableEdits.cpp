@@ -0,0 +1,142 @@
+// PieceTable against the std::vector<std::wstring> it replaced, on a generated log (2M lines
+// unless a count is given): typing at random places, pressing Enter, joining lines with
+// backspace, and reading lines back.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/pieceTableEdits.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp -o pieceTableEdits.exe
+pieceTableEdits.exe [lines]
+*/
+#define NOMINMAX
+
+#include "pieceTable.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::vector<std::wstring> MakeLines(size_t lines) {
+    const wchar_t* levels[] = {L"INFO", L"INFO", L"WARN", L"ERROR"};
+    std::mt19937 random(1);
+    std::vector<std::wstring> text(lines);
+    for (size_t line = 0; line < lines; ++line) {
+        text[line] = L"2024-03-12 " + std::to_wstring(random() % 86400) + L" " + levels[random() % 4] +
+                     L" request " + std::to_wstring(random() % 100000) + L" took " +
+                     std::to_wstring(random() % 900) + L"ms";
+    }
+    return text;
+}
+
+// The old model: one string per line, Enter and line joins shift every later line
+struct VectorBuffer {
+    std::vector<std::wstring> lines;
+
+    void insertChar(size_t line, size_t col, wchar_t ch) { lines[line].insert(col, 1, ch); }
+    void splitLine(size_t line, size_t col) {
+        std::wstring tail = lines[line].substr(col);
+        lines[line].erase(col);
+        lines.insert(lines.begin() + line + 1, tail);
+    }
+    void mergeLines(size_t line) {
+        lines[line] += lines[line + 1];
+        lines.erase(lines.begin() + line + 1);
+    }
+    size_t lineCount() const { return lines.size(); }
+    size_t lineLength(size_t line) const { return lines[line].length(); }
+    void getLine(size_t line, std::wstring& out) const { out = lines[line]; }
+};
+
+// Same positions for both buffers, so they do the same edits
+struct Workload {
+    std::mt19937 random{2};
+    size_t line(size_t lines, size_t limit) { return random() % std::min(lines, limit); }
+};
+
+template <typename Buffer>
+static double TypeCharacters(Buffer& buffer, int count) {
+    Workload places;
+    double start = Seconds();
+    for (int i = 0; i < count; ++i) {
+        size_t line = places.line(buffer.lineCount(), SIZE_MAX);
+        buffer.insertChar(line, places.random() % (buffer.lineLength(line) + 1), L'x');
+    }
+    return Seconds() - start;
+}
+
+// Near the top, where the vector has the most lines to shift
+template <typename Buffer>
+static double PressEnter(Buffer& buffer, int count) {
+    Workload places;
+    double start = Seconds();
+    for (int i = 0; i < count; ++i) {
+        size_t line = places.line(buffer.lineCount(), 1000);
+        buffer.splitLine(line, places.random() % (buffer.lineLength(line) + 1));
+    }
+    return Seconds() - start;
+}
+
+template <typename Buffer>
+static double JoinLines(Buffer& buffer, int count) {
+    Workload places;
+    double start = Seconds();
+    for (int i = 0; i < count; ++i) {
+        buffer.mergeLines(places.line(buffer.lineCount() - 1, 1000));
+    }
+    return Seconds() - start;
+}
+
+template <typename Buffer>
+static double ReadLines(Buffer& buffer, int count, size_t& chars) {
+    Workload places;
+    std::wstring text;
+    double start = Seconds();
+    for (int i = 0; i < count; ++i) {
+        buffer.getLine(places.line(buffer.lineCount(), SIZE_MAX), text);
+        chars += text.length();
+    }
+    return Seconds() - start;
+}
+
+static void Report(const char* name, int count, double pieces, double vector) {
+    printf("%-20s %8d %14.3f %14.3f\n", name, count, pieces * 1e6 / count, vector * 1e6 / count);
+}
+
+int main(int argc, char** argv) {
+    size_t lines = argc > 1 ? (size_t)atoll(argv[1]) : 2000000;
+    std::vector<std::wstring> text = MakeLines(lines);
+
+    VectorBuffer vector{text};
+    std::wstring joined;
+    for (size_t i = 0; i < text.size(); ++i) {
+        joined += text[i];
+        if (i + 1 < text.size()) joined += L'\n';
+    }
+    PieceTable pieces;
+    double start = Seconds();
+    pieces.load(std::move(joined));
+    printf("%zu lines, piece table loaded in %.1f ms\n", pieces.lineCount(), (Seconds() - start) * 1000);
+
+    // Each workload runs on the buffers the previous ones left, so both stay alike
+    printf("%-20s %8s %14s %14s\n", "edit", "count", "pieces us", "vector us");
+    Report("type a character", 100000, TypeCharacters(pieces, 100000), TypeCharacters(vector, 100000));
+    Report("press Enter", 500, PressEnter(pieces, 500), PressEnter(vector, 500));
+    Report("join lines", 500, JoinLines(pieces, 500), JoinLines(vector, 500));
+    size_t pieceChars = 0, vectorChars = 0;
+    Report("read a line", 1000000, ReadLines(pieces, 1000000, pieceChars), ReadLines(vector, 1000000, vectorChars));
+    if (pieceChars != vectorChars || pieces.lineCount() != vector.lineCount()) {
+        printf("The buffers disagree: %zu and %zu characters read\n", pieceChars, vectorChars);
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
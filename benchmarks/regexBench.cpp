@@ -0,0 +1,113 @@
+// RegexMatcher::findAll against std::wregex, line by line over a generated log, and on single
+// long lines built to make naive leftmost-longest matching quadratic.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/regexBench.cpp regexSearch.cpp charScan.cpp -o regexBench.exe
+regexBench.exe [log lines] [long line length]
+*/
+#define NOMINMAX
+
+#include "regexSearch.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::vector<std::wstring> MakeLog(size_t lines) {
+    const wchar_t* levels[] = {L"INFO", L"INFO", L"INFO", L"WARN", L"ERROR"};
+    const wchar_t* methods[] = {L"GET", L"POST", L"PUT"};
+    std::mt19937 random(1);
+    std::vector<std::wstring> log;
+    for (size_t line = 0; line < lines; ++line) {
+        std::wstring text = L"2024-03-" + std::to_wstring(10 + random() % 20) + L" " +
+                            std::to_wstring(random() % 24) + L":" + std::to_wstring(random() % 60) + L" " +
+                            levels[random() % 5] + L" " + methods[random() % 3] + L" /api/v" +
+                            std::to_wstring(random() % 3) + L"/item" + std::to_wstring(random() % 10000) +
+                            L" took " + std::to_wstring(random() % 900) + L"." + std::to_wstring(random() % 100) +
+                            L"ms user" + std::to_wstring(random() % 500) + L"@example.com";
+        log.push_back(text);
+    }
+    return log;
+}
+
+static size_t OurMatches(const std::wstring& pattern, const std::vector<std::wstring>& lines, double& seconds) {
+    std::wstring error;
+    RegexMatcher matcher(CompileRegex(pattern, false, error));
+    std::vector<std::pair<int, int>> matches;
+    size_t count = 0;
+    double start = Seconds();
+    for (const std::wstring& line : lines) {
+        matches.clear();
+        matcher.findAll(line.data(), line.length(), matches);
+        count += matches.size();
+    }
+    seconds = Seconds() - start;
+    return count;
+}
+
+// Empty matches are skipped to count the same things as findAll, though ECMAScript
+// alternation is leftmost-first, so the matches themselves can differ
+static size_t StdMatches(const std::wstring& pattern, const std::vector<std::wstring>& lines, double& seconds) {
+    std::wregex regex(pattern, std::regex_constants::ECMAScript | std::regex_constants::optimize);
+    size_t count = 0;
+    double start = Seconds();
+    for (const std::wstring& line : lines) {
+        for (std::wsregex_iterator it(line.begin(), line.end(), regex), end; it != end; ++it) {
+            if (it->length() != 0) count++;
+        }
+    }
+    seconds = Seconds() - start;
+    return count;
+}
+
+static void Compare(const wchar_t* pattern, const std::vector<std::wstring>& lines, bool runStd) {
+    double ours, theirs = 0;
+    size_t ourCount = OurMatches(pattern, lines, ours);
+    size_t stdCount = runStd ? StdMatches(pattern, lines, theirs) : 0;
+    if (runStd) {
+        printf("%-24ls %10.1f %8zu %10.1f %8zu\n", pattern, ours * 1000, ourCount, theirs * 1000, stdCount);
+    } else {
+        printf("%-24ls %10.1f %8zu %10s %8s\n", pattern, ours * 1000, ourCount, "-", "-");
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t logLines = argc > 1 ? (size_t)atoll(argv[1]) : 200000;
+    size_t longLine = argc > 2 ? (size_t)atoll(argv[2]) : 80000;
+
+    std::vector<std::wstring> log = MakeLog(logLines);
+    printf("%zu log lines\n", logLines);
+    printf("%-24s %10s %8s %10s %8s\n", "pattern", "ours ms", "matches", "wregex ms", "matches");
+    for (const wchar_t* pattern : {L"ERROR", L"ERROR|WARN", L"(GET|POST) /api", L"\\d+\\.\\d+ms",
+                                   L"[a-z]+\\d+@example\\.com", L"item\\d{4} took"}) {
+        Compare(pattern, log, true);
+    }
+
+    // std::wregex backtracks, recursing per unit, so it only gets a line it can finish
+    struct LongCase {
+        const wchar_t* pattern;
+        size_t stdLength;
+    };
+    std::vector<std::wstring> longLines{std::wstring(longLine, L'a')};
+    printf("\nOne line of %zu units of 'a', and a shorter one for wregex\n", longLine);
+    printf("%-24s %10s %8s %10s %8s\n", "pattern", "ours ms", "matches", "wregex ms", "matches");
+    for (const LongCase& test : {LongCase{L"a|a*b", 2000}, LongCase{L"(a*b)?", 2000}, LongCase{L"(aa)*b|a", 2000},
+                                 LongCase{L"(a*)*b", 12}}) {
+        Compare(test.pattern, longLines, false);
+        std::vector<std::wstring> shortLines{std::wstring(test.stdLength, L'a')};
+        printf("%zu units:\n", test.stdLength);
+        Compare(test.pattern, shortLines, true);
+    }
+    return 0;
+}
\ No newline at end of file
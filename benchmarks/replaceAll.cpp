@@ -0,0 +1,103 @@
+// Replace-all of about a million matches in a large generated document through the editor's
+// own path: a finished search, the trigram index, ReplaceAllMatches with every LinesChanged
+// hook live, then undo and redo of the one entry it records. Each is timed on its own, which
+// is how long the window can't take input, and until the search results and the trigram
+// index it sends back to workers are in again. The search should be empty after the
+// replace and full again after the undo.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/replaceAll.cpp WindowProc.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp charScan.cpp textEncoding.cpp lineWidths.cpp viewport.cpp damageTracker.cpp frameScheduler.cpp textMetrics.cpp glyphAdvances.cpp updateCaretAndScroll.cpp fileOperations.cpp fileSave.cpp spillFile.cpp editJournal.cpp undoHistory.cpp undoStack.cpp characterCase.cpp isModified.cpp cursorControls.cpp replaceText.cpp searchMode.cpp matchList.cpp searchWorker.cpp regexSearch.cpp trigramIndex.cpp infoBar.cpp -o replaceAll.exe -municode -lcomdlg32
+replaceAll.exe [lines]
+*/
+#define NOMINMAX
+
+#include "searchMode.h"
+#include "searchWorker.h"
+#include "trigramIndex.h"
+#include "undoStack.h"
+#include "textEditorGlobals.h" // For textBuffer
+#include "textMetrics.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::wstring MakeText(size_t lines) {
+    const wchar_t* words[] = {L"alpha", L"beta", L"gamma", L"delta", L"epsilon", L"zeta", L"eta", L"theta"};
+    std::mt19937 random(1);
+    std::wstring text;
+    for (size_t line = 0; line < lines; ++line) {
+        int count = 4 + random() % 8;
+        for (int i = 0; i < count; ++i) {
+            text += words[random() % 8];
+            text += i + 1 < count ? L' ' : L'\n';
+        }
+    }
+    return text;
+}
+
+// Until the trigram index is in and the search has streamed all its results
+static void Settle(HWND hwnd) {
+    MSG msg;
+    while ((searchInProgress || TrigramIndexBytes() == 0) && GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message == WM_INDEX_READY) {
+            FinishTrigramIndex(hwnd, msg.lParam);
+        } else if (msg.message == WM_SEARCH_RESULTS) {
+            ReceiveSearchResults(hwnd, msg.lParam);
+        }
+    }
+}
+
+template <typename Action>
+static void Time(HWND hwnd, const char* name, Action action) {
+    uint64_t before = textBuffer.contentHash();
+    double start = Seconds();
+    action();
+    double blocked = Seconds() - start;
+    Settle(hwnd);
+    double settled = Seconds() - start;
+    printf("%-12s %8.1f ms blocked, %8.1f ms until settled, %zu matches of \"%ls\"%s\n", name, blocked * 1000,
+           settled * 1000, searchMatches.size(), searchQuery.c_str(),
+           textBuffer.contentHash() == before ? ", text unchanged" : "");
+}
+
+int main(int argc, char** argv) {
+    size_t lines = argc > 1 ? (size_t)atoll(argv[1]) : 1000000;
+
+    HWND hwnd = CreateWindowExW(0, L"STATIC", L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, NULL, NULL);
+    textBuffer.load(MakeText(lines));
+    calcTextMetrics(hwnd);
+    StartTrigramIndex(hwnd);
+    Settle(hwnd);
+    uint64_t original = textBuffer.contentHash();
+
+    searchBoxText = L"Search: alpha";
+    double start = Seconds();
+    FindAllMatches(hwnd);
+    Settle(hwnd);
+    printf("%zu lines, %zu characters, %zu matches found in %.1f ms\n", textBuffer.lineCount(), textBuffer.length(),
+           searchMatches.size(), (Seconds() - start) * 1000);
+
+    replaceBoxText = L"Replace: omega";
+    Time(hwnd, "replace all", [&]() { ReplaceAllMatches(hwnd); });
+    Time(hwnd, "undo", [&]() { PerformUndo(hwnd); });
+    if (textBuffer.contentHash() != original) {
+        printf("Undo didn't give back the original text\n");
+        return 1;
+    }
+    Time(hwnd, "redo", [&]() { PerformRedo(hwnd); });
+
+    StopSearch();
+    CancelTrigramIndex();
+    DestroyWindow(hwnd);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+// Replace-all against a plain per-line replace on random documents, small ones and ones of a few
+// million characters that rebuild in many blocks: the text after the replace, after its undo
+// and after its redo, and that LinesChanged is called once over the replaced lines. Replacements
+// shorter, longer and empty, so the blocks after the first move. Prints "ok" or where it failed.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/replaceCheck.cpp replaceText.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp undoHistory.cpp spillFile.cpp -o replaceCheck.exe
+replaceCheck.exe
+*/
+#define NOMINMAX
+
+#include "replaceText.h"
+#include "frameScheduler.h"
+#include "isModified.h"
+#include "textEditorGlobals.h" // For textBuffer
+
+#include <windows.h>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// What replaceText.cpp needs from the rest of the editor, the edits going straight to textBuffer
+UndoHistory undoHistory(256 * 1024 * 1024);
+static int linesChangedCalls = 0;
+static int changedLine, changedRemoved, changedInserted; // Of the last call
+
+void LinesChanged(int line, int removedLines, int insertedLines) {
+    linesChangedCalls++;
+    changedLine = line;
+    changedRemoved = removedLines;
+    changedInserted = insertedLines;
+}
+
+void InsertAtOffset(size_t offset, const wchar_t* text, size_t count) {
+    textBuffer.insertAt(offset, text, count);
+}
+
+void EraseAtOffset(size_t offset, size_t count) {
+    textBuffer.eraseAt(offset, count);
+}
+
+void ScheduleLayout(unsigned) {}
+void isModifiedTag(const PieceTable&, HWND) {}
+
+static std::mt19937 randomNumbers(3);
+
+// Lines of 'a' and 'b', about one in lineEvery characters a line break
+static std::wstring MakeText(size_t chars, unsigned lineEvery) {
+    std::wstring text;
+    for (size_t i = 0; i < chars; ++i) {
+        text += randomNumbers() % lineEvery == 0 ? L'\n' : (wchar_t)(L'a' + randomNumbers() % 2);
+    }
+    return text;
+}
+
+static std::vector<SearchMatch> FindAll(const std::wstring& query) {
+    std::vector<SearchMatch> matches;
+    std::wstring line;
+    for (size_t i = 0; i < textBuffer.lineCount(); ++i) {
+        textBuffer.getLine(i, line);
+        for (size_t at = line.find(query); at != std::wstring::npos; at = line.find(query, at + query.length())) {
+            matches.push_back(SearchMatch{(int)i, (int)at, (int)query.length()});
+        }
+    }
+    return matches;
+}
+
+static std::wstring ReplaceEachLine(const std::wstring& query, const std::wstring& replacement) {
+    std::wstring result;
+    std::wstring line;
+    for (size_t i = 0; i < textBuffer.lineCount(); ++i) {
+        textBuffer.getLine(i, line);
+        size_t copied = 0;
+        for (size_t at = line.find(query); at != std::wstring::npos; at = line.find(query, copied)) {
+            result.append(line, copied, at - copied);
+            result += replacement;
+            copied = at + query.length();
+        }
+        result.append(line, copied, std::wstring::npos);
+        if (i + 1 < textBuffer.lineCount()) result += L'\n';
+    }
+    return result;
+}
+
+static bool CheckRound(int round, size_t chars, unsigned lineEvery) {
+    textBuffer.load(MakeText(chars, lineEvery));
+    for (int i = 0; i < 10; ++i) {
+        size_t offset = randomNumbers() % (textBuffer.length() + 1);
+        textBuffer.insertAt(offset, L"ab\nb", 1 + randomNumbers() % 4); // Some add buffer pieces too
+    }
+    const wchar_t* queries[] = {L"ab", L"b", L"aab"};
+    const wchar_t* replacements[] = {L"", L"Q", L"XYZW"};
+    std::wstring query = queries[randomNumbers() % 3];
+    std::wstring replacement = replacements[randomNumbers() % 3];
+
+    std::wstring before = textBuffer.getText();
+    std::vector<SearchMatch> matches = FindAll(query);
+    std::wstring expected = ReplaceEachLine(query, replacement);
+    linesChangedCalls = 0;
+    ReplaceMatches(NULL, matches, replacement);
+    if (textBuffer.getText() != expected) {
+        printf("round %d: replace gave the wrong text\n", round);
+        return false;
+    }
+    if (matches.empty()) return true;
+    int touched = matches.back().line - matches.front().line;
+    if (linesChangedCalls != 1 || changedLine != matches.front().line || changedRemoved != touched ||
+        changedInserted != touched) {
+        printf("round %d: LinesChanged called %d times, last (%d, %d, %d) for matches on lines %d-%d\n", round,
+               linesChangedCalls, changedLine, changedRemoved, changedInserted, matches.front().line,
+               matches.back().line);
+        return false;
+    }
+    UndoReplace(undoHistory.undo());
+    if (textBuffer.getText() != before) {
+        printf("round %d: undo didn't give back the original text\n", round);
+        return false;
+    }
+    RedoReplace(undoHistory.redo());
+    if (textBuffer.getText() != expected) {
+        printf("round %d: redo didn't give back the replaced text\n", round);
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    for (int round = 0; round < 300; ++round) {
+        if (!CheckRound(round, randomNumbers() % 5000, 5)) return 1;
+    }
+    for (int round = 300; round < 306; ++round) {
+        if (!CheckRound(round, 3000000 + randomNumbers() % 3000000, 40)) return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
\ No newline at end of file
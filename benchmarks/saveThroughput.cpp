@@ -0,0 +1,135 @@
+// Save throughput of a generated document (100 MB of text unless a size is given) that has
+// been edited in a few thousand places: the snapshot the UI thread takes, the encoder on its
+// own, and whole WriteSnapshot saves, against the std::wofstream line-by-line save it replaced.
+// The files are written to the current directory and deleted afterwards.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/saveThroughput.cpp WindowProc.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp charScan.cpp textEncoding.cpp lineWidths.cpp viewport.cpp damageTracker.cpp frameScheduler.cpp textMetrics.cpp glyphAdvances.cpp updateCaretAndScroll.cpp fileOperations.cpp fileSave.cpp spillFile.cpp editJournal.cpp undoHistory.cpp undoStack.cpp characterCase.cpp isModified.cpp cursorControls.cpp replaceText.cpp searchMode.cpp matchList.cpp searchWorker.cpp regexSearch.cpp trigramIndex.cpp infoBar.cpp -o saveThroughput.exe -municode -lcomdlg32
+saveThroughput.exe [MB]
+*/
+#define NOMINMAX
+
+#include "fileSave.h"
+#include "textEncoding.h"
+#include "textEditorGlobals.h" // For textBuffer
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::mt19937 randomNumbers(1);
+
+static std::wstring MakeText(size_t chars) {
+    const wchar_t* words[] = {L"alpha", L"beta", L"gamma", L"caf\u00e9", L"\u2192", L"zeta", L"na\u00efve", L"theta"};
+    std::wstring text;
+    text.reserve(chars + 16);
+    while (text.length() < chars) {
+        text += words[randomNumbers() % 8];
+        text += randomNumbers() % 10 == 0 ? L'\n' : L' ';
+    }
+    return text;
+}
+
+static std::string Narrow(const wchar_t* path) {
+    std::string narrow;
+    for (const wchar_t* at = path; *at; ++at) narrow += (char)*at;
+    return narrow;
+}
+
+static size_t FileBytes(const wchar_t* path) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    CloseHandle(file);
+    return (size_t)size.QuadPart;
+}
+
+// What SaveTextToFile used to do: every line through the default locale, in place
+static double OldSave(const wchar_t* path) {
+    double start = Seconds();
+    std::wofstream file(Narrow(path));
+    std::wstring line;
+    for (size_t i = 0; i < textBuffer.lineCount(); ++i) {
+        textBuffer.getLine(i, line);
+        file << line;
+        if (i + 1 < textBuffer.lineCount()) file << L'\n';
+    }
+    file.close();
+    return Seconds() - start;
+}
+
+static void Report(const char* name, double seconds, size_t bytes) {
+    printf("%-32s %10.1f %10.0f\n", name, seconds * 1000, bytes / 1048576.0 / seconds);
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)atoll(argv[1]) : 100;
+    textBuffer.load(MakeText(megabytes << 20));
+    for (int i = 0; i < 5000; ++i) {
+        size_t offset = randomNumbers() % textBuffer.length();
+        textBuffer.insertAt(offset, L"edit ", 5);
+    }
+
+    double start = Seconds();
+    TextSnapshot snapshot = textBuffer.snapshot();
+    double snapshotSeconds = Seconds() - start;
+    size_t runs = 0;
+    snapshot.forEachRun([&](const wchar_t*, size_t) { runs++; });
+    printf("%zu characters in %zu runs, snapshot on the UI thread took %.2f ms\n", snapshot.length(), runs,
+           snapshotSeconds * 1000);
+    printf("%-32s %10s %10s\n", "", "ms", "MB/s out");
+
+    struct Format {
+        const char* name;
+        TextEncoding encoding;
+        LineEnding lineEnding;
+    };
+    for (const Format& format : {Format{"encode UTF-8", TextEncoding::UTF8, LineEnding::LF},
+                                 Format{"encode UTF-8, CRLF", TextEncoding::UTF8, LineEnding::CRLF},
+                                 Format{"encode UTF-16LE", TextEncoding::UTF16LE, LineEnding::LF}}) {
+        // The same batches WriteSnapshot makes, with the bytes dropped instead of written
+        TextEncoder encoder(format.encoding, format.lineEnding);
+        std::string out;
+        size_t bytes = 0;
+        start = Seconds();
+        snapshot.forEachRun([&](const wchar_t* text, size_t count) {
+            for (size_t done = 0; done < count; done += 1 << 20) {
+                encoder.encode(text + done, std::min(count - done, (size_t)1 << 20), out);
+                bytes += out.size();
+                out.clear();
+            }
+        });
+        encoder.finish(out);
+        Report(format.name, Seconds() - start, bytes + out.size());
+    }
+
+    const wchar_t* path = L"saveThroughput.txt";
+    for (int i = 0; i < 2; ++i) { // The second save goes over an existing file
+        start = Seconds();
+        bool ok = WriteSnapshot(snapshot, path, TextEncoding::UTF8, LineEnding::LF);
+        double seconds = Seconds() - start;
+        if (!ok) {
+            printf("WriteSnapshot failed\n");
+            return 1;
+        }
+        Report(i == 0 ? "WriteSnapshot, new file" : "WriteSnapshot, replacing it", seconds, FileBytes(path));
+    }
+    DeleteFileW(path);
+
+    double old = OldSave(path);
+    Report("wofstream line by line", old, FileBytes(path));
+    DeleteFileW(path);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+// Full-document search time against the number of search workers, for a literal and a regex
+// query over a generated document: 5M lines and up to every hardware thread unless given.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/searchScaling.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp searchWorker.cpp regexSearch.cpp -o searchScaling.exe
+searchScaling.exe [lines] [most threads]
+*/
+#define NOMINMAX
+
+#include "searchWorker.h"
+#include "textEditorGlobals.h" // For textBuffer
+#include "regexSearch.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+// Words of two to nine letters, with "needle" in about one line in a thousand
+static std::wstring MakeDocument(size_t lines) {
+    std::mt19937 random(1);
+    std::wstring text;
+    text.reserve(lines * 48);
+    for (size_t line = 0; line < lines; ++line) {
+        size_t words = 3 + random() % 8;
+        for (size_t word = 0; word < words; ++word) {
+            if (word != 0) text += L' ';
+            if (random() % 8000 == 0) {
+                text += L"needle";
+                continue;
+            }
+            size_t letters = 2 + random() % 8;
+            for (size_t letter = 0; letter < letters; ++letter) text += (wchar_t)(L'a' + random() % 26);
+        }
+        if (line + 1 < lines) text += L'\n';
+    }
+    return text;
+}
+
+// Runs one search to its last batch, returning the seconds taken and the matches found
+static double TimeSearch(HWND hwnd, const std::wstring& query, std::shared_ptr<const RegexProgram> regex,
+                         size_t& matches) {
+    double start = Seconds();
+    uint64_t generation = StartSearch(hwnd, query, regex, SearchOptions{false, false}, {});
+    matches = 0;
+    MSG msg;
+    while (GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message != WM_SEARCH_RESULTS) continue;
+        SearchBatch* batch = (SearchBatch*)msg.lParam;
+        bool done = batch->generation == generation && batch->done;
+        if (batch->generation == generation) matches += batch->occurrences.size();
+        delete batch;
+        if (done) break;
+    }
+    return Seconds() - start;
+}
+
+int main(int argc, char** argv) {
+    size_t lines = argc > 1 ? (size_t)atoll(argv[1]) : 5000000;
+    textBuffer.load(MakeDocument(lines));
+    printf("%zu lines, %zu characters\n", lines, textBuffer.length());
+
+    // Results are read straight off the queue, the window only gives them an address
+    HWND hwnd = CreateWindowExW(0, L"STATIC", L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, NULL, NULL);
+    std::wstring error;
+    std::shared_ptr<const RegexProgram> regex = CompileRegex(L"ne+dle|[xyz]{4}", false, error);
+
+    unsigned most = argc > 2 ? (unsigned)atoi(argv[2]) : std::thread::hardware_concurrency();
+    most = std::max(1u, most);
+    printf("threads  literal ms  regex ms  literal matches  regex matches\n");
+    for (unsigned threads = 1; threads <= most; threads *= 2) {
+        SetSearchThreads(threads);
+        size_t literalMatches, regexMatches;
+        TimeSearch(hwnd, L"needle", nullptr, literalMatches); // Starts the pool and warms the caches
+        double literal = TimeSearch(hwnd, L"needle", nullptr, literalMatches);
+        double pattern = TimeSearch(hwnd, L"", regex, regexMatches);
+        printf("%7u  %10.1f  %8.1f  %15zu  %13zu\n", threads, literal * 1000, pattern * 1000,
+               literalMatches, regexMatches);
+        if (threads < most && threads * 2 > most) threads = most / 2;
+    }
+    StopSearch();
+    DestroyWindow(hwnd);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+// SubstringSearcher over one block of text, the way the search workers call it, against
+// std::wstring::find line by line as FindAllMatches used to search. Short, medium and long
+// needles, common and rare, on a generated log (100M characters unless a size is given).
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/substringSearch.cpp charScan.cpp -o substringSearch.exe
+substringSearch.exe [characters]
+*/
+#define NOMINMAX
+
+#include "charScan.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::wstring MakeLog(size_t chars) {
+    const wchar_t* levels[] = {L"INFO", L"INFO", L"INFO", L"WARN", L"ERROR"};
+    std::mt19937 random(1);
+    std::wstring text;
+    text.reserve(chars + 200);
+    while (text.length() < chars) {
+        text += L"2024-03-12 " + std::to_wstring(random() % 86400) + L" " + levels[random() % 5] +
+                L" request " + std::to_wstring(random() % 100000) + L" from user" +
+                std::to_wstring(random() % 5000) + L"@example.com took " + std::to_wstring(random() % 900) + L"ms";
+        if (random() % 20000 == 0) {
+            text += L" connection reset by peer while reading response headers";
+        }
+        text += L'\n';
+    }
+    return text;
+}
+
+// Every occurrence, overlapping ones included, as the workers report them
+static size_t Ours(const std::wstring& needle, bool ignoreCase, const std::wstring& text, double& seconds) {
+    SubstringSearcher searcher(needle, ignoreCase);
+    size_t count = 0;
+    double start = Seconds();
+    for (size_t pos = searcher.find(text.data(), text.length()); pos < text.length();
+         pos = searcher.find(text.data(), text.length(), pos + 1)) {
+        count++;
+    }
+    seconds = Seconds() - start;
+    return count;
+}
+
+static size_t Old(const std::wstring& needle, const std::vector<std::wstring>& lines, double& seconds) {
+    size_t count = 0;
+    double start = Seconds();
+    for (const std::wstring& line : lines) {
+        for (size_t pos = line.find(needle); pos != std::wstring::npos; pos = line.find(needle, pos + 1)) {
+            count++;
+        }
+    }
+    seconds = Seconds() - start;
+    return count;
+}
+
+int main(int argc, char** argv) {
+    size_t chars = argc > 1 ? (size_t)atoll(argv[1]) : 100000000;
+    std::wstring text = MakeLog(chars);
+    std::vector<std::wstring> lines;
+    for (size_t start = 0; start < text.length();) {
+        size_t end = text.find(L'\n', start);
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    printf("%zu characters, %zu lines\n", text.length(), lines.size());
+    printf("%-60s %10s %10s %10s %10s\n", "needle", "ours ms", "matches", "find ms", "matches");
+
+    const wchar_t* needles[] = {L"ERROR", L"took 42ms", L"user4242@", L"request 12345 from",
+                                L"@example.com took 899ms", L"connection reset by peer while reading response headers",
+                                L"connection reset by peer while reading response trailers"};
+    for (const wchar_t* needle : needles) {
+        double ours, old;
+        size_t ourCount = Ours(needle, false, text, ours);
+        size_t oldCount = Old(needle, lines, old);
+        printf("%-60ls %10.1f %10zu %10.1f %10zu\n", needle, ours * 1000, ourCount, old * 1000, oldCount);
+    }
+
+    // There was no case-insensitive search before, so these have nothing to compare against
+    printf("\nIgnoring case\n");
+    for (const wchar_t* needle : {L"error", L"Connection Reset By Peer"}) {
+        double ours;
+        size_t ourCount = Ours(needle, true, text, ours);
+        printf("%-60ls %10.1f %10zu\n", needle, ours * 1000, ourCount);
+    }
+    return 0;
+}
\ No newline at end of file
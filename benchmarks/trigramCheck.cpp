@@ -0,0 +1,178 @@
+// The trigram index against a full scan on random documents of a little over 4M characters:
+// typing, pastes of a few words to a few thousand, deletions across blocks, edits made while
+// the background build runs and edits over 1 MB that start a fresh build. Every line that
+// holds the query has to stay a candidate, and a search over the candidate spans has to
+// find what a scan of every line finds. Prints "ok" or where it failed.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/trigramCheck.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp trigramIndex.cpp searchWorker.cpp regexSearch.cpp -o trigramCheck.exe
+trigramCheck.exe
+*/
+#define NOMINMAX
+
+#include "trigramIndex.h"
+#include "searchWorker.h"
+#include "textEditorGlobals.h" // For textBuffer
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cwctype>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+static std::mt19937 randomNumbers(7);
+static HWND window;
+
+static std::wstring Word() {
+    const wchar_t* words[] = {L"alpha", L"Beta", L"gamma", L"DELTA", L"eps", L"zeta", L"theta", L"iota"};
+    return words[randomNumbers() % 8];
+}
+
+static std::wstring MakeText(size_t chars) {
+    std::wstring text;
+    while (text.length() < chars) {
+        text += Word();
+        text += randomNumbers() % 8 == 0 ? L'\n' : L' ';
+        if (randomNumbers() % 50 == 0) text += L"\n\n";
+    }
+    return text;
+}
+
+// Each edit goes through textBuffer and then the index, as LinesChanged would call it
+static void RandomEdit(bool large) {
+    size_t line = randomNumbers() % textBuffer.lineCount();
+    size_t offset = textBuffer.lineStart(line) + randomNumbers() % (textBuffer.lineLength(line) + 1);
+    if (large || randomNumbers() % 2) {
+        std::wstring text;
+        bool breaks = randomNumbers() % 4 != 0;
+        int words = large ? 250000 : randomNumbers() % 40 == 0 ? 3000 : 5;
+        for (int i = 0; i < words; ++i) {
+            text += Word();
+            text += breaks && randomNumbers() % 3 == 0 ? L'\n' : L' ';
+        }
+        textBuffer.insertAt(offset, text.data(), text.length());
+        TrigramLinesChanged((int)line, 0, (int)std::count(text.begin(), text.end(), L'\n'));
+    } else {
+        size_t count = std::min<size_t>(randomNumbers() % 3000, textBuffer.length() - offset);
+        std::wstring text = textBuffer.getRange(offset, count);
+        textBuffer.eraseAt(offset, count);
+        TrigramLinesChanged((int)line, (int)std::count(text.begin(), text.end(), L'\n'), 0);
+    }
+}
+
+// Pumps messages until the build lands, as the window would between edits
+static void WaitForIndex() {
+    std::vector<std::pair<int, int>> spans;
+    MSG msg;
+    while (!TrigramCandidateLines(L"abc", spans) && GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message == WM_INDEX_READY) {
+            FinishTrigramIndex(window, msg.lParam);
+        } else if (msg.message == WM_SEARCH_RESULTS) {
+            delete (SearchBatch*)msg.lParam;
+        }
+    }
+}
+
+typedef std::vector<std::tuple<int, int, int>> Occurrences; // (line, col, length)
+
+static Occurrences Search(const std::wstring& query, const std::vector<ScanRange>& ranges) {
+    uint64_t generation = StartSearch(window, query, nullptr, SearchOptions{false, false}, ranges);
+    Occurrences found;
+    MSG msg;
+    while (GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message != WM_SEARCH_RESULTS) continue;
+        SearchBatch* batch = (SearchBatch*)msg.lParam;
+        bool done = batch->generation == generation && batch->done;
+        if (batch->generation == generation) {
+            for (const SearchMatch& match : batch->occurrences) found.emplace_back(match.line, match.col, match.length);
+        }
+        delete batch;
+        if (done) break;
+    }
+    return found;
+}
+
+static std::wstring Lowered(std::wstring text) {
+    for (wchar_t& ch : text) ch = (wchar_t)towlower(ch);
+    return text;
+}
+
+static bool CheckQuery(int round, int edit, const std::wstring& query) {
+    std::vector<std::pair<int, int>> spans;
+    if (!TrigramCandidateLines(query, spans)) {
+        printf("round %d, edit %d: no index for \"%ls\"\n", round, edit, query.c_str());
+        return false;
+    }
+    size_t lines = textBuffer.lineCount();
+    std::vector<char> candidate(lines, 0);
+    std::vector<ScanRange> ranges;
+    for (const auto& [first, count] : spans) {
+        if ((size_t)first + count > lines) {
+            printf("round %d, edit %d: a span runs past the last line\n", round, edit);
+            return false;
+        }
+        std::fill(candidate.begin() + first, candidate.begin() + first + count, 1);
+        size_t end = (size_t)first + count;
+        ranges.push_back(ScanRange{textBuffer.lineStart(first),
+                                   end < lines ? textBuffer.lineStart(end) : textBuffer.length() + 1, first});
+    }
+
+    std::wstring folded = Lowered(query);
+    Occurrences expected;
+    std::wstring line;
+    for (size_t i = 0; i < lines; ++i) {
+        textBuffer.getLine(i, line);
+        if (!candidate[i] && Lowered(line).find(folded) != std::wstring::npos) {
+            printf("round %d, edit %d: line %zu holds \"%ls\" but is not a candidate\n", round, edit, i, query.c_str());
+            return false;
+        }
+        for (size_t at = line.find(query); at != std::wstring::npos; at = line.find(query, at + 1)) {
+            expected.emplace_back((int)i, (int)at, (int)query.length());
+        }
+    }
+    if (ranges.empty()) {
+        if (expected.empty()) return true;
+        printf("round %d, edit %d: no candidates for \"%ls\" but it is in the text\n", round, edit, query.c_str());
+        return false;
+    }
+    Occurrences found = Search(query, ranges);
+    if (found != expected) {
+        printf("round %d, edit %d: %zu results for \"%ls\" over the candidates, a full scan finds %zu\n", round,
+               edit, found.size(), query.c_str(), expected.size());
+        return false;
+    }
+    return true;
+}
+
+static bool CheckRound(int round) {
+    textBuffer.load(MakeText(4300000));
+    StartTrigramIndex(window);
+    for (int i = 0; i < 50; ++i) RandomEdit(round == 1 && i == 25); // While it builds
+    WaitForIndex();
+
+    for (int edit = 0; edit < 3000; ++edit) {
+        RandomEdit(edit % 1000 == 500); // The edits after it until the next query land during the build
+        if (edit % 150 != 0) continue;
+        WaitForIndex();
+
+        std::wstring query = Word().substr(1) + L" " + Word().substr(0, 2);
+        if (randomNumbers() % 3 == 0) query = L"zzq";
+        if (randomNumbers() % 3 == 0) query = Word();
+        if (!CheckQuery(round, edit, query)) return false;
+    }
+    return true;
+}
+
+int main() {
+    window = CreateWindowExW(0, L"STATIC", L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, NULL, NULL);
+    bool ok = true;
+    for (int round = 0; round < 3 && ok; ++round) ok = CheckRound(round);
+    StopSearch();
+    CancelTrigramIndex();
+    DestroyWindow(window);
+    if (ok) printf("ok\n");
+    return ok ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+// Cost of keeping the trigram index up to date, per kind of edit, on a generated document
+// (20M characters unless a size is given).
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/trigramEdits.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp textEncoding.cpp charScan.cpp trigramIndex.cpp -o trigramEdits.exe
+trigramEdits.exe [characters]
+*/
+#define NOMINMAX
+
+#include "trigramIndex.h"
+#include "textEditorGlobals.h" // For textBuffer
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::mt19937 randomNumbers(1);
+
+static std::wstring MakeText(size_t chars) {
+    const wchar_t* words[] = {L"alpha", L"beta", L"gamma", L"delta", L"epsilon", L"zeta", L"eta", L"theta"};
+    std::wstring text;
+    text.reserve(chars + 16);
+    while (text.length() < chars) {
+        text += words[randomNumbers() % 8];
+        text += randomNumbers() % 8 == 0 ? L'\n' : L' ';
+    }
+    return text;
+}
+
+static size_t RandomOffset(size_t& line) {
+    line = randomNumbers() % textBuffer.lineCount();
+    return textBuffer.lineStart(line) + randomNumbers() % (textBuffer.lineLength(line) + 1);
+}
+
+// Each edit goes through textBuffer and then the index, as LinesChanged would call it
+static void Insert(const std::wstring& text) {
+    size_t line;
+    size_t offset = RandomOffset(line);
+    int newlines = 0;
+    for (wchar_t ch : text) newlines += ch == L'\n';
+    textBuffer.insertAt(offset, text.data(), text.length());
+    TrigramLinesChanged((int)line, 0, newlines);
+}
+
+static void EraseLine() {
+    size_t line = randomNumbers() % (textBuffer.lineCount() - 1);
+    textBuffer.eraseAt(textBuffer.lineStart(line), textBuffer.lineLength(line) + 1);
+    TrigramLinesChanged((int)line, 1, 0);
+}
+
+template <typename Edit>
+static void Time(const char* name, int count, Edit edit) {
+    double start = Seconds();
+    for (int i = 0; i < count; ++i) edit();
+    double seconds = Seconds() - start;
+    printf("%-28s %8d %12.2f\n", name, count, seconds * 1e6 / count);
+}
+
+int main(int argc, char** argv) {
+    size_t chars = argc > 1 ? (size_t)atoll(argv[1]) : 20000000;
+    textBuffer.load(MakeText(chars));
+
+    HWND hwnd = CreateWindowExW(0, L"STATIC", L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, NULL, NULL);
+    StartTrigramIndex(hwnd);
+    MSG msg;
+    while (GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message == WM_INDEX_READY) {
+            FinishTrigramIndex(hwnd, msg.lParam);
+            break;
+        }
+    }
+    printf("%zu characters, %zu lines, index %zu KB built in %.1f ms\n", textBuffer.length(),
+           textBuffer.lineCount(), TrigramIndexBytes() / 1024, TrigramIndexMillis());
+
+    std::wstring paste = MakeText(4000);
+    printf("%-28s %8s %12s\n", "edit", "count", "us per edit");
+    Time("type a character", 100000, []() { Insert(L"x"); });
+    Time("type a word", 100000, []() { Insert(L"kappa "); });
+    Time("press Enter", 100000, []() { Insert(L"\n"); });
+    Time("delete a line", 100000, []() { EraseLine(); });
+    Time("paste 4000 characters", 10000, [&]() { Insert(paste); });
+
+    CancelTrigramIndex();
+    DestroyWindow(hwnd);
+    return 0;
+}
\ No newline at end of file
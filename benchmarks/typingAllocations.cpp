@@ -0,0 +1,140 @@
+// Heap allocations per keystroke while typing and backspacing into a large document, with
+// every LinesChanged hook live: line widths, glyph advances, an active search and the
+// trigram index, plus the journal. Counts operator new on every thread.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/typingAllocations.cpp WindowProc.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp charScan.cpp textEncoding.cpp lineWidths.cpp viewport.cpp damageTracker.cpp frameScheduler.cpp textMetrics.cpp glyphAdvances.cpp updateCaretAndScroll.cpp fileOperations.cpp fileSave.cpp spillFile.cpp editJournal.cpp undoHistory.cpp undoStack.cpp characterCase.cpp isModified.cpp cursorControls.cpp replaceText.cpp searchMode.cpp matchList.cpp searchWorker.cpp regexSearch.cpp trigramIndex.cpp infoBar.cpp -o typingAllocations.exe -municode -lcomdlg32
+typingAllocations.exe [lines] [rounds]
+*/
+#define NOMINMAX
+
+#include "characterCase.h"
+#include "textEditorGlobals.h" // For textBuffer and the caret
+#include "textMetrics.h"
+#include "searchMode.h"
+#include "searchWorker.h"
+#include "trigramIndex.h"
+#include "editJournal.h"
+
+#include <windows.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* block = malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    free(block);
+}
+
+static double Seconds() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static std::wstring MakeText(size_t lines) {
+    const wchar_t* words[] = {L"alpha", L"beta", L"gamma", L"delta", L"epsilon", L"zeta", L"eta", L"theta"};
+    std::mt19937 random(1);
+    std::wstring text;
+    for (size_t line = 0; line < lines; ++line) {
+        int count = 4 + random() % 8;
+        for (int i = 0; i < count; ++i) {
+            text += words[random() % 8];
+            text += i + 1 < count ? L' ' : L'\n';
+        }
+    }
+    return text;
+}
+
+// Waits for the trigram index, or for the search to stream all its results in
+static void Pump(HWND hwnd, UINT until) {
+    MSG msg;
+    while (GetMessageW(&msg, NULL, 0, 0)) {
+        if (msg.message == WM_INDEX_READY) {
+            FinishTrigramIndex(hwnd, msg.lParam);
+            if (until == WM_INDEX_READY) return;
+        } else if (msg.message == WM_SEARCH_RESULTS) {
+            ReceiveSearchResults(hwnd, msg.lParam);
+            if (!searchInProgress) return;
+        }
+    }
+}
+
+// Types a sentence of words that contain the query, then backspaces over all of it
+static size_t TypeAndErase(HWND hwnd, const std::wstring& sentence) {
+    for (wchar_t ch : sentence) {
+        if (ch == L' ') {
+            spaceCase(ch, hwnd);
+        } else {
+            defaultCase(ch, hwnd);
+        }
+    }
+    for (size_t i = 0; i < sentence.length(); ++i) {
+        backspaceCase(L'\b', hwnd);
+    }
+    return sentence.length() * 2;
+}
+
+int main(int argc, char** argv) {
+    size_t lines = argc > 1 ? (size_t)atoll(argv[1]) : 1000000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+    HWND hwnd = CreateWindowExW(0, L"STATIC", L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, NULL, NULL);
+    textBuffer.load(MakeText(lines));
+    calcTextMetrics(hwnd);
+    StartTrigramIndex(hwnd);
+    Pump(hwnd, WM_INDEX_READY);
+    searchBoxText = L"Search: alpha";
+    FindAllMatches(hwnd);
+    Pump(hwnd, WM_SEARCH_RESULTS);
+    StartJournal(L"typingAllocations.txt", textBuffer.contentHash(), false);
+    printf("%zu lines, %zu matches for \"%ls\"\n", textBuffer.lineCount(), searchMatches.size(), searchQuery.c_str());
+
+    // The first rounds grow the scratch buffers to their working size
+    const std::wstring sentence = L"alphabet soup alpha beta alphanumeric gamma ";
+    caretLine = (int)textBuffer.lineCount() / 2;
+    caretCol = (int)textBuffer.lineLength(caretLine);
+    for (int i = 0; i < 10; ++i) TypeAndErase(hwnd, sentence);
+
+    size_t keystrokes = 0;
+    size_t before = allocations;
+    double start = Seconds();
+    for (int i = 0; i < rounds; ++i) keystrokes += TypeAndErase(hwnd, sentence);
+    double seconds = Seconds() - start;
+    size_t counted = allocations - before;
+    printf("%zu keystrokes, %zu allocations (%.4f per keystroke), %.2f us per keystroke\n", keystrokes, counted,
+           (double)counted / keystrokes, seconds * 1e6 / keystrokes);
+
+    CloseJournal();
+    StopSearch();
+    CancelTrigramIndex();
+    DestroyWindow(hwnd);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+// Typing after a save has to start a new undo node, the saved one stays the text on disk.
+// Saves, types more, closes without saving and opens the file again, then checks undo
+// takes the text back to what it was before the saved group, not past it. Also covers a
+// background save, where typing goes on while the file is written, and undo in the same
+// session. The side file is written to the current directory and deleted afterwards.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/undoSaveCheck.cpp undoHistory.cpp spillFile.cpp -o undoSaveCheck.exe
+undoSaveCheck.exe
+*/
+#define NOMINMAX
+
+#include "undoHistory.h"
+
+#include <windows.h>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+static const wchar_t* SPILL_PATH = L"undoSaveCheck.undo";
+
+static uint64_t HashOf(const std::wstring& text) {
+    return std::hash<std::wstring>()(text);
+}
+
+// Types ch at the end of a one line document, merging into the last entry as RecordTyping does
+static void Type(UndoHistory& history, std::wstring& document, wchar_t ch) {
+    int col = (int)document.size();
+    UndoEntry last;
+    if (history.last(last) && last.type == UndoActionType::INSERT_TEXT && last.col + (int)last.text.length() == col) {
+        history.extendLast(ch, false);
+    } else {
+        history.push(UndoEntry{UndoActionType::INSERT_TEXT, 0, col, std::wstring_view(&ch, 1)});
+    }
+    document += ch;
+}
+
+static void Type(UndoHistory& history, std::wstring& document, const wchar_t* text) {
+    for (; *text; ++text) Type(history, document, *text);
+}
+
+// Undoes one entry, false when it doesn't fit the document
+static bool Undo(UndoHistory& history, std::wstring& document) {
+    if (!history.canUndo()) return false;
+    UndoEntry entry = history.undo();
+    if (entry.type != UndoActionType::INSERT_TEXT || entry.col < 0 ||
+        (size_t)entry.col + entry.text.length() > document.size() ||
+        document.compare(entry.col, entry.text.length(), entry.text.data(), entry.text.length()) != 0) {
+        return false;
+    }
+    document.erase(entry.col, entry.text.length());
+    return true;
+}
+
+static int failures = 0;
+
+static void Expect(bool ok, const char* what) {
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+// Saves "abc" and types "def" after it, with the save finished before or while typing
+static void SaveTypeReopenUndo(bool background) {
+    UndoHistory history(1 << 20);
+    std::wstring document;
+    history.attach(SPILL_PATH, HashOf(document));
+    Type(history, document, L"abc");
+
+    std::wstring disk = document;
+    uint64_t saved = background ? history.savePoint() : history.position();
+    if (!background) history.markSaved(saved, HashOf(disk));
+    Type(history, document, L"def");
+    if (background) history.markSaved(saved, HashOf(disk)); // The save finishes after the typing
+
+    history.detach(); // Closed with "Don't save"
+    document = disk;
+    history.attach(SPILL_PATH, HashOf(document));
+    Expect(Undo(history, document) && document.empty(),
+           background ? "background save, type, reopen, undo to before the save"
+                      : "save, type, reopen, undo to before the save");
+    history.detach();
+    DeleteFileW(SPILL_PATH);
+}
+
+static void SaveTypeUndo() {
+    UndoHistory history(1 << 20);
+    std::wstring document;
+    history.attach(L"", HashOf(document));
+    Type(history, document, L"abc");
+    history.markSaved(history.position(), HashOf(document));
+    Type(history, document, L"def");
+    Expect(Undo(history, document) && document == L"abc", "save, type, undo back to the saved text");
+    Expect(Undo(history, document) && document.empty(), "undo again to before the save");
+    history.detach();
+}
+
+int main() {
+    DeleteFileW(SPILL_PATH);
+    SaveTypeReopenUndo(false);
+    SaveTypeReopenUndo(true);
+    SaveTypeUndo();
+    return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+// The line and column ranges WM_PAINT draws for a paint rect: lines and columns only partly
+// inside it at the top, bottom and sides, scrolling past the end of the document or past the
+// end of a line, an empty document and an empty line. Prints each case with ok or FAILED.
+/*
+From the repository root
+g++ -O2 -std=c++17 -I. benchmarks/viewportCheck.cpp viewport.cpp -o viewportCheck.exe
+viewportCheck.exe
+*/
+#define NOMINMAX
+
+#include "viewport.h"
+
+#include <cstdio>
+
+static int failures = 0;
+
+static void Expect(bool ok, const char* what) {
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+static bool Is(LineRange range, int first, int last) {
+    return range.first == first && range.last == last;
+}
+
+static bool Is(ColumnRange range, int first, int last) {
+    return range.first == first && range.last == last;
+}
+
+// 20 pixel lines, scrollOffsetY in lines
+static void CheckLines() {
+    Expect(Is(VisibleLineRange(0, 100, 20, 0, 1000), 0, 5), "whole lines from the top");
+    Expect(Is(VisibleLineRange(20, 40, 20, 0, 1000), 1, 2), "rect on line boundaries");
+    Expect(Is(VisibleLineRange(15, 45, 20, 0, 1000), 0, 3), "partial lines at the top and bottom");
+    Expect(Is(VisibleLineRange(30, 70, 20, 10, 1000), 11, 14), "partial lines, scrolled");
+    Expect(Is(VisibleLineRange(0, 1, 20, 0, 1000), 0, 1), "one pixel row");
+    Expect(Is(VisibleLineRange(-10, 30, 20, 0, 1000), 0, 2), "rect above the client area");
+    Expect(Is(VisibleLineRange(0, 200, 20, 995, 1000), 995, 1000), "last lines, the rect runs past the end");
+    Expect(Is(VisibleLineRange(0, 200, 20, 1200, 1000), 1000, 1000), "scrolled past the end");
+    Expect(Is(VisibleLineRange(0, 200, 20, 0, 1), 0, 1), "empty document, one empty line");
+    Expect(Is(VisibleLineRange(0, 200, 20, 0, 0), 0, 0), "no lines at all");
+    Expect(Is(VisibleLineRange(50, 50, 20, 0, 1000), 0, 0), "empty rect");
+    Expect(Is(VisibleLineRange(0, 100, 0, 0, 1000), 0, 0), "no line height yet");
+}
+
+// 8 pixel columns, scrollOffsetX in pixels
+static void CheckColumns() {
+    Expect(Is(VisibleColumnRange(0, 80, 8, 0, 100), 0, 10), "whole columns from the left");
+    Expect(Is(VisibleColumnRange(4, 20, 8, 0, 100), 0, 3), "partial columns at both sides");
+    Expect(Is(VisibleColumnRange(0, 16, 8, 12, 100), 1, 4), "partial columns, scrolled mid column");
+    Expect(Is(VisibleColumnRange(0, 800, 8, 0, 10), 0, 10), "line shorter than the rect");
+    Expect(Is(VisibleColumnRange(0, 80, 8, 200, 10), 10, 10), "scrolled past the end of the line");
+    Expect(Is(VisibleColumnRange(0, 80, 8, 0, 0), 0, 0), "empty line");
+    Expect(Is(VisibleColumnRange(40, 40, 8, 0, 100), 0, 0), "empty rect");
+    Expect(Is(VisibleColumnRange(0, 80, 0, 0, 100), 0, 100), "no advance, the whole line");
+}
+
+int main() {
+    CheckLines();
+    CheckColumns();
+    return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "charScan.h"
+
+#include <windows.h> // For CharUpperBuffW, CharLowerBuffW
+#include <algorithm>
+#include <cwchar> // For WCHAR_MAX
+#include <cwctype>
+
+#if WCHAR_MAX == 0xFFFF && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define CHARSCAN_SSE2 1
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define CHARSCAN_AVX2 1
+#endif
+#endif
+
+size_t FindChar(const wchar_t* text, size_t count, wchar_t ch) {
+    size_t i = 0;
+#ifdef CHARSCAN_SSE2
+    const __m128i needle = _mm_set1_epi16((short)ch);
+    for (; i + 8 <= count; i += 8) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(block, needle));
+        if (mask != 0) {
+            return i + (__builtin_ctz(mask) >> 1); // Two mask bits per code unit
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        if (text[i] == ch) return i;
+    }
+    return count;
+}
+
+size_t CountChar(const wchar_t* text, size_t count, wchar_t ch) {
+    size_t total = 0;
+    size_t i = 0;
+#ifdef CHARSCAN_SSE2
+    const __m128i needle = _mm_set1_epi16((short)ch);
+    for (; i + 8 <= count; i += 8) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+        total += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi16(block, needle))) >> 1;
+    }
+#endif
+    for (; i < count; ++i) {
+        if (text[i] == ch) total++;
+    }
+    return total;
+}
+
+const CharTables charTables;
+
+CharTables::CharTables() {
+    for (unsigned unit = 0; unit <= 0xFFFF; ++unit) {
+        fold[unit] = (wchar_t)unit;
+        word[unit] = iswalnum((wint_t)unit) || unit == L'_';
+    }
+    // One call each over the whole plane, the same mapping the system uses for every locale
+    CharUpperBuffW(fold, 0x10000);
+    CharLowerBuffW(fold, 0x10000);
+    for (unsigned unit = 0xD800; unit <= 0xDFFF; ++unit) {
+        fold[unit] = (wchar_t)unit;
+    }
+}
+
+bool IsWholeWord(const wchar_t* line, size_t lineLength, size_t col, size_t length) {
+    size_t end = col + length;
+    bool startsWord = col == 0 || !IsWordChar(line[col - 1]) || !IsWordChar(line[col]);
+    bool endsWord = end >= lineLength || !IsWordChar(line[end]) || !IsWordChar(line[end - 1]);
+    return startsWord && endsWord;
+}
+
+namespace {
+    // Needles at least this long go through Horspool
+    const size_t HORSPOOL_MIN = 16;
+
+    // The search loops are instantiated twice, folding text units as they are read or not
+    template <bool folded>
+    inline wchar_t unitAt(const wchar_t* text, size_t i) {
+        return folded ? FoldCase(text[i]) : text[i];
+    }
+
+    template <bool folded>
+    bool sameUnits(const wchar_t* a, const wchar_t* b, size_t count) {
+        if (!folded) return std::char_traits<wchar_t>::compare(a, b, count) == 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (FoldCase(a[i]) != b[i]) return false;
+        }
+        return true;
+    }
+
+    // Jumps between occurrences of the first unit, then verifies the rest
+    template <bool folded>
+    size_t findScalar(const wchar_t* text, size_t count, const wchar_t* needle, size_t length, size_t i) {
+        while (i + length <= count) {
+            if (folded) {
+                while (i + length <= count && FoldCase(text[i]) != needle[0]) i++;
+            } else {
+                i += FindChar(text + i, count - length + 1 - i, needle[0]);
+            }
+            if (i + length > count) break;
+            if (sameUnits<folded>(text + i + 1, needle + 1, length - 1)) return i;
+            i++;
+        }
+        return count;
+    }
+
+#ifdef CHARSCAN_SSE2
+    // Positions whose first and last units both match are the only ones verified in full.
+    // Folded, each end is compared against every unit that folds to it.
+    template <bool folded>
+    size_t findSse2(const wchar_t* text, size_t count, const wchar_t* needle, size_t length,
+                    const wchar_t* firsts, const wchar_t* lasts, size_t i) {
+        const __m128i first0 = _mm_set1_epi16((short)firsts[0]);
+        const __m128i first1 = _mm_set1_epi16((short)firsts[1]);
+        const __m128i first2 = _mm_set1_epi16((short)firsts[2]);
+        const __m128i last0 = _mm_set1_epi16((short)lasts[0]);
+        const __m128i last1 = _mm_set1_epi16((short)lasts[1]);
+        const __m128i last2 = _mm_set1_epi16((short)lasts[2]);
+        for (; i + length - 1 + 8 <= count; i += 8) {
+            __m128i head = _mm_loadu_si128((const __m128i*)(text + i));
+            __m128i tail = _mm_loadu_si128((const __m128i*)(text + i + length - 1));
+            __m128i headHits = _mm_cmpeq_epi16(head, first0);
+            __m128i tailHits = _mm_cmpeq_epi16(tail, last0);
+            if (folded) {
+                headHits = _mm_or_si128(headHits, _mm_or_si128(_mm_cmpeq_epi16(head, first1), _mm_cmpeq_epi16(head, first2)));
+                tailHits = _mm_or_si128(tailHits, _mm_or_si128(_mm_cmpeq_epi16(tail, last1), _mm_cmpeq_epi16(tail, last2)));
+            }
+            int mask = _mm_movemask_epi8(_mm_and_si128(headHits, tailHits));
+            while (mask != 0) {
+                int bit = __builtin_ctz(mask);
+                size_t at = i + (bit >> 1);
+                if (length <= 2 || sameUnits<folded>(text + at + 1, needle + 1, length - 2)) return at;
+                mask &= ~(3 << bit);
+            }
+        }
+        return findScalar<folded>(text, count, needle, length, i);
+    }
+#endif
+
+#ifdef CHARSCAN_AVX2
+    template <bool folded>
+    __attribute__((target("avx2")))
+    size_t findAvx2(const wchar_t* text, size_t count, const wchar_t* needle, size_t length,
+                    const wchar_t* firsts, const wchar_t* lasts, size_t i) {
+        const __m256i first0 = _mm256_set1_epi16((short)firsts[0]);
+        const __m256i first1 = _mm256_set1_epi16((short)firsts[1]);
+        const __m256i first2 = _mm256_set1_epi16((short)firsts[2]);
+        const __m256i last0 = _mm256_set1_epi16((short)lasts[0]);
+        const __m256i last1 = _mm256_set1_epi16((short)lasts[1]);
+        const __m256i last2 = _mm256_set1_epi16((short)lasts[2]);
+        for (; i + length - 1 + 16 <= count; i += 16) {
+            __m256i head = _mm256_loadu_si256((const __m256i*)(text + i));
+            __m256i tail = _mm256_loadu_si256((const __m256i*)(text + i + length - 1));
+            __m256i headHits = _mm256_cmpeq_epi16(head, first0);
+            __m256i tailHits = _mm256_cmpeq_epi16(tail, last0);
+            if (folded) {
+                headHits = _mm256_or_si256(headHits, _mm256_or_si256(_mm256_cmpeq_epi16(head, first1), _mm256_cmpeq_epi16(head, first2)));
+                tailHits = _mm256_or_si256(tailHits, _mm256_or_si256(_mm256_cmpeq_epi16(tail, last1), _mm256_cmpeq_epi16(tail, last2)));
+            }
+            unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(headHits, tailHits));
+            while (mask != 0) {
+                int bit = __builtin_ctz(mask);
+                size_t at = i + (bit >> 1);
+                if (length <= 2 || sameUnits<folded>(text + at + 1, needle + 1, length - 2)) return at;
+                mask &= ~(3u << bit);
+            }
+        }
+        return findSse2<folded>(text, count, needle, length, firsts, lasts, i);
+    }
+
+    const bool hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    template <bool folded>
+    size_t findHorspool(const wchar_t* text, size_t count, const wchar_t* needle, size_t length,
+                        const size_t* skip, size_t i) {
+        wchar_t lastUnit = needle[length - 1];
+        for (; i + length <= count; i += skip[unitAt<folded>(text, i + length - 1) & 0xFF]) {
+            if (unitAt<folded>(text, i + length - 1) == lastUnit && sameUnits<folded>(text + i, needle, length - 1)) return i;
+        }
+        return count;
+    }
+
+    // Fills units with everything that folds to target, false if there are more than fit
+    bool unitsFoldingTo(wchar_t target, wchar_t (&units)[3]) {
+        int found = 0;
+        for (unsigned unit = 0; unit <= 0xFFFF; ++unit) {
+            if (charTables.fold[unit] != target) continue;
+            if (found == 3) return false;
+            units[found++] = (wchar_t)unit;
+        }
+        for (int k = found; k < 3; ++k) units[k] = units[0];
+        return true;
+    }
+}
+
+SubstringSearcher::SubstringSearcher(const std::wstring& needle, bool ignoreCase)
+    : needle(needle), useHorspool(needle.length() >= HORSPOOL_MIN), ignoreCase(ignoreCase), useFilter(true) {
+    if (ignoreCase) {
+        for (wchar_t& unit : this->needle) unit = FoldCase(unit);
+    }
+    // A bucket shared by several units keeps the smallest shift, which is always safe
+    for (size_t& shift : skip) {
+        shift = needle.length();
+    }
+    for (size_t k = 0; k + 1 < needle.length(); ++k) {
+        skip[this->needle[k] & 0xFF] = needle.length() - 1 - k;
+    }
+    if (needle.empty()) return;
+    std::fill(firstUnits, firstUnits + 3, this->needle[0]);
+    std::fill(lastUnits, lastUnits + 3, this->needle.back());
+    if (ignoreCase && !useHorspool) {
+        useFilter = unitsFoldingTo(this->needle[0], firstUnits) && unitsFoldingTo(this->needle.back(), lastUnits);
+    }
+}
+
+size_t SubstringSearcher::find(const wchar_t* text, size_t count, size_t from) const {
+    size_t length = needle.length();
+    if (length == 0) return from <= count ? from : count;
+    if (from + length > count) return count;
+
+    const wchar_t* pattern = needle.data();
+    if (ignoreCase) {
+        if (useHorspool) return findHorspool<true>(text, count, pattern, length, skip, from);
+        if (!useFilter) return findScalar<true>(text, count, pattern, length, from);
+#ifdef CHARSCAN_AVX2
+        if (hasAvx2) return findAvx2<true>(text, count, pattern, length, firstUnits, lastUnits, from);
+#endif
+#ifdef CHARSCAN_SSE2
+        return findSse2<true>(text, count, pattern, length, firstUnits, lastUnits, from);
+#else
+        return findScalar<true>(text, count, pattern, length, from);
+#endif
+    }
+
+    if (useHorspool) return findHorspool<false>(text, count, pattern, length, skip, from);
+#ifdef CHARSCAN_AVX2
+    if (hasAvx2) return findAvx2<false>(text, count, pattern, length, firstUnits, lastUnits, from);
+#endif
+#ifdef CHARSCAN_SSE2
+    return findSse2<false>(text, count, pattern, length, firstUnits, lastUnits, from);
+#else
+    return findScalar<false>(text, count, pattern, length, from);
+#endif
+}
\ No newline at end of file
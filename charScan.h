@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Vectorized character scanning over UTF-16 text, eight code units per SSE2 compare.
+// Falls back to a plain loop where wchar_t isn't 16 bits or SSE2 isn't available.
+
+// Index of the first ch in text[0, count), or count if there is none
+size_t FindChar(const wchar_t* text, size_t count, wchar_t ch);
+size_t CountChar(const wchar_t* text, size_t count, wchar_t ch);
+
+// Per-unit tables for the whole BMP, filled in once at startup
+struct CharTables {
+    wchar_t fold[0x10000]; // Simple case folding: upper, then lower, so every case of a letter meets
+    bool word[0x10000];    // Letters, digits and '_'
+    CharTables();
+};
+extern const CharTables charTables;
+
+// Surrogates fold to themselves, so a pair is only ever equal to itself
+inline wchar_t FoldCase(wchar_t ch) { return charTables.fold[(uint16_t)ch]; }
+inline bool IsWordChar(wchar_t ch) { return charTables.word[(uint16_t)ch]; }
+
+// The match [col, col + length) in line starts and ends on word boundaries, as \b would see them
+bool IsWholeWord(const wchar_t* line, size_t lineLength, size_t col, size_t length);
+
+// Literal substring search, prepared once per query and then shared read-only by
+// search threads. Short needles compare the first and last unit of 8 (SSE2) or 16
+// (AVX2, picked at runtime) candidate positions at once and only verify the survivors;
+// long needles use Boyer-Moore-Horspool, whose skips grow with the needle.
+// Ignoring case, the needle is folded once and text units are folded through the table
+// as they are compared, so the text is never copied.
+class SubstringSearcher {
+public:
+    explicit SubstringSearcher(const std::wstring& needle, bool ignoreCase = false);
+
+    // Index of the first occurrence starting at or after from, or count if there is none
+    size_t find(const wchar_t* text, size_t count, size_t from = 0) const;
+    size_t length() const { return needle.length(); }
+
+private:
+    std::wstring needle; // Folded when ignoring case
+    size_t skip[256];  // Horspool shifts, bucketed by the low byte of the unit
+    bool useHorspool;
+    bool ignoreCase;
+    // Every unit that folds to the needle's first and last unit, repeated to fill the slots.
+    // The vector filter compares against each; there is no filter when more would be needed.
+    wchar_t firstUnits[3];
+    wchar_t lastUnits[3];
+    bool useFilter;
+};
\ No newline at end of file
@@ -5,15 +5,23 @@
 #include "textMetrics.h"
 #include "isModified.h"
 #include "searchMode.h"
+#include "frameScheduler.h"
+#include "textEncoding.h" // For NormalizeLineEndings
+#include "mappedText.h"   // For MappedIndexBuilding
+
+#include <algorithm>
 
 void characterCase(wchar_t ch, HWND hwnd, WPARAM wParam) {
     // Ensure we are within valid line bounds AND process valid input characters
     if (isSearchMode){
         HandleSearchCharacterDown(hwnd, ch);
+    }else if (MappedIndexBuilding()){
+        MessageBeep(MB_OK); // Read-only until the whole file is indexed
     }else{
         if (ch >= 32 || ch == L'\t' || ch == L'\r' || ch == L'\b') {
-            if (caretLine >= textBuffer.size()) {
-                textBuffer.resize(caretLine + 1);
+            while (caretLine >= textBuffer.lineCount()) {
+                int lastLine = textBuffer.lineCount() - 1;
+                SplitLine(lastLine, textBuffer.lineLength(lastLine));
             }
             
             switch(ch) {
@@ -42,28 +50,18 @@ void characterCase(wchar_t ch, HWND hwnd, WPARAM wParam) {
         
         trackCaret = true; 
         isModifiedTag(textBuffer, hwnd);
-        calcTextMetrics(hwnd);
-        UpdateScrollBars(hwnd);
-        // Update display after any textBuffer or caret position change
-        InvalidateRect(hwnd, NULL, TRUE); 
-        UpdateCaretPosition(hwnd);       
+        // Line widths were updated by the edit itself, no full rescan
+        // The edit recorded its own damage, caret tracking and scroll bars run once per frame
+        ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
     } 
 }
 
 void returnCase(wchar_t ch, HWND hwnd) {
-    // If caret is in the middle of a line, split it
-    std::wstring remainingText;
-    if (caretCol < textBuffer[caretLine].length()) {
-        remainingText = textBuffer[caretLine].substr(caretCol);
-        textBuffer[caretLine].resize(caretCol); 
-        textBuffer.insert(textBuffer.begin() + caretLine + 1, remainingText); 
-    } else {
-        // If caret is at the end of a line, just add an empty new line
-        textBuffer.insert(textBuffer.begin() + caretLine + 1, L"");
-    }
+    // Split at the caret, at the end of a line this just adds an empty new line
+    SplitLine(caretLine, caretCol);
     
-    // Record the line split for undo
-    RecordAction(UndoActionType::LINE_SPLIT, caretLine, caretCol, remainingText);
+    // Record the line split for undo (merging back needs no text)
+    RecordAction(UndoActionType::LINE_SPLIT, caretLine, caretCol);
     
     caretLine++; 
     caretCol = 0; 
@@ -77,7 +75,7 @@ void returnCase(wchar_t ch, HWND hwnd) {
 void backspaceCase(wchar_t ch, HWND hwnd) {
     if (caretCol > 0) {
         // Get the character we're about to delete
-        wchar_t deletedChar = textBuffer[caretLine][caretCol - 1];
+        wchar_t deletedChar = textBuffer.charAt(caretLine, caretCol - 1);
         
         // Record the deletion for undo (this handles grouping automatically)
         RecordDeletion(caretLine, caretCol - 1, deletedChar);
@@ -88,17 +86,15 @@ void backspaceCase(wchar_t ch, HWND hwnd) {
         
     } else if (caretLine > 0) {
         // Backspace at beginning of line: merge with previous line
-        int prevLineLength = textBuffer[caretLine - 1].length();
-        std::wstring currentLineContent = textBuffer[caretLine];
+        int prevLineLength = textBuffer.lineLength(caretLine - 1);
         
-        // Record the line join for undo
-        RecordAction(UndoActionType::LINE_JOIN, caretLine - 1, prevLineLength, currentLineContent);
+        // Record the line join for undo (splitting back needs only the position)
+        RecordAction(UndoActionType::LINE_JOIN, caretLine - 1, prevLineLength);
         
         // Perform the line merge
-        textBuffer.erase(textBuffer.begin() + caretLine);
+        MergeLines(caretLine - 1);
         caretLine--;
-        caretCol = textBuffer[caretLine].length();
-        textBuffer[caretLine] += currentLineContent;
+        caretCol = prevLineLength;
         
         // Check if scrollOffset needs to decrease if we merge up and current line was at top
         if (caretLine < scrollOffsetY) {
@@ -121,7 +117,7 @@ void spaceCase(wchar_t ch, HWND hwnd) {
     RecordTyping(caretLine, caretCol, ch);
     
     // Insert the space
-    InsertTextAt(caretLine, caretCol, std::wstring(1, ch));
+    InsertCharAt(caretLine, caretCol, ch);
     caretCol++;
 }
 
@@ -130,6 +126,24 @@ void defaultCase(wchar_t ch, HWND hwnd) {
     RecordTyping(caretLine, caretCol, ch);
     
     // Insert the character
-    InsertTextAt(caretLine, caretCol, std::wstring(1, ch));
+    InsertCharAt(caretLine, caretCol, ch);
     caretCol++;
+}
+
+void pasteCase(std::wstring text, HWND hwnd) {
+    // Pasted \r\n become the document's \n, in the same single pass a file load uses
+    NormalizeLineEndings(text);
+    if (MappedIndexBuilding()) return;
+    if (text.empty() || caretLine >= (int)textBuffer.lineCount()) return;
+    caretCol = std::min(caretCol, (int)textBuffer.lineLength(caretLine));
+
+    // All the lines go in as one insert, and undo takes them out again as one
+    RecordAction(UndoActionType::INSERT_TEXT, caretLine, caretCol, text);
+    InsertTextAt(caretLine, caretCol, text);
+
+    MoveCaretAfter(caretLine, caretCol, text);
+
+    trackCaret = true;
+    isModifiedTag(textBuffer, hwnd);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <windows.h>
+#include <string>
 
 
 void characterCase(wchar_t ch, HWND hwnd, WPARAM wParam);
@@ -9,3 +10,4 @@ void backspaceCase(wchar_t ch, HWND hwnd);
 void tabCase(wchar_t ch, HWND hwnd);
 void spaceCase(wchar_t ch, HWND hwnd);
 void defaultCase(wchar_t, HWND hwnd);
+void pasteCase(std::wstring text, HWND hwnd); // WM_PASTE, one edit and one undo entry however many lines
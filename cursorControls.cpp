@@ -3,6 +3,9 @@
 #include "updateCaretAndScroll.h"
 #include "searchMode.h"
 #include "infoBar.h"
+#include "damageTracker.h"
+#include "frameScheduler.h"
+#include "glyphAdvances.h"
 
 #include <windows.h>
 #include <algorithm>
@@ -28,8 +31,35 @@ void mouseDownL(HWND hwnd, LPARAM lParam, WPARAM wParam) {
             int buttonTop = searchBoxTop + 3;
             int buttonSize = 24;
             
+            // Replace row under the search row
+            if (isReplaceMode && mouseY > buttonTop + 27) {
+                if (mouseX > clientRect.right - 108 && mouseX < clientRect.right - 44) {
+                    ReplaceCurrentMatch(hwnd);
+                } else if (mouseX > clientRect.right - 42 && mouseX < clientRect.right - 4) {
+                    ReplaceAllMatches(hwnd);
+                } else {
+                    FocusReplaceRow(true);
+                }
+                return;
+            }
+            // Option toggles, left of the arrows
+            if (mouseX > clientRect.right - 164 && mouseX < clientRect.right - 140 &&
+                mouseY > buttonTop && mouseY < buttonTop + buttonSize) {
+                ToggleIgnoreCase(hwnd);
+                return;
+            }
+            if (mouseX > clientRect.right - 136 && mouseX < clientRect.right - 112 &&
+                mouseY > buttonTop && mouseY < buttonTop + buttonSize) {
+                ToggleWholeWord(hwnd);
+                return;
+            }
+            if (mouseX > clientRect.right - 108 && mouseX < clientRect.right - 84 &&
+                mouseY > buttonTop && mouseY < buttonTop + buttonSize) {
+                ToggleRegexSearch(hwnd);
+                return;
+            }
             // Up button
-            if (mouseX > buttonRight - buttonSize*3 && mouseX < buttonRight - buttonSize*2 &&
+            else if (mouseX > buttonRight - buttonSize*3 && mouseX < buttonRight - buttonSize*2 &&
                 mouseY > buttonTop && mouseY < buttonTop + buttonSize) {
                 FindPrevious(hwnd);
                 return;
@@ -66,7 +96,8 @@ void mouseDownL(HWND hwnd, LPARAM lParam, WPARAM wParam) {
                 
                 SelectObject(hdc, hOldFont);
                 ReleaseDC(hwnd, hdc);
-                InvalidateRect(hwnd, NULL, TRUE);
+                FocusReplaceRow(false);
+                DamageSearchBox();
                 return;
             }
         }
@@ -79,75 +110,34 @@ void mouseDownL(HWND hwnd, LPARAM lParam, WPARAM wParam) {
         tempCaretLine = 0;
     }
     
-    if (tempCaretLine >= textBuffer.size()) {
-        caretLine = textBuffer.size() - 1; 
+    if (tempCaretLine >= textBuffer.lineCount()) {
+        caretLine = textBuffer.lineCount() - 1; 
         if (caretLine < 0) caretLine = 0; 
-        caretCol = textBuffer[caretLine].length(); 
+        caretCol = textBuffer.lineLength(caretLine); 
         
         trackCaret = true; 
-        InvalidateRect(hwnd, NULL, TRUE);
-        UpdateCaretPosition(hwnd);
+        ScheduleLayout(LAYOUT_CARET);
         SetFocus(hwnd);
         return; 
     }
 
     caretLine = tempCaretLine;
-
-    HDC hdc = GetDC(hwnd);
-    HFONT hOldFont = (HFONT)SelectObject(hdc, font); 
-
-    const std::wstring& lineContent = textBuffer[caretLine];
-    int effectiveMouseX = mouseX + scrollOffsetX;
-    int tempCaretCol = 0;
-
-    if (!lineContent.empty()) {
-        int low = 0;
-        int high = lineContent.length();
-        int mid;
-
-        while (low <= high) {
-            mid = low + (high - low) / 2;
-            SIZE size;
-            GetTextExtentPoint32W(hdc, lineContent.c_str(), mid, &size);
-
-            if (size.cx <= effectiveMouseX) {
-                tempCaretCol = mid;
-                low = mid + 1;
-            } else {
-                high = mid - 1;
-            }
-        }
-
-        if (tempCaretCol < lineContent.length()) { 
-            SIZE charWidthSize;
-            GetTextExtentPoint32W(hdc, lineContent.c_str() + tempCaretCol, 1, &charWidthSize);
-            
-            SIZE currentTextWidth; 
-            GetTextExtentPoint32W(hdc, lineContent.c_str(), tempCaretCol, &currentTextWidth);
-
-            if (effectiveMouseX > (currentTextWidth.cx + charWidthSize.cx / 2)) {
-                tempCaretCol++;
-            }
-        }
-    } 
-    if (tempCaretCol > lineContent.length()) {
-        tempCaretCol = lineContent.length();
-    }
-    caretCol = tempCaretCol;
+    caretCol = columnFromCaretX(caretLine, mouseX + scrollOffsetX);
     SetCapture(hwnd);
     
+    // The old selection highlight goes away
+    if (selection.active) {
+        DamageLines(selection.startLine, selection.endLine);
+    }
+
     // Store selection start
     selection.startLine = selection.endLine = caretLine;
     selection.startCol = selection.endCol = caretCol;
     selection.active = true;
     selectedText = getSelectedText(selection, textBuffer);
     
-    SelectObject(hdc, hOldFont);
-    ReleaseDC(hwnd, hdc);
-    
     trackCaret = true; 
-    InvalidateRect(hwnd, NULL, TRUE);
-    UpdateCaretPosition(hwnd);
+    ScheduleLayout(LAYOUT_CARET);
     SetFocus(hwnd); 
 }
 void mouseDragL(HWND hwnd, LPARAM lParam, WPARAM wParam){
@@ -158,51 +148,14 @@ void mouseDragL(HWND hwnd, LPARAM lParam, WPARAM wParam){
         
         // Calculate line (same as LBUTTONDOWN)
         int tempCaretLine = (mouseY / charHeight) + scrollOffsetY;
-        tempCaretLine = std::clamp(tempCaretLine, 0, (int)textBuffer.size() - 1);
+        tempCaretLine = std::clamp(tempCaretLine, 0, (int)textBuffer.lineCount() - 1);
         caretLine = tempCaretLine;
         
         // Calculate column (same as LBUTTONDOWN)
-        HDC hdc = GetDC(hwnd);
-        HFONT hOldFont = (HFONT)SelectObject(hdc, font);
-        
-        const std::wstring& lineContent = textBuffer[caretLine];
-        int effectiveMouseX = mouseX + scrollOffsetX;
-        int tempCaretCol = 0;
-        
-        if (!lineContent.empty()) {
-            int low = 0;
-            int high = lineContent.length();
-            
-            while (low <= high) {
-                int mid = low + (high - low) / 2;
-                SIZE size;
-                GetTextExtentPoint32W(hdc, lineContent.c_str(), mid, &size);
-                
-                if (size.cx <= effectiveMouseX) {
-                    tempCaretCol = mid;
-                    low = mid + 1;
-                } else {
-                    high = mid - 1;
-                }
-            }
-            
-            if (tempCaretCol < lineContent.length()) {
-                SIZE charWidthSize;
-                GetTextExtentPoint32W(hdc, lineContent.c_str() + tempCaretCol, 1, &charWidthSize);
-                SIZE currentTextWidth;
-                GetTextExtentPoint32W(hdc, lineContent.c_str(), tempCaretCol, &currentTextWidth);
-                
-                if (effectiveMouseX > (currentTextWidth.cx + charWidthSize.cx / 2)) {
-                    tempCaretCol++;
-                }
-            }
-        }
-        tempCaretCol = std::min(tempCaretCol, (int)lineContent.length());
-        caretCol = tempCaretCol;
-        
-        SelectObject(hdc, hOldFont);
-        ReleaseDC(hwnd, hdc);
+        caretCol = columnFromCaretX(caretLine, mouseX + scrollOffsetX);
         
+        // Only the lines between the old and new selection end change
+        DamageLines(selection.endLine, caretLine);
         selection.endLine = caretLine;
         selection.endCol = caretCol;
         selection.active = true;
@@ -210,8 +163,7 @@ void mouseDragL(HWND hwnd, LPARAM lParam, WPARAM wParam){
         
         // Visual update
         trackCaret = true;
-        InvalidateRect(hwnd, NULL, TRUE);
-        UpdateCaretPosition(hwnd);
+        ScheduleLayout(LAYOUT_CARET);
     }
 }
 void mouseUpL(HWND hwnd){
@@ -229,9 +181,7 @@ void mouseUpL(HWND hwnd){
             selectedText.clear();
             selection.Clear();
         }
-
-        InvalidateRect(hwnd, NULL, TRUE);
-        UpdateWindow(hwnd);
+        // Drawn by the drag already, the empty-selection case has nothing visible to clear
     }
 
 }
@@ -273,7 +223,7 @@ void DrawSelections(HDC hdc, const RECT& paintRect) {
         } 
         else if (line == startLine) {
             rcLine.left = startCol * charWidth - scrollOffsetX;
-            rcLine.right = textBuffer[line].length() * charWidth - scrollOffsetX;
+            rcLine.right = textBuffer.lineLength(line) * charWidth - scrollOffsetX;
         }
         else if (line == endLine) {
             rcLine.left = 0 - scrollOffsetX;
@@ -281,7 +231,7 @@ void DrawSelections(HDC hdc, const RECT& paintRect) {
         }
         else {
             rcLine.left = 0 - scrollOffsetX;
-            rcLine.right = textBuffer[line].length() * charWidth - scrollOffsetX;
+            rcLine.right = textBuffer.lineLength(line) * charWidth - scrollOffsetX;
         }
         
         // Clip to visible area
@@ -294,12 +244,12 @@ void DrawSelections(HDC hdc, const RECT& paintRect) {
             
             // Redraw text with selection colors
             int textStart = std::max(0, ((int)rcLine.left + scrollOffsetX) / charWidth);
-            int textEnd = std::min((int)textBuffer[line].length(), 
+            int textEnd = std::min((int)textBuffer.lineLength(line), 
                              ((int)rcLine.right + scrollOffsetX) / charWidth);
             
             if (textEnd > textStart) {
-                std::wstring visibleText = textBuffer[line].substr(
-                    textStart, textEnd - textStart);
+                std::wstring visibleText = textBuffer.getRange(
+                    textBuffer.lineStart(line) + textStart, textEnd - textStart);
                 TextOutW(hdc, 
                         textStart * charWidth - scrollOffsetX, 
                         rcLine.top,
@@ -314,13 +264,13 @@ void DrawSelections(HDC hdc, const RECT& paintRect) {
     DeleteObject(hbrHighlight);
 }
 
-std::wstring getSelectedText(const Selection& selection, const std::vector<std::wstring>& textBuffer) {
+std::wstring getSelectedText(const Selection& selection, const PieceTable& textBuffer) {
     std::wstring selectedText;
 
     // Validate selection
     if (!selection.active || 
-        selection.startLine >= textBuffer.size() || 
-        selection.endLine >= textBuffer.size()) {
+        selection.startLine >= textBuffer.lineCount() || 
+        selection.endLine >= textBuffer.lineCount()) {
         return selectedText;
     }
 
@@ -333,27 +283,18 @@ std::wstring getSelectedText(const Selection& selection, const std::vector<std::
     // Handle single line selection
     if (startLine == endLine) {
         if (startCol == endCol) return selectedText; // Empty selection
-        startCol = std::min(startCol, (int)textBuffer[startLine].length());
-        endCol = std::min(endCol, (int)textBuffer[startLine].length());
-        return textBuffer[startLine].substr(startCol, endCol - startCol);
+        if (startCol > endCol) std::swap(startCol, endCol);
     }
 
-    // Multi-line selection
-    for (int line = startLine; line <= endLine; ++line) {
-        int lineStart = (line == startLine) ? startCol : 0;
-        int lineEnd = (line == endLine) ? endCol : textBuffer[line].length();
-
-        // Clamp to valid range
-        lineStart = std::min(lineStart, (int)textBuffer[line].length());
-        lineEnd = std::min(lineEnd, (int)textBuffer[line].length());
+    // Clamp to valid range
+    startCol = std::min(startCol, (int)textBuffer.lineLength(startLine));
+    endCol = std::min(endCol, (int)textBuffer.lineLength(endLine));
 
-        if (lineStart < lineEnd) {
-            selectedText += textBuffer[line].substr(lineStart, lineEnd - lineStart);
-        }
-
-        // Add newline except after last line
-        if (line < endLine) selectedText += L'\n';
+    // The document already stores L'\n' between lines, so the selection is one contiguous range
+    size_t start = textBuffer.lineStart(startLine) + startCol;
+    size_t end = textBuffer.lineStart(endLine) + endCol;
+    if (end > start) {
+        selectedText = textBuffer.getRange(start, end - start);
     }
-
     return selectedText;
 }
\ No newline at end of file
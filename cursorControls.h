@@ -9,4 +9,4 @@ void mouseDownL(HWND hwnd, LPARAM lParam, WPARAM wParam);
 void mouseDragL(HWND hwnd, LPARAM lParam, WPARAM wParam);
 void mouseUpL(HWND hwnd);
 void DrawSelections(HDC hdc, const RECT& paintRect);
-std::wstring getSelectedText(const Selection& selection, const std::vector<std::wstring>& textBuffer);
\ No newline at end of file
+std::wstring getSelectedText(const Selection& selection, const PieceTable& textBuffer);
\ No newline at end of file
@@ -0,0 +1,119 @@
+#define NOMINMAX
+
+#include "damageTracker.h"
+#include "textEditorGlobals.h"
+#include "textMetrics.h"
+#include "searchMode.h"
+#include "infoBar.h"
+
+#include <algorithm>
+
+struct Damage {
+    int firstLine, lastLine;  // Damaged document lines, firstLine > lastLine when none
+    bool toEnd;               // Everything below firstLine as well
+    bool searchBox;
+    bool infoBar;
+    bool all;
+};
+static Damage damage = {1, 0, false, false, false, false};
+
+// Scroll offsets the window contents currently show
+static int paintedScrollOffsetX = 0;
+static int paintedScrollOffsetY = 0;
+
+void DamageLines(int firstLine, int lastLine) {
+    if (firstLine > lastLine) std::swap(firstLine, lastLine);
+    if (damage.firstLine > damage.lastLine) {
+        damage.firstLine = firstLine;
+        damage.lastLine = lastLine;
+    } else {
+        damage.firstLine = std::min(damage.firstLine, firstLine);
+        damage.lastLine = std::max(damage.lastLine, lastLine);
+    }
+}
+
+void DamageFromLine(int line) {
+    DamageLines(line, line);
+    damage.toEnd = true;
+}
+
+void DamageSearchBox() {
+    damage.searchBox = true;
+}
+
+void DamageInfoBar() {
+    damage.infoBar = true;
+}
+
+void DamageAll() {
+    damage.all = true;
+}
+
+static RECT SearchBoxRect(const RECT& clientRect) {
+    int bottom = clientRect.bottom - (showInfoBar ? infoBarHeight : 0);
+    return RECT{0, bottom - searchBoxHeight, clientRect.right, bottom};
+}
+
+static RECT InfoBarRect(const RECT& clientRect) {
+    return RECT{0, clientRect.bottom - infoBarHeight, clientRect.right, clientRect.bottom};
+}
+
+// Where the document is drawn, above the search box and info bar
+static RECT TextAreaRect(const RECT& clientRect) {
+    int bottom = clientRect.bottom - (showInfoBar ? infoBarHeight : 0) - (isSearchMode ? searchBoxHeight : 0);
+    return RECT{clientRect.left, clientRect.top, clientRect.right, std::max(bottom, (int)clientRect.top)};
+}
+
+void ScrollContent(HWND hwnd, int oldScrollOffsetX, int oldScrollOffsetY) {
+    // Pending damage is in the old position, scrolling the bits would leave it stale
+    if (GetUpdateRect(hwnd, NULL, FALSE) || paintedScrollOffsetX != oldScrollOffsetX ||
+        paintedScrollOffsetY != oldScrollOffsetY) {
+        DamageAll();
+        return;
+    }
+    // Only the text moves, the search box and info bar stay pinned to the bottom
+    RECT clientRect;
+    GetClientRect(hwnd, &clientRect);
+    RECT textRect = TextAreaRect(clientRect);
+    ScrollWindowEx(hwnd, oldScrollOffsetX - scrollOffsetX, (oldScrollOffsetY - scrollOffsetY) * charHeight,
+                &textRect, &textRect, NULL, NULL, SW_INVALIDATE);
+    paintedScrollOffsetX = scrollOffsetX;
+    paintedScrollOffsetY = scrollOffsetY;
+}
+
+void FlushDamage(HWND hwnd) {
+    // Caret tracking and jumps change the offsets directly, nothing on screen lines up anymore
+    if (scrollOffsetX != paintedScrollOffsetX || scrollOffsetY != paintedScrollOffsetY) {
+        damage.all = true;
+    }
+
+    if (damage.all) {
+        InvalidateRect(hwnd, NULL, FALSE);
+    } else {
+        RECT clientRect;
+        GetClientRect(hwnd, &clientRect);
+
+        if (damage.firstLine <= damage.lastLine && charHeight > 0) {
+            RECT lineRect = clientRect;
+            lineRect.top = std::max((LONG)(damage.firstLine - scrollOffsetY) * charHeight, clientRect.top);
+            if (!damage.toEnd) {
+                lineRect.bottom = std::min((LONG)(damage.lastLine + 1 - scrollOffsetY) * charHeight, clientRect.bottom);
+            }
+            if (lineRect.bottom > lineRect.top) {
+                InvalidateRect(hwnd, &lineRect, FALSE);
+            }
+        }
+        if (damage.searchBox && isSearchMode) {
+            RECT searchRect = SearchBoxRect(clientRect);
+            InvalidateRect(hwnd, &searchRect, FALSE);
+        }
+        if (damage.infoBar && showInfoBar) {
+            RECT infoRect = InfoBarRect(clientRect);
+            InvalidateRect(hwnd, &infoRect, FALSE);
+        }
+    }
+
+    paintedScrollOffsetX = scrollOffsetX;
+    paintedScrollOffsetY = scrollOffsetY;
+    damage = Damage{1, 0, false, false, false, false};
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <windows.h>
+
+// Damage tracking.
+// Handlers record which parts of the window changed while a message is processed,
+// and FlushDamage invalidates just those rectangles, without erase (WM_PAINT fills
+// its own background). WindowProc flushes once per message, so an input event
+// turns into a single minimal repaint.
+void DamageLines(int firstLine, int lastLine);  // Document lines, inclusive
+void DamageFromLine(int line);                  // line and everything below it (lines shifted)
+void DamageSearchBox();
+void DamageInfoBar();
+void DamageAll();
+
+// Scrolls the window contents to match the scroll offsets and fixes up the overlays
+void ScrollContent(HWND hwnd, int oldScrollOffsetX, int oldScrollOffsetY);
+void FlushDamage(HWND hwnd);
\ No newline at end of file
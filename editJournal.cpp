@@ -0,0 +1,393 @@
+#define NOMINMAX
+
+#include "editJournal.h"
+#include "textEditorGlobals.h" // For textBuffer
+#include "spillFile.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Records the journal may gather before it restarts from a checkpoint, or the size of
+    // the text if that is more, so replay never reads much more than a load would
+    const uint64_t CHECKPOINT_BYTES = 16 * 1024 * 1024;
+    const size_t WRITE_CHUNK = 4 * 1024 * 1024; // Checkpoint text gathered per write
+    const uint32_t JOURNAL_VERSION = 1;
+    const uint64_t FNV_OFFSET = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+    // Untitled journals are this in the temp directory, then the process id of the editor
+    const wchar_t* UNTITLED_PREFIX = L"textEditor-untitled";
+
+    // Offsets are stored as the distance from where the previous edit ended, zigzag
+    // encoded, and every number as a varint, so a typed character takes five bytes
+    enum : uint8_t {
+        RECORD_INSERT = 1,    // offset, count, then count chars
+        RECORD_ERASE = 2,     // offset, count
+        RECORD_CHECKPOINT = 3 // count, then the whole text
+    };
+
+    struct JournalHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t charBytes;  // sizeof(wchar_t) of the build that wrote it
+        uint32_t reserved;
+        uint64_t savedHash;  // Content hash of the saved text the records start from
+    };
+
+    // One per batch after the header. A frame the crash cut short fails its checksum and
+    // the replay stops before it.
+    struct FrameHeader {
+        uint64_t bytes;
+        uint64_t checksum;
+    };
+
+    // A journal for the writer to replace its current one with
+    struct Restart {
+        std::wstring path;
+        uint64_t savedHash;
+        std::unique_ptr<TextSnapshot> checkpoint;
+    };
+
+    // Shared with the writer, under queueMutex
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::vector<char> pending;              // Records the writer hasn't taken yet
+    std::unique_ptr<Restart> pendingRestart;
+    bool stopping = false;
+    std::thread writerThread;
+
+    // UI thread
+    bool journaling = false;
+    std::wstring journalDocument;
+    uint64_t journalSavedHash = 0;
+    uint64_t recordCursor = 0;          // Where the last queued edit ended
+    uint64_t bytesSinceCheckpoint = 0;
+
+    std::wstring tempDirectory() {
+        wchar_t directory[MAX_PATH];
+        DWORD length = GetTempPathW(MAX_PATH, directory);
+        if (length == 0 || length > MAX_PATH) return L"";
+        return std::wstring(directory, length);
+    }
+
+    uint64_t checksum(uint64_t hash, const void* data, size_t bytes) {
+        const unsigned char* at = (const unsigned char*)data;
+        for (size_t i = 0; i < bytes; ++i) {
+            hash = (hash ^ at[i]) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+    void putVarint(std::vector<char>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((char)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char)value);
+    }
+
+    bool getVarint(const char*& at, const char* end, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; at < end && shift < 64; shift += 7) {
+            uint8_t byte = (uint8_t)*at++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    uint64_t zigzag(int64_t value) {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value) {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    bool writeHeader(SpillFile& file, uint64_t savedHash) {
+        JournalHeader header = {{'J', 'R', 'N', 'L'}, JOURNAL_VERSION, sizeof(wchar_t), 0, savedHash};
+        return file.append(&header, sizeof(header));
+    }
+
+    bool appendFrame(SpillFile& file, const std::vector<char>& records) {
+        FrameHeader frame{records.size(), checksum(FNV_OFFSET, records.data(), records.size())};
+        return file.append(&frame, sizeof(frame)) && file.append(records.data(), records.size());
+    }
+
+    // The whole text as a frame of its own; one pass for the checksum, one to write it out
+    bool appendCheckpoint(SpillFile& file, const TextSnapshot& text) {
+        std::vector<char> out;
+        out.push_back((char)RECORD_CHECKPOINT);
+        putVarint(out, text.length());
+        FrameHeader frame{out.size() + text.length() * sizeof(wchar_t), checksum(FNV_OFFSET, out.data(), out.size())};
+        text.forEachRun([&](const wchar_t* run, size_t count) {
+            frame.checksum = checksum(frame.checksum, run, count * sizeof(wchar_t));
+        });
+        bool ok = file.append(&frame, sizeof(frame));
+        out.reserve(WRITE_CHUNK);
+        text.forEachRun([&](const wchar_t* run, size_t count) {
+            const char* bytes = (const char*)run;
+            size_t size = count * sizeof(wchar_t);
+            if (out.size() + size > WRITE_CHUNK) {
+                ok = ok && file.append(out.data(), out.size());
+                out.clear();
+            }
+            if (size >= WRITE_CHUNK) {
+                ok = ok && file.append(bytes, size);
+            } else {
+                out.insert(out.end(), bytes, bytes + size);
+            }
+        });
+        return ok && file.append(out.data(), out.size());
+    }
+
+    // Drops the current journal for the one in restart. One with a checkpoint is written
+    // beside it and renamed over it, so there is always a journal to recover from.
+    bool restartJournal(std::unique_ptr<SpillFile>& file, const std::wstring& path, const Restart& restart) {
+        if (!restart.checkpoint) {
+            if (file) file->remove(); // Created again by the first batch
+            file.reset();
+            return true;
+        }
+        std::unique_ptr<SpillFile> fresh(new SpillFile());
+        bool ok = fresh->create(restart.path + L".new") && writeHeader(*fresh, restart.savedHash) &&
+                  appendCheckpoint(*fresh, *restart.checkpoint) && fresh->flush();
+        if (ok) {
+            if (file && path == restart.path) file->close(); // An open file can't be renamed over
+            ok = fresh->moveTo(restart.path);
+        }
+        if (!ok) {
+            fresh->remove();
+            return false;
+        }
+        if (file) file->remove();
+        file = std::move(fresh);
+        return true;
+    }
+
+    // Writer thread. Each pass takes everything queued since the last one, so while a
+    // flush is waiting on the disk the next edits gather and go out together.
+    void writeJournal() {
+        std::unique_ptr<SpillFile> file; // Opened by the first batch after a restart
+        std::wstring path;
+        uint64_t savedHash = 0;
+        bool failed = false;             // Nothing more is written until the next restart, a gap can't be replayed
+        std::vector<char> batch;
+        for (;;) {
+            std::unique_ptr<Restart> restart;
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueReady.wait(lock, [] { return stopping || pendingRestart || !pending.empty(); });
+                restart = std::move(pendingRestart);
+                batch.swap(pending); // Both keep their capacity, so queueing allocates nothing
+                stop = stopping;
+            }
+            if (stop) {
+                if (file) file->remove();
+                return;
+            }
+            if (restart) {
+                failed = !restartJournal(file, path, *restart);
+                path = restart->path;
+                savedHash = restart->savedHash;
+            }
+            if (!batch.empty() && !failed) {
+                if (!file) {
+                    file.reset(new SpillFile());
+                    failed = !file->create(path) || !writeHeader(*file, savedHash);
+                }
+                failed = failed || !appendFrame(*file, batch) || !file->flush();
+            }
+            batch.clear();
+        }
+    }
+
+    // Applies one frame's records to textBuffer, false when they don't parse
+    bool applyRecords(const std::vector<char>& records, uint64_t& cursor, std::wstring& text) {
+        const char* at = records.data();
+        const char* end = at + records.size();
+        while (at < end) {
+            uint8_t type = (uint8_t)*at++;
+            uint64_t delta = 0;
+            uint64_t count = 0;
+            if (type != RECORD_CHECKPOINT && !getVarint(at, end, delta)) return false;
+            if (!getVarint(at, end, count)) return false;
+            uint64_t offset = cursor + unzigzag(delta);
+            if (type != RECORD_ERASE) {
+                if (count > (uint64_t)(end - at) / sizeof(wchar_t)) return false;
+                text.resize((size_t)count);
+                memcpy(&text[0], at, (size_t)count * sizeof(wchar_t)); // Records aren't aligned
+                at += count * sizeof(wchar_t);
+            }
+            switch (type) {
+                case RECORD_INSERT:
+                    textBuffer.insertAt((size_t)offset, text.data(), (size_t)count);
+                    cursor = offset + count;
+                    break;
+                case RECORD_ERASE:
+                    textBuffer.eraseAt((size_t)offset, (size_t)count);
+                    cursor = offset;
+                    break;
+                case RECORD_CHECKPOINT:
+                    textBuffer.load(std::move(text));
+                    text.clear();
+                    break;
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void queueRecord(uint8_t type, size_t offset, const wchar_t* text, size_t count) {
+        size_t before;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            before = pending.size();
+            pending.push_back((char)type);
+            putVarint(pending, zigzag((int64_t)offset - (int64_t)recordCursor));
+            putVarint(pending, count);
+            if (text) {
+                pending.insert(pending.end(), (const char*)text, (const char*)(text + count));
+            }
+            bytesSinceCheckpoint += pending.size() - before;
+        }
+        recordCursor = text ? offset + count : offset;
+        if (before == 0) {
+            queueReady.notify_one(); // Otherwise the writer has been woken already and takes this too
+        }
+
+        if (bytesSinceCheckpoint > std::max<uint64_t>(CHECKPOINT_BYTES, textBuffer.length() * sizeof(wchar_t))) {
+            StartJournal(journalDocument, journalSavedHash, true);
+        }
+    }
+
+    // Replays the journal at path onto textBuffer, deleting it unless textBuffer changed
+    bool replayFile(const std::wstring& path) {
+        SpillFile file;
+        if (!file.openExisting(path)) return false;
+
+        JournalHeader header;
+        bool ok = file.size() >= sizeof(header) && file.read(0, &header, sizeof(header)) &&
+                  memcmp(header.magic, "JRNL", 4) == 0 && header.version == JOURNAL_VERSION &&
+                  header.charBytes == sizeof(wchar_t) && header.savedHash == textBuffer.contentHash();
+        uint64_t startVersion = textBuffer.version();
+        uint64_t at = sizeof(header);
+        uint64_t cursor = 0;
+        std::vector<char> records;
+        std::wstring text;
+        FrameHeader frame;
+        while (ok && file.size() - at >= sizeof(frame) && file.read(at, &frame, sizeof(frame)) &&
+               frame.bytes <= file.size() - at - sizeof(frame)) {
+            records.resize((size_t)frame.bytes);
+            if (!file.read(at + sizeof(frame), records.data(), records.size()) ||
+                checksum(FNV_OFFSET, records.data(), records.size()) != frame.checksum ||
+                !applyRecords(records, cursor, text)) {
+                break; // The batch being written when it crashed
+            }
+            at += sizeof(frame) + frame.bytes;
+        }
+
+        bool changed = ok && textBuffer.version() != startVersion;
+        if (changed) {
+            file.close();
+        } else {
+            file.remove();
+        }
+        return changed;
+    }
+}
+
+std::wstring JournalPath(const std::wstring& documentPath) {
+    if (!documentPath.empty()) {
+        return documentPath + L".journal";
+    }
+    std::wstring directory = tempDirectory();
+    if (directory.empty()) return L"";
+    return directory + UNTITLED_PREFIX + std::to_wstring(GetCurrentProcessId()) + L".journal";
+}
+
+void StartJournal(const std::wstring& documentPath, uint64_t savedHash, bool checkpoint) {
+    std::unique_ptr<Restart> restart(new Restart{JournalPath(documentPath), savedHash, nullptr});
+    if (checkpoint) {
+        restart->checkpoint.reset(new TextSnapshot(textBuffer.snapshot()));
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.clear(); // Those edits are in the saved text or the checkpoint
+        pendingRestart = std::move(restart);
+    }
+    journaling = true;
+    journalDocument = documentPath;
+    journalSavedHash = savedHash;
+    recordCursor = 0;
+    bytesSinceCheckpoint = 0;
+    if (!writerThread.joinable()) {
+        writerThread = std::thread(writeJournal);
+    }
+    queueReady.notify_one();
+}
+
+void CloseJournal() {
+    if (!writerThread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.clear();
+        pendingRestart.reset();
+        stopping = true;
+    }
+    queueReady.notify_one();
+    writerThread.join();
+    stopping = false;
+    journaling = false;
+    DeleteFileW(JournalPath(journalDocument).c_str()); // A replayed one the writer never got to replace
+}
+
+void JournalInsert(size_t offset, const wchar_t* text, size_t count) {
+    if (!journaling || count == 0) return;
+    queueRecord(RECORD_INSERT, offset, text, count);
+}
+
+void JournalErase(size_t offset, size_t count) {
+    if (!journaling || count == 0) return;
+    queueRecord(RECORD_ERASE, offset, nullptr, count);
+}
+
+bool ReplayJournal(const std::wstring& documentPath) {
+    std::wstring path = JournalPath(documentPath);
+    if (path.empty()) return false;
+    DeleteFileW((path + L".new").c_str()); // A checkpoint the crash cut short, the journal is whole without it
+    if (!documentPath.empty()) return replayFile(path);
+
+    // An untitled document takes up the journal of one whose editor crashed. A running
+    // editor holds its journal and checkpoint open, so neither can be renamed or deleted.
+    std::wstring directory = tempDirectory();
+    std::vector<std::wstring> journals;
+    WIN32_FIND_DATAW entry;
+    HANDLE search = FindFirstFileW((directory + UNTITLED_PREFIX + L"*.journal*").c_str(), &entry);
+    if (search != INVALID_HANDLE_VALUE) {
+        do {
+            std::wstring found = directory + entry.cFileName;
+            if (found.size() > 4 && found.compare(found.size() - 4, 4, L".new") == 0) {
+                DeleteFileW(found.c_str());
+            } else {
+                journals.push_back(found);
+            }
+        } while (FindNextFileW(search, &entry));
+        FindClose(search);
+    }
+    for (const std::wstring& orphan : journals) {
+        if ((orphan == path || MoveFileExW(orphan.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) &&
+            replayFile(path)) {
+            return true; // Any others are taken up by the next untitled editor to start
+        }
+    }
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Every change to textBuffer since the last save is appended to a journal next to the
+// document, so a crash loses at most the edits of the batch being written. The UI thread
+// only copies a few bytes into a queue; a writer thread takes whatever has built up,
+// appends it as one checksummed frame and flushes it, so a burst of typing costs one
+// flush. Once the journal outgrows the text it restarts from a checkpoint of the whole text.
+
+// <document>.journal, or for an untitled document one in the temp directory named after the
+// editor's process, so each running editor has its own
+std::wstring JournalPath(const std::wstring& documentPath);
+
+// Starts a new journal for the document at documentPath (empty when untitled), whose saved
+// text hashes to savedHash. The old journal is deleted, or with checkpoint replaced by one
+// holding the whole of textBuffer, for when it already differs from the saved text.
+void StartJournal(const std::wstring& documentPath, uint64_t savedHash, bool checkpoint);
+// Stops the writer and deletes the journal; the user has saved or discarded the text
+void CloseJournal();
+
+// From InsertAtOffset and EraseAtOffset, after textBuffer has changed
+void JournalInsert(size_t offset, const wchar_t* text, size_t count);
+void JournalErase(size_t offset, size_t count);
+
+// Replays a journal a crash left behind for the document onto textBuffer, which has to
+// hold the saved text it was started from. A journal for other text, or one that can't
+// be read, is deleted, and so is a checkpoint a crash left half written. True when
+// textBuffer changed; the journal is kept until StartJournal replaces it.
+// An untitled document (empty path) recovers the first journal, out of those in the temp
+// directory, that no running editor has open and that replays.
+bool ReplayJournal(const std::wstring& documentPath);
\ No newline at end of file
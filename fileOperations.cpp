@@ -1,36 +1,120 @@
 #include "fileOperations.h" // Include its own header for function prototypes
 #include "TextEditorGlobals.h" // For access to global variables and other utilities
 #include "textMetrics.h"       // For calcTextMetrics
-#include "updateCaretAndScroll.h" // For UpdateScrollBars, UpdateCaretPosition
+#include "updateCaretAndScroll.h"
 #include "isModified.h" //For setting modified tag
-#include "undoStack.h"  //To clear undo stack
+#include "undoStack.h"  //To switch undo history with the document
+#include "damageTracker.h"
+#include "frameScheduler.h"
+#include "fileSave.h"
+#include "trigramIndex.h"
+#include "editJournal.h"
+#include "mappedText.h"
+#include "searchMode.h"
+#include "infoBar.h"
 
-#include <fstream>   // For std::wifstream, std::wofstream
+#include <algorithm>
+#include <memory>
 #include <commdlg.h> // For GetOpenFileNameW, GetSaveFileNameW
 #include <strsafe.h> // For StringCchCopyW, wcsrchr
 
-void LoadTextFromFile(HWND hwnd, const std::wstring& filePath) {
-    std::wifstream inputFile(filePath.c_str());
-    if (!inputFile.is_open()) {
-        MessageBox(hwnd, L"Could not open file for reading.", L"Error", MB_ICONERROR | MB_OK);
-        return;
+// Version the current document started at, saves of older documents are ignored when they land
+static uint64_t documentStartVersion = 0;
+
+// Files at least this big are shown in place from a mapped view, decoded as they are read
+const size_t LARGE_FILE_BYTES = 64 * 1024 * 1024;
+
+// Whole file into bytes, sized once up front and read in large blocks
+static bool ReadFileBytes(HANDLE file, std::string& bytes) {
+    const size_t blockSize = 64 * 1024 * 1024;
+    size_t done = 0;
+    while (done < bytes.size()) {
+        DWORD read = 0;
+        DWORD request = (DWORD)std::min(blockSize, bytes.size() - done);
+        if (!ReadFile(file, &bytes[done], request, &read, NULL) || read == 0) return false;
+        done += read;
     }
+    return true;
+}
+
+static void DecodeBytes(const char* data, size_t size, std::wstring& text) {
+    size_t bomLength;
+    TextEncoding encoding = DetectEncoding(data, size, bomLength);
+    documentEncoding = DecodeText(data + bomLength, size - bomLength, encoding, text);
+}
 
-    textBuffer.clear();
-    std::wstring line;
+// Reads and decodes the file, or for a large one hands it to mapped without reading any of it
+static bool DecodeFile(const std::wstring& filePath, std::wstring& text, std::shared_ptr<MappedText>& mapped) {
+    // Logs are often still open for writing by the program producing them
+    HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
 
-    while (std::getline(inputFile, line)) {
-        textBuffer.push_back(line);
+    LARGE_INTEGER fileSize;
+    bool ok = GetFileSizeEx(file, &fileSize);
+    size_t size = ok ? (size_t)fileSize.QuadPart : 0;
+    if (ok && size >= LARGE_FILE_BYTES) {
+        mapped = MappedText::map(file, size, filePath); // Closes file either way
+        return mapped != nullptr;
+    } else if (ok) {
+        std::string bytes(size, '\0');
+        ok = ReadFileBytes(file, bytes);
+        if (ok) DecodeBytes(bytes.data(), bytes.size(), text);
     }
-    inputFile.close();
+    CloseHandle(file);
+    return ok;
+}
 
-    if (textBuffer.empty()) {
-        //ensure 1 line if empty to avoid errors
-        textBuffer.push_back(L""); 
+// Drawn as soon as its first screen is indexed; the journal, undo history and trigram index
+// wait for ReceiveFileIndex to have all of it
+static void LoadMappedFile(HWND hwnd, const std::wstring& filePath, std::shared_ptr<MappedText> mapped) {
+    undoHistory.detach();
+    CloseJournal();
+    CancelTrigramIndex();
+    StartMappedIndex(hwnd, mapped, linesPerPage + 1);
+    textBuffer.loadMapped(mapped);
+    documentEncoding = mapped->encoding();
+    documentLineEnding = mapped->lineEnding();
+    documentStartVersion = textBuffer.version();
+    currentFilePath = filePath;
+    setOriginal(textBuffer, hwnd);
+
+    caretLine = 0;
+    caretCol = 0;
+    scrollOffsetY = 0;
+    scrollOffsetX = 0;
+    calcTextMetrics(hwnd);
+    DestroyCaret();
+    CreateCaret(hwnd, NULL, 2, charHeight);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
+    ShowCaret(hwnd);
+    DamageAll();
+    UpdateInfoBar(hwnd);
+    SetFocus(hwnd);
+    if (isSearchMode) FindAllMatches(hwnd); // Waits for the index too
+}
+
+void LoadTextFromFile(HWND hwnd, const std::wstring& filePath) {
+    std::wstring text;
+    std::shared_ptr<MappedText> mapped;
+    if (!DecodeFile(filePath, text, mapped)) {
+        MessageBox(hwnd, L"Could not open file for reading.", L"Error", MB_ICONERROR | MB_OK);
+        return;
+    }
+    CancelMappedIndex();
+    if (mapped) {
+        LoadMappedFile(hwnd, filePath, std::move(mapped));
+        return;
     }
+    documentLineEnding = NormalizeLineEndings(text);
+
+    //an empty file still loads as 1 empty line, the piece table keeps the text as its original buffer
+    textBuffer.load(std::move(text));
+    documentStartVersion = textBuffer.version();
 
     currentFilePath = filePath;
-    documentModified = false;
+    setOriginal(textBuffer, hwnd);
+    bool recovered = ResumeJournal(hwnd, filePath);
 
     //reset scroll and caret positions
     
@@ -42,34 +126,106 @@ void LoadTextFromFile(HWND hwnd, const std::wstring& filePath) {
 
     // Call functions to update UI
     calcTextMetrics(hwnd);
-    UpdateScrollBars(hwnd);
     //Caret won't appear
     DestroyCaret();
     CreateCaret(hwnd, NULL, 2, charHeight);
-    UpdateCaretPosition(hwnd);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
     ShowCaret(hwnd);
-    InvalidateRect(hwnd, NULL, TRUE);
-    clearStack(undoStack);
+    DamageAll();
+    // A recovered text isn't the saved one, and the side file the crash left was never
+    // completed, so the history starts again then
+    undoHistory.attach(UndoSpillPath(filePath), textBuffer.contentHash());
+    StartTrigramIndex(hwnd); // Only large files get one
     SetFocus(hwnd);
+    if (recovered) {
+        MessageBox(hwnd, L"Unsaved changes from the last session were recovered, but not their undo history.", L"Text Editor", MB_ICONINFORMATION | MB_OK);
+    }
 }
 
-bool SaveTextToFile(HWND hwnd, const std::wstring& filePath) {
-    std::wofstream outputFile(filePath.c_str()); 
+void ReceiveFileIndex(HWND hwnd, LPARAM lParam) {
+    size_t oldLines = textBuffer.lineCount();
+    bool restarted;
+    std::shared_ptr<MappedText> indexed = ReceiveMappedIndex(lParam, restarted);
+    if (!indexed) return;
 
-    if (!outputFile.is_open()) { 
-        MessageBox(hwnd, L"Could not open file for writing.", L"Error", MB_ICONERROR | MB_OK);
-        return false; 
+    // Nothing can be edited until it is all indexed, so the document only grows at the end
+    if (restarted) {
+        textBuffer.loadMapped(indexed);
+    } else {
+        textBuffer.mappedGrew();
+    }
+    measureAllLines();
+    if (restarted) {
+        // Decoded again as ANSI, nothing shown so far still holds
+        documentStartVersion = textBuffer.version();
+        caretLine = 0;
+        caretCol = 0;
+        scrollOffsetY = 0;
+        scrollOffsetX = 0;
+        ScheduleLayout(LAYOUT_CARET);
+        DamageAll();
+    } else {
+        DamageFromLine((int)oldLines - 1); // The last line may have grown
     }
+    ScheduleLayout(LAYOUT_SCROLLBARS);
+    UpdateInfoBar(hwnd);
+    if (MappedIndexBuilding()) return;
 
-    for (size_t i = 0; i < textBuffer.size(); ++i) { 
-        outputFile << textBuffer[i]; 
-        if (i < textBuffer.size() - 1) { //textBuffer.size() - 1 so that the last line doesnt make a new line
-            outputFile << L'\n';        
-        }
+    documentEncoding = indexed->encoding();
+    documentLineEnding = indexed->lineEnding();
+    setOriginal(textBuffer, hwnd);
+    bool recovered = ResumeJournal(hwnd, currentFilePath);
+    caretLine = std::min(caretLine, (int)textBuffer.lineCount() - 1);
+    caretCol = std::min(caretCol, (int)textBuffer.lineLength(caretLine));
+    if (recovered) measureAllLines();
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
+    DamageAll();
+    undoHistory.attach(UndoSpillPath(currentFilePath), textBuffer.contentHash());
+    StartTrigramIndex(hwnd);
+    UpdateInfoBar(hwnd);
+    if (isSearchMode) FindAllMatches(hwnd);
+    if (recovered) {
+        MessageBox(hwnd, L"Unsaved changes from the last session were recovered, but not their undo history.", L"Text Editor", MB_ICONINFORMATION | MB_OK);
+    }
+}
+
+bool ResumeJournal(HWND hwnd, const std::wstring& filePath) {
+    uint64_t savedTextHash = textBuffer.contentHash();
+    bool recovered = ReplayJournal(filePath);
+    StartJournal(filePath, savedTextHash, recovered);
+    isModifiedTag(textBuffer, hwnd);
+    return recovered;
+}
+
+// Synchronous save, for when the caller needs the result before carrying on (prompt before closing)
+bool SaveTextToFile(HWND hwnd, const std::wstring& filePath) {
+    WaitForBackgroundSave();
+    if (!WriteSnapshot(textBuffer.snapshot(), filePath, documentEncoding, documentLineEnding)) {
+        MessageBox(hwnd, L"Could not save the file.", L"Error", MB_ICONERROR | MB_OK);
+        return false;
     }
-    outputFile.close(); 
+    undoHistory.markSaved(undoHistory.position(), textBuffer.contentHash());
+    undoHistory.moveTo(UndoSpillPath(filePath));
+    StartJournal(filePath, textBuffer.contentHash(), false);
     return true; // Indicate successful save
 }
+
+void FinishBackgroundSave(HWND hwnd, WPARAM wParam, LPARAM lParam) {
+    std::unique_ptr<SaveJob> job((SaveJob*)lParam);
+    if (!wParam) {
+        MessageBox(hwnd, L"Could not save the file.", L"Error", MB_ICONERROR | MB_OK);
+        return;
+    }
+    if (job->snapshot.version() < documentStartVersion) {
+        return; // Another document was opened while this one was being written
+    }
+    currentFilePath = job->path;
+    setSavedSnapshot(job->snapshot, textBuffer, hwnd);
+    undoHistory.markSaved(job->undoPosition, job->snapshot.contentHash());
+    undoHistory.moveTo(UndoSpillPath(job->path));
+    // Edits made while it was written are still unsaved, the new journal starts with them
+    StartJournal(job->path, job->snapshot.contentHash(), textBuffer.version() != job->snapshot.version());
+}
 int PromptForSave(HWND hwnd) {
     if (!documentModified) { 
         return IDYES; 
@@ -119,9 +275,13 @@ void NewDocument(HWND hwnd) {
         return;
     }
 
+    CancelMappedIndex();
     textBuffer.clear(); 
-    textBuffer.push_back(L""); 
+    CancelTrigramIndex();
+    documentStartVersion = textBuffer.version();
     currentFilePath.clear();
+    documentEncoding = TextEncoding::UTF8;
+    documentLineEnding = LineEnding::CRLF;
     caretLine = 0;   
     caretCol = 0;
     scrollOffsetY = 0;
@@ -129,15 +289,15 @@ void NewDocument(HWND hwnd) {
 
     trackCaret = true;
     calcTextMetrics(hwnd);
-    UpdateScrollBars(hwnd);
     //Caret won't appear
     DestroyCaret();
     CreateCaret(hwnd, NULL, 2, charHeight);
-    UpdateCaretPosition(hwnd);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
     ShowCaret(hwnd);
-    InvalidateRect(hwnd, NULL, TRUE);
+    DamageAll();
     setOriginal(textBuffer, hwnd);
-    clearStack(undoStack);
+    undoHistory.attach(L"", textBuffer.contentHash());
+    StartJournal(L"", textBuffer.contentHash(), false);
     SetFocus(hwnd);
 }
 void OpenFile(HWND hwnd) {
@@ -162,22 +322,22 @@ void OpenFile(HWND hwnd) {
         LoadTextFromFile(hwnd, ofn.lpstrFile); 
         ShowCaret(hwnd);
     }
-    setOriginal(textBuffer, hwnd);
-    clearStack(undoStack);
-    
 }
+// The modified tag is cleared by FinishBackgroundSave once the file is on disk
 void SaveFile(HWND hwnd) {
-    if (currentFilePath == L"") { 
+    if (MappedIndexBuilding()) {
+        MessageBox(hwnd, L"The file is still being read, it can be saved once it is done.", L"Text Editor", MB_ICONINFORMATION | MB_OK);
+    } else if (currentFilePath == L"") { 
         SaveFileAs(hwnd); 
     } else { 
-        SaveTextToFile(hwnd, currentFilePath); 
+        StartBackgroundSave(hwnd, currentFilePath); 
     }
-    setOriginal(textBuffer, hwnd);
-    //Caret won't appear
-    CreateCaret(hwnd, NULL, 2, charHeight);
-    UpdateCaretPosition(hwnd);
 }
 void SaveFileAs(HWND hwnd) {
+    if (MappedIndexBuilding()) {
+        MessageBox(hwnd, L"The file is still being read, it can be saved once it is done.", L"Text Editor", MB_ICONINFORMATION | MB_OK);
+        return;
+    }
     OPENFILENAMEW ofn; // Structure for save file dialog
     wchar_t szFile[MAX_PATH] = L""; // Buffer for file path
 
@@ -201,10 +361,9 @@ void SaveFileAs(HWND hwnd) {
     ofn.lpstrDefExt = L"txt"; // Default extension
 
     if (GetSaveFileNameW(&ofn)) { 
-        SaveTextToFile(hwnd, ofn.lpstrFile); 
+        StartBackgroundSave(hwnd, ofn.lpstrFile); 
     }
-    setOriginal(textBuffer, hwnd);
     //Caret won't appear
     CreateCaret(hwnd, NULL, 2, charHeight);
-    UpdateCaretPosition(hwnd);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
 }
\ No newline at end of file
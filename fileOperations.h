@@ -5,9 +5,16 @@
 
 // Declare the file operation functions
 void LoadTextFromFile(HWND hwnd, const std::wstring& filePath);
+// Replays the edits a crash left in the journal of the text just loaded, which is the saved
+// text, and journals from there on. True when there were some.
+bool ResumeJournal(HWND hwnd, const std::wstring& filePath);
 bool SaveTextToFile(HWND hwnd, const std::wstring& filePath);
 int PromptForSave(HWND hwnd);
 void NewDocument(HWND hwnd);
 void OpenFile(HWND hwnd);
 void SaveFile(HWND hwnd);
 void SaveFileAs(HWND hwnd);
+void FinishBackgroundSave(HWND hwnd, WPARAM wParam, LPARAM lParam); // WM_SAVE_COMPLETE
+// WM_FILE_INDEXED: the scrollbars and info bar follow the index of a large file, and once it
+// is complete the file is editable like any other
+void ReceiveFileIndex(HWND hwnd, LPARAM lParam);
@@ -0,0 +1,95 @@
+#define NOMINMAX
+
+#include "fileSave.h"
+#include "textEditorGlobals.h" // For textBuffer, documentEncoding, documentLineEnding
+#include "undoStack.h"         // For undoHistory
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+    const size_t ENCODE_BATCH = 1 << 20;          // UTF-16 units handed to the encoder at a time
+    const size_t WRITE_CHUNK = 4 * 1024 * 1024;   // Bytes buffered per WriteFile
+
+    std::thread saveThread;
+
+    bool writeAll(HANDLE file, const std::string& bytes) {
+        size_t done = 0;
+        while (done < bytes.size()) {
+            DWORD written = 0;
+            DWORD request = (DWORD)std::min(bytes.size() - done, WRITE_CHUNK);
+            if (!WriteFile(file, bytes.data() + done, request, &written, NULL) || written == 0) {
+                return false;
+            }
+            done += written;
+        }
+        return true;
+    }
+}
+
+bool WriteSnapshot(const TextSnapshot& snapshot, const std::wstring& path,
+                   TextEncoding encoding, LineEnding lineEnding) {
+    // Same directory, so the rename never crosses volumes
+    std::wstring tempPath = path + L".saving";
+    HANDLE file = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    TextEncoder encoder(encoding, lineEnding);
+    std::string out;
+    out.reserve(WRITE_CHUNK + ENCODE_BATCH * 4);
+    encoder.writeBom(out);
+
+    bool ok = true;
+    snapshot.forEachRun([&](const wchar_t* text, size_t count) {
+        size_t done = 0;
+        while (ok && done < count) {
+            size_t batch = std::min(ENCODE_BATCH, count - done);
+            encoder.encode(text + done, batch, out);
+            done += batch;
+            if (out.size() >= WRITE_CHUNK) {
+                ok = writeAll(file, out);
+                out.clear();
+            }
+        }
+    });
+    encoder.finish(out);
+    ok = ok && writeAll(file, out) && FlushFileBuffers(file);
+    CloseHandle(file);
+
+    if (ok) {
+        // ReplaceFileW keeps the existing file's ACLs, attributes, streams and creation time.
+        // A file the text is still read from can't go away, it is kept aside until it is let go.
+        const MappedText* mapped = snapshot.mappedOriginal();
+        if (mapped && mapped->isFile(path)) {
+            ok = ReplaceFileW(path.c_str(), tempPath.c_str(), mapped->asidePath().c_str(),
+                              REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL);
+            if (ok) mapped->movedAside();
+        } else if (GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES) {
+            ok = ReplaceFileW(path.c_str(), tempPath.c_str(), NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL);
+        } else {
+            ok = MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+        }
+    }
+    if (!ok) {
+        DeleteFileW(tempPath.c_str());
+    }
+    return ok;
+}
+
+void StartBackgroundSave(HWND hwnd, const std::wstring& path) {
+    WaitForBackgroundSave(); // One save at a time, they share the temp file
+
+    SaveJob* job = new SaveJob{textBuffer.snapshot(), path, documentEncoding, documentLineEnding,
+                               undoHistory.savePoint()};
+    saveThread = std::thread([hwnd, job]() {
+        bool ok = WriteSnapshot(job->snapshot, job->path, job->encoding, job->lineEnding);
+        PostMessage(hwnd, WM_SAVE_COMPLETE, ok, (LPARAM)job);
+    });
+}
+
+void WaitForBackgroundSave() {
+    if (saveThread.joinable()) {
+        saveThread.join();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include "pieceTable.h"
+#include "textEncoding.h"
+
+// Posted to the window when a background save finishes.
+// wParam is nonzero on success, lParam owns the SaveJob (see FinishBackgroundSave).
+#define WM_SAVE_COMPLETE (WM_APP + 1)
+
+struct SaveJob {
+    TextSnapshot snapshot;
+    std::wstring path;
+    TextEncoding encoding;
+    LineEnding lineEnding;
+    uint64_t undoPosition; // Undo node of the snapshot, the history's saved point once it is on disk
+};
+
+// Encodes the snapshot into a temp file next to path, flushes it and renames it over
+// path, so a crash or full disk mid-save leaves the old file intact
+bool WriteSnapshot(const TextSnapshot& snapshot, const std::wstring& path,
+                   TextEncoding encoding, LineEnding lineEnding);
+
+// Saves a snapshot of textBuffer on a worker thread, the UI keeps taking input meanwhile
+void StartBackgroundSave(HWND hwnd, const std::wstring& path);
+// Blocks until a save in flight is on disk (before a synchronous save, and on exit)
+void WaitForBackgroundSave();
\ No newline at end of file
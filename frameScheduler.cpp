@@ -0,0 +1,27 @@
+#include "frameScheduler.h"
+#include "updateCaretAndScroll.h"
+#include "damageTracker.h"
+
+static unsigned pendingLayout = 0;
+
+void ScheduleLayout(unsigned work) {
+    pendingLayout |= work;
+}
+
+void FlushFrame(HWND hwnd) {
+    // Steps can schedule later steps (caret tracking scrolls), so each is cleared before it runs
+    if (pendingLayout & LAYOUT_CARET) {
+        pendingLayout &= ~LAYOUT_CARET;
+        UpdateCaretPosition(hwnd);
+    }
+    if (pendingLayout & LAYOUT_SCROLLBARS) {
+        pendingLayout &= ~LAYOUT_SCROLLBARS;
+        UpdateScrollBars(hwnd);
+    }
+    FlushDamage(hwnd);
+}
+
+bool KeyboardInputPending(HWND hwnd) {
+    MSG msg;
+    return PeekMessage(&msg, hwnd, WM_KEYFIRST, WM_KEYLAST, PM_NOREMOVE);
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <windows.h>
+
+// Per-frame layout scheduling.
+// Handlers mark which layout steps are stale instead of running them on the spot,
+// and FlushFrame runs each marked step once (caret tracking first, since it can
+// scroll, then the scroll bars) before handing the frame's damage to FlushDamage.
+enum LayoutWork : unsigned {
+    LAYOUT_CARET      = 1 << 0,  // UpdateCaretPosition
+    LAYOUT_SCROLLBARS = 1 << 1   // UpdateScrollBars
+};
+
+void ScheduleLayout(unsigned work);
+void FlushFrame(HWND hwnd);
+// True while more keyboard input is queued, e.g. during key auto-repeat
+bool KeyboardInputPending(HWND hwnd);
\ No newline at end of file
@@ -0,0 +1,97 @@
+#define NOMINMAX
+
+#include "glyphAdvances.h"
+#include "textEditorGlobals.h" // For textBuffer
+#include "textMetrics.h"       // For font, charWidth, fixedPitch, getMeasureDC
+#include "viewport.h"          // For IsLowSurrogate
+
+#include <windows.h>
+#include <algorithm>
+#include <vector>
+
+namespace {
+    struct LineAdvances {
+        int line;
+        std::vector<int> prefix; // prefix[i] = width of the first i characters
+    };
+
+    // A handful of lines covers the caret line plus a drag sweeping across the page
+    const size_t maxCachedLines = 16;
+    std::vector<LineAdvances> cache; // Most recently used last
+    HFONT cacheFont = NULL;
+
+    const std::vector<int>& lineAdvances(int line) {
+        if (cacheFont != font) {
+            cache.clear();
+            cacheFont = font;
+        }
+        for (size_t i = 0; i < cache.size(); ++i) {
+            if (cache[i].line == line) {
+                if (i + 1 != cache.size()) {
+                    std::rotate(cache.begin() + i, cache.begin() + i + 1, cache.end());
+                }
+                return cache.back().prefix;
+            }
+        }
+        if (cache.size() == maxCachedLines) {
+            cache.erase(cache.begin());
+        }
+
+        std::wstring text = textBuffer.getLine(line);
+        LineAdvances entry{line, std::vector<int>(text.length() + 1, 0)};
+        if (!text.empty()) {
+            SIZE size;
+            GetTextExtentExPointW(getMeasureDC(), text.c_str(), (int)text.length(), 0, NULL,
+                                  entry.prefix.data() + 1, &size);
+        }
+        cache.push_back(std::move(entry));
+        return cache.back().prefix;
+    }
+}
+
+int caretXFromColumn(int line, int col) {
+    if (line < 0 || line >= (int)textBuffer.lineCount() || col <= 0) return 0;
+    if (fixedPitch) {
+        return std::min(col, (int)textBuffer.lineLength(line)) * charWidth;
+    }
+    const std::vector<int>& prefix = lineAdvances(line);
+    return prefix[std::min(col, (int)prefix.size() - 1)];
+}
+
+int columnFromCaretX(int line, int x) {
+    if (line < 0 || line >= (int)textBuffer.lineCount() || x <= 0) return 0;
+    int length = (int)textBuffer.lineLength(line);
+    int col;
+    if (fixedPitch) {
+        // Past the midpoint of a glyph snaps to its right edge
+        col = charWidth > 0 ? std::min((x + charWidth / 2) / charWidth, length) : 0;
+    } else {
+        const std::vector<int>& prefix = lineAdvances(line);
+        col = (int)(std::upper_bound(prefix.begin(), prefix.end(), x) - prefix.begin()) - 1;
+        if (col < length && x > prefix[col] + (prefix[col + 1] - prefix[col]) / 2) {
+            col++;
+        }
+    }
+    if (col > 0 && col < length && IsLowSurrogate(textBuffer.charAt(line, col))) {
+        col++;
+    }
+    return col;
+}
+
+void invalidateGlyphAdvances(int line, int removedLines, int insertedLines) {
+    int shift = insertedLines - removedLines;
+    for (size_t i = 0; i < cache.size();) {
+        if (cache[i].line >= line && cache[i].line <= line + removedLines) {
+            cache.erase(cache.begin() + i);
+            continue;
+        }
+        if (cache[i].line > line + removedLines) {
+            cache[i].line += shift;
+        }
+        ++i;
+    }
+}
+
+void clearGlyphAdvances() {
+    cache.clear();
+}
\ No newline at end of file
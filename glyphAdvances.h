@@ -0,0 +1,14 @@
+#pragma once
+
+// Caret placement and mouse hit-testing without a GDI call per probe.
+// The first lookup on a line fetches every prefix width in one GetTextExtentExPointW
+// call and keeps it in a small cache keyed by the font; later lookups are array reads
+// or a binary search. Fixed-pitch fonts skip the cache entirely (col * charWidth).
+
+// Pixel x of the caret before column col, unscrolled
+int caretXFromColumn(int line, int col);
+// Nearest caret column to unscrolled pixel x, never inside a surrogate pair
+int columnFromCaretX(int line, int x);
+// Lines [line, line + removedLines] were replaced by [line, line + insertedLines]
+void invalidateGlyphAdvances(int line, int removedLines, int insertedLines);
+void clearGlyphAdvances();
\ No newline at end of file
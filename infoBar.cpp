@@ -1,5 +1,10 @@
 #include "infoBar.h"
 #include "textEditorGlobals.h"
+#include "damageTracker.h"
+#include "searchMode.h"
+#include "trigramIndex.h"
+#include "undoStack.h" // For undoHistory
+#include "mappedText.h"
 #include <windows.h>
 
 bool showInfoBar = true;
@@ -29,21 +34,47 @@ void DrawInfoBar(HWND hwnd, HDC hdc) {
     SelectObject(hdc, oldPen);
     
     // Calculate document statistics
-    size_t totalChars = 0;
-    size_t totalLines = textBuffer.size();
-    
-    for (const auto& line : textBuffer) {
-        totalChars += line.length();
-    }
+    size_t totalLines = textBuffer.lineCount();
+    size_t totalChars = textBuffer.length() - (totalLines - 1); // Line breaks don't count
     
     // Format info text
     wchar_t infoText[256];
-    swprintf(infoText, 256,
-            L"Ln %d, Col %d  |  Lines: %zu  |  Chars: %zu",
+    int length = swprintf(infoText, 256,
+            L"Ln %d, Col %d  |  Lines: %zu  |  Chars: %zu  |  Undo: %.1f of %.0f MB, %.1f MB on disk",
             caretLine + 1,
             caretCol + 1,
             totalLines,
-            totalChars);
+            totalChars,
+            undoHistory.memoryUsed() / (1024.0 * 1024.0),
+            undoHistory.budget() / (1024.0 * 1024.0),
+            undoHistory.spilledBytes() / (1024.0 * 1024.0));
+    if (isSearchMode && !searchQuery.empty() && length > 0) {
+        int added;
+        if (searchInProgress) {
+            added = swprintf(infoText + length, 256 - length,
+                    L"  |  Matches: %zu (searching\u2026)",
+                    searchMatches.size());
+        } else {
+            added = swprintf(infoText + length, 256 - length,
+                    L"  |  Matches: %zu (checked %zu in %.2f ms)",
+                    searchMatches.size(),
+                    searchChecked,
+                    searchMillis);
+        }
+        length = added > 0 ? length + added : -1;
+    }
+    if (MappedIndexBuilding() && length > 0) {
+        int added = swprintf(infoText + length, 256 - length,
+                L"  |  Reading %.0f%%, read-only until done",
+                textBuffer.mappedOriginal()->progress() * 100);
+        length = added > 0 ? length + added : -1;
+    }
+    if (TrigramIndexBytes() > 0 && length > 0) {
+        swprintf(infoText + length, 256 - length,
+                L"  |  Index: %.1f MB in %.0f ms",
+                TrigramIndexBytes() / (1024.0 * 1024.0),
+                TrigramIndexMillis());
+    }
     
     SetBkMode(hdc, TRANSPARENT);
     SetTextColor(hdc, RGB(0, 0, 0));
@@ -62,18 +93,8 @@ void DrawInfoBar(HWND hwnd, HDC hdc) {
 void UpdateInfoBar(HWND hwnd) {
     if (!showInfoBar) return;
     
-    // Just invalidate the info bar area for redraw
-    RECT clientRect;
-    GetClientRect(hwnd, &clientRect);
-    
-    RECT infoRect = {
-        0,
-        clientRect.bottom - infoBarHeight,
-        clientRect.right,
-        clientRect.bottom
-    };
-    
-    InvalidateRect(hwnd, &infoRect, FALSE);
+    // Just mark the info bar area, it is invalidated with the rest of the message's damage
+    DamageInfoBar();
 }
 
 void InitInfoBar(HWND hwnd) {
@@ -96,10 +117,10 @@ void InitInfoBar(HWND hwnd) {
 
 void ShowHideInfoBar(HWND hwnd) {
     if (showInfoBar == false) {
-        InvalidateRect(hwnd, NULL, TRUE);
+        DamageAll();
     }else{
     
-    InvalidateRect(hwnd, NULL, TRUE);
+    DamageAll();
     
     // Trigger window resize to adjust editor area
     RECT rcClient;
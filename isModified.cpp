@@ -2,34 +2,57 @@
 #include "textEditorGlobals.h"
 #include <filesystem>
 
-std::vector<std::wstring> savedTextBuffer;
+uint64_t savedVersion = 0;
+uint64_t savedHash = 0;
+size_t savedLength = 0;
+static uint64_t checkedVersion = 0; // Version the title was last updated for
 
-void setOriginal(std::vector<std::wstring> originalTextBuffer, HWND hwnd){
-    savedTextBuffer = textBuffer; 
-    documentModified = false;
+void setTitle(HWND hwnd){
     if (currentFilePath ==L""){
-        SetWindowTextW(hwnd, (L"New Document"));
+        SetWindowTextW(hwnd, documentModified ? L"New Document (Modified)" : L"New Document");
     }else{
         std::filesystem::path path(currentFilePath);
-        SetWindowTextW(hwnd, path.filename().c_str());
-    }
-}
-void isModifiedTag(std::vector<std::wstring> originalTextBuffer,HWND hwnd){
-    if(originalTextBuffer != savedTextBuffer){
-        documentModified = true;
-        if (currentFilePath ==L""){
-            SetWindowTextW(hwnd, (L"New Document (Modified)"));
-        }else{
-            std::filesystem::path path(currentFilePath);
+        if (documentModified){
             SetWindowTextW(hwnd, ((path.filename().wstring())+L" (Modified)").c_str());
-        }
-    }else{
-        documentModified = false;
-        if (currentFilePath ==L""){
-            SetWindowTextW(hwnd, (L"New Document"));
         }else{
-            std::filesystem::path path(currentFilePath);
             SetWindowTextW(hwnd, path.filename().c_str());
         }
     }
+}
+
+// Edits that end back at the saved text (typing then backspacing, undo) hash the same
+static bool differsFromSaved(const PieceTable& textBuffer){
+    return textBuffer.version() != savedVersion &&
+           (textBuffer.length() != savedLength || textBuffer.contentHash() != savedHash);
+}
+
+void setOriginal(const PieceTable& originalTextBuffer, HWND hwnd){
+    savedVersion = originalTextBuffer.version();
+    savedHash = originalTextBuffer.contentHash();
+    savedLength = originalTextBuffer.length();
+    checkedVersion = savedVersion;
+    documentModified = false;
+    setTitle(hwnd);
+}
+void setSavedSnapshot(const TextSnapshot& saved, const PieceTable& textBuffer, HWND hwnd){
+    savedVersion = saved.version();
+    savedHash = saved.contentHash();
+    savedLength = saved.length();
+    // Typing may have carried on while the snapshot was written
+    checkedVersion = textBuffer.version();
+    documentModified = differsFromSaved(textBuffer);
+    setTitle(hwnd);
+}
+void isModifiedTag(const PieceTable& originalTextBuffer,HWND hwnd){
+    // Nothing changed since the last check, the title is already right
+    if (originalTextBuffer.version() == checkedVersion){
+        return;
+    }
+    checkedVersion = originalTextBuffer.version();
+
+    bool modified = differsFromSaved(originalTextBuffer);
+    if (modified != documentModified){
+        documentModified = modified;
+        setTitle(hwnd);
+    }
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #pragma once
 
 #include <windows.h> 
-#include <vector>
 #include <string>    // For std::wstring
+#include <cstdint>
+#include "pieceTable.h"
 
-extern std::vector<std::wstring> savedTextBuffer;
+// Saved state, compared against the buffer's O(1) version and content hash
+extern uint64_t savedVersion;
+extern uint64_t savedHash;
+extern size_t savedLength;
 
-void isModifiedTag(std::vector<std::wstring> originalTextBuffer, HWND hwnd);
-void setOriginal(std::vector<std::wstring> originalTextBuffer, HWND hwnd);
\ No newline at end of file
+void setTitle(HWND hwnd);
+void isModifiedTag(const PieceTable& originalTextBuffer, HWND hwnd);
+void setOriginal(const PieceTable& originalTextBuffer, HWND hwnd);
+// A background save finished writing saved, which may be behind textBuffer by now
+void setSavedSnapshot(const TextSnapshot& saved, const PieceTable& textBuffer, HWND hwnd);
\ No newline at end of file
@@ -0,0 +1,171 @@
+#define NOMINMAX
+
+#include "lineWidths.h"
+
+#include <algorithm>
+
+namespace {
+    // xorshift32 for treap priorities
+    uint32_t nextPriority() {
+        static uint32_t state = 88172645u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+}
+
+LineWidths::LineWidths() : root(-1) {}
+
+void LineWidths::assign(const std::vector<int>& widths) {
+    nodes.clear();
+    freeNodes.clear();
+    nodes.reserve(widths.size());
+    root = build(widths.data(), widths.size());
+}
+
+void LineWidths::insertLines(size_t line, const int* widths, size_t count) {
+    int left, right;
+    split(root, line, left, right);
+    root = merge(merge(left, build(widths, count)), right);
+}
+
+// Builds a treap of the widths left to right in O(count), keeping the right spine on a stack
+int LineWidths::build(const int* widths, size_t count) {
+    spine.clear();
+    for (size_t i = 0; i < count; ++i) {
+        int n = newNode(widths[i]);
+        int last = -1;
+        while (!spine.empty() && nodes[spine.back()].priority < nodes[n].priority) {
+            last = spine.back();
+            spine.pop_back();
+            pull(last);
+        }
+        nodes[n].left = last;
+        if (!spine.empty()) {
+            nodes[spine.back()].right = n;
+        }
+        spine.push_back(n);
+    }
+    int top = -1;
+    while (!spine.empty()) {
+        pull(spine.back());
+        top = spine.back();
+        spine.pop_back();
+    }
+    return top;
+}
+
+void LineWidths::eraseLines(size_t line, size_t count) {
+    int left, middle, right, rest;
+    split(root, line, left, rest);
+    split(rest, count, middle, right);
+    freeSubtree(middle);
+    root = merge(left, right);
+}
+
+void LineWidths::set(size_t line, int width) {
+    if (line >= size()) return;
+    int left, middle, right, rest;
+    split(root, line, left, rest);
+    split(rest, 1, middle, right);
+    nodes[middle].width = width;
+    pull(middle);
+    root = merge(merge(left, middle), right);
+}
+
+int LineWidths::get(size_t line) const {
+    int n = root;
+    while (n != -1) {
+        size_t leftCount = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].count;
+        if (line < leftCount) {
+            n = nodes[n].left;
+        } else if (line == leftCount) {
+            return nodes[n].width;
+        } else {
+            line -= leftCount + 1;
+            n = nodes[n].right;
+        }
+    }
+    return 0;
+}
+
+int LineWidths::maxWidth() const {
+    return root == -1 ? 0 : nodes[root].maxWidth;
+}
+
+size_t LineWidths::size() const {
+    return root == -1 ? 0 : nodes[root].count;
+}
+
+int LineWidths::newNode(int width) {
+    int n;
+    if (!freeNodes.empty()) {
+        n = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        n = (int)nodes.size();
+        nodes.emplace_back();
+    }
+    nodes[n] = Node{width, width, nextPriority(), -1, -1, 1};
+    return n;
+}
+
+void LineWidths::freeSubtree(int n) {
+    if (n == -1) return;
+    freeSubtree(nodes[n].left);
+    freeSubtree(nodes[n].right);
+    freeNodes.push_back(n);
+}
+
+void LineWidths::pull(int n) {
+    Node& node = nodes[n];
+    node.count = 1;
+    node.maxWidth = node.width;
+    if (node.left != -1) {
+        node.count += nodes[node.left].count;
+        node.maxWidth = std::max(node.maxWidth, nodes[node.left].maxWidth);
+    }
+    if (node.right != -1) {
+        node.count += nodes[node.right].count;
+        node.maxWidth = std::max(node.maxWidth, nodes[node.right].maxWidth);
+    }
+}
+
+int LineWidths::merge(int a, int b) {
+    if (a == -1) return b;
+    if (b == -1) return a;
+    if (nodes[a].priority > nodes[b].priority) {
+        int merged = merge(nodes[a].right, b);
+        nodes[a].right = merged;
+        pull(a);
+        return a;
+    }
+    int merged = merge(a, nodes[b].left);
+    nodes[b].left = merged;
+    pull(b);
+    return b;
+}
+
+// Splits so that left holds the first index lines
+void LineWidths::split(int n, size_t index, int& left, int& right) {
+    if (n == -1) {
+        left = right = -1;
+        return;
+    }
+    size_t leftCount = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].count;
+    int a, b;
+    if (index <= leftCount) {
+        split(nodes[n].left, index, a, b);
+        nodes[n].left = b;
+        pull(n);
+        left = a;
+        right = n;
+    } else {
+        split(nodes[n].right, index - leftCount - 1, a, b);
+        nodes[n].right = a;
+        pull(n);
+        left = n;
+        right = b;
+    }
+}
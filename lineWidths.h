@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-line pixel width cache.
+// Widths are kept in an implicit treap ordered by line number, each node caching
+// the maximum width of its subtree. Inserting/removing lines and updating one width
+// are O(log n), and the widest line (for the horizontal scroll bar) is O(1).
+class LineWidths {
+public:
+    LineWidths();
+
+    void assign(const std::vector<int>& widths); // Rebuild from a full measurement, O(n)
+    void insertLines(size_t line, const int* widths, size_t count); // Spliced in as one subtree, O(count + log n)
+    void eraseLines(size_t line, size_t count);
+    void set(size_t line, int width);
+    int get(size_t line) const;
+    int maxWidth() const;
+    size_t size() const;
+
+private:
+    struct Node {
+        int width;
+        int maxWidth;   // Cached over the whole subtree
+        uint32_t priority;
+        int left;
+        int right;
+        size_t count;   // Lines in the subtree
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<int> spine; // build's right spine, kept to save the allocation
+    int root;
+
+    int newNode(int width);
+    int build(const int* widths, size_t count);
+    void freeSubtree(int n);
+    void pull(int n);
+    int merge(int a, int b);
+    void split(int n, size_t index, int& left, int& right);
+};
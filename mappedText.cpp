@@ -0,0 +1,271 @@
+#define NOMINMAX
+
+#include "mappedText.h"
+#include "charScan.h"
+#include "rollingHash.h"
+
+#include <cstring>
+#include <thread>
+
+namespace {
+    // The first screen is indexed before the load returns, but not past this much of a long line
+    const size_t FIRST_SCREEN_BYTES = 1024 * 1024;
+    // Batches go to the UI thread about this often
+    const DWORD BATCH_MILLIS = 100;
+
+    std::shared_ptr<MappedText> indexing; // The text the worker is indexing, UI thread only
+    std::atomic<uint64_t> indexGeneration{0};
+    std::thread indexThread;
+
+    bool isWide(TextEncoding encoding) {
+        return encoding == TextEncoding::UTF16LE || encoding == TextEncoding::UTF16BE;
+    }
+
+    // End of the block of data[from, size): just after its CHECKPOINT_LINES-th line break, or
+    // after the last one before CHECKPOINT_BYTES. A line longer than that is cut where decoding
+    // can start again, never inside a UTF-8 sequence or between \r and \n. ANSI text may be
+    // double-byte, where only a line break is safe, so there the block runs to the line's end.
+    size_t blockEnd(const char* data, size_t from, size_t size, TextEncoding encoding) {
+        size_t limit = std::min(size, from + MappedText::CHECKPOINT_BYTES);
+        size_t lastBreak = 0;
+        size_t lines = 0;
+        if (isWide(encoding)) {
+            int low = encoding == TextEncoding::UTF16LE ? 0 : 1; // Byte of the unit holding the ASCII value
+            for (size_t i = from; i + 1 < limit; i += 2) {
+                if (data[i + low] == '\n' && data[i + 1 - low] == 0) {
+                    lastBreak = i + 2;
+                    if (++lines == MappedText::CHECKPOINT_LINES) return lastBreak;
+                }
+            }
+        } else {
+            for (const char* at = data + from;;) {
+                const char* found = (const char*)memchr(at, '\n', data + limit - at);
+                if (!found) break;
+                lastBreak = found - data + 1;
+                if (++lines == MappedText::CHECKPOINT_LINES) return lastBreak;
+                at = found + 1;
+            }
+        }
+        if (limit == size) return size;
+        if (lastBreak != 0) return lastBreak;
+
+        size_t end = limit;
+        if (isWide(encoding)) {
+            int low = encoding == TextEncoding::UTF16LE ? 0 : 1;
+            bool crBefore = data[end - 2 + low] == '\r' && data[end - 1 - low] == 0;
+            bool lfAfter = end + 1 < size && data[end + low] == '\n' && data[end + 1 - low] == 0;
+            return crBefore && lfAfter ? end - 2 : end;
+        }
+        if (encoding == TextEncoding::ANSI) {
+            const char* found = (const char*)memchr(data + limit, '\n', size - limit);
+            return found ? found - data + 1 : size;
+        }
+        for (int back = 0; back < 3 && ((unsigned char)data[end] & 0xC0) == 0x80; ++back) end--;
+        if (data[end - 1] == '\r' && data[end] == '\n') end--;
+        return end;
+    }
+}
+
+MappedText::MappedText()
+    : file(INVALID_HANDLE_VALUE), mapping(NULL), view(NULL), size(0), bomLength(0),
+      textEncoding(TextEncoding::UTF8), longest(0), crlfCount(0), aside(false) {}
+
+std::shared_ptr<MappedText> MappedText::map(HANDLE file, size_t size, const std::wstring& path) {
+    std::shared_ptr<MappedText> text(new MappedText());
+    text->file = file;
+    text->size = size;
+    text->filePath = path;
+    text->mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    text->view = text->mapping ? (const char*)MapViewOfFile(text->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!text->view) return nullptr;
+
+    // A save over the file that a crash stopped from deleting the old one
+    DeleteFileW(text->asidePath().c_str());
+    text->textEncoding = DetectEncoding(text->view, size, text->bomLength);
+    text->restart(text->textEncoding);
+    return text;
+}
+
+MappedText::~MappedText() {
+    if (view) UnmapViewOfFile(view);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    if (aside) DeleteFileW(asidePath().c_str());
+}
+
+LineEnding MappedText::lineEnding() const {
+    return crlfCount > 0 && crlfCount * 2 >= lineBreaks() ? LineEnding::CRLF : LineEnding::LF;
+}
+
+double MappedText::progress() const {
+    return size > bomLength ? (double)(checkpoints.back().byte - bomLength) / (size - bomLength) : 1.0;
+}
+
+size_t MappedText::blockAt(size_t offset) const {
+    auto after = std::upper_bound(checkpoints.begin(), checkpoints.end(), offset,
+                                  [](size_t value, const MappedCheckpoint& at) { return value < at.offset; });
+    return std::min((size_t)(after - checkpoints.begin()) - 1, blockCount() - 1);
+}
+
+// The last block whose first checkpoint has at most index breaks before it, so the next has more
+size_t MappedText::blockOfBreak(size_t index) const {
+    auto after = std::upper_bound(checkpoints.begin(), checkpoints.end(), index,
+                                  [](size_t value, const MappedCheckpoint& at) { return value < at.line; });
+    return (after - checkpoints.begin()) - 1;
+}
+
+// Blocks never end between \r and \n, so each normalizes on its own as it would in the whole text
+void MappedText::decode(size_t first, size_t last, std::wstring& text) const {
+    const MappedCheckpoint& from = checkpoints[first];
+    DecodeText(view + from.byte, checkpoints[last].byte - from.byte, textEncoding, text);
+    NormalizeLineEndings(text);
+}
+
+size_t MappedText::nextBreak(size_t offset) const {
+    if (offset >= length()) return length();
+    std::wstring text;
+    size_t block = blockAt(offset);
+    decode(block, block + 1, text);
+    size_t at = offset - checkpoints[block].offset;
+    size_t found = FindChar(text.data() + at, text.size() - at, L'\n');
+    if (found < text.size() - at) return offset + found;
+
+    // The first break after this block opens the block holding it
+    size_t index = checkpoints[block + 1].line;
+    if (index >= lineBreaks()) return length();
+    block = blockOfBreak(index);
+    decode(block, block + 1, text);
+    return checkpoints[block].offset + FindChar(text.data(), text.size(), L'\n');
+}
+
+MappedIndexState MappedText::startState() const {
+    return MappedIndexState{MappedCheckpoint{bomLength, 0, 0, 0}, textEncoding, 0, 0, 0};
+}
+
+bool MappedText::indexBlock(MappedIndexState& state, std::vector<MappedCheckpoint>& out, std::wstring& scratch) const {
+    size_t from = (size_t)state.at.byte;
+    if (from >= size) return false;
+    size_t end = blockEnd(view, from, size, state.encoding);
+    if (DecodeText(view + from, end - from, state.encoding, scratch) != state.encoding) {
+        // Not valid UTF-8, so the whole file is ANSI as a full decode would have made it
+        state = MappedIndexState{MappedCheckpoint{bomLength, 0, 0, 0}, TextEncoding::ANSI, 0, 0, 0};
+        out.clear();
+        return true;
+    }
+    size_t decoded = scratch.size();
+    NormalizeLineEndings(scratch);
+    state.crlfBreaks += decoded - scratch.size(); // Each \r dropped was the start of a \r\n
+
+    const wchar_t* text = scratch.data();
+    size_t count = scratch.size();
+    size_t lineStart = 0;
+    size_t breaks = 0;
+    for (size_t i = FindChar(text, count, L'\n'); i < count; i = i + 1 + FindChar(text + i + 1, count - i - 1, L'\n')) {
+        state.longestLine = std::max(state.longestLine, state.lineChars + (i - lineStart));
+        state.lineChars = 0;
+        lineStart = i + 1;
+        breaks++;
+    }
+    state.lineChars += count - lineStart;
+    state.longestLine = std::max(state.longestLine, state.lineChars);
+
+    state.at = MappedCheckpoint{end, state.at.offset + count, state.at.line + breaks, extendHash(state.at.hash, text, count)};
+    out.push_back(state.at);
+    return true;
+}
+
+void MappedText::restart(TextEncoding encoding) {
+    textEncoding = encoding;
+    checkpoints.assign(1, MappedCheckpoint{bomLength, 0, 0, 0});
+    longest = 0;
+    crlfCount = 0;
+}
+
+void MappedText::add(const std::vector<MappedCheckpoint>& more, size_t longestLine, size_t crlfBreaks) {
+    checkpoints.insert(checkpoints.end(), more.begin(), more.end());
+    longest = longestLine;
+    crlfCount = crlfBreaks;
+}
+
+bool MappedText::isFile(const std::wstring& path) const {
+    HANDLE other = CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, 0, NULL);
+    if (other == INVALID_HANDLE_VALUE) return false;
+    BY_HANDLE_FILE_INFORMATION mine, theirs;
+    bool same = GetFileInformationByHandle(file, &mine) && GetFileInformationByHandle(other, &theirs) &&
+                mine.dwVolumeSerialNumber == theirs.dwVolumeSerialNumber &&
+                mine.nFileIndexHigh == theirs.nFileIndexHigh && mine.nFileIndexLow == theirs.nFileIndexLow;
+    CloseHandle(other);
+    return same;
+}
+
+void StartMappedIndex(HWND hwnd, std::shared_ptr<MappedText> text, size_t firstLines) {
+    CancelMappedIndex();
+
+    // Enough for the first paint, so the window never shows an empty document first
+    MappedIndexState state = text->startState();
+    std::vector<MappedCheckpoint> first;
+    std::wstring scratch;
+    while (state.at.line < firstLines && state.at.byte < FIRST_SCREEN_BYTES && text->indexBlock(state, first, scratch)) {
+    }
+    if (state.encoding != text->encoding()) {
+        text->restart(state.encoding);
+    }
+    text->add(first, state.longestLine, state.crlfBreaks);
+
+    indexing = text;
+    uint64_t generation = ++indexGeneration;
+    indexThread = std::thread([hwnd, text = std::shared_ptr<const MappedText>(text), state, generation]() mutable {
+        std::wstring scratch;
+        std::unique_ptr<MappedIndexBatch> batch(new MappedIndexBatch{generation, state.encoding, false});
+        DWORD started = GetTickCount();
+        for (;;) {
+            bool more = text->indexBlock(state, batch->checkpoints, scratch);
+            if (indexGeneration.load(std::memory_order_relaxed) != generation) return;
+            if (state.encoding != batch->encoding) {
+                batch->encoding = state.encoding;
+                batch->restart = true;
+            }
+            if (more && GetTickCount() - started < BATCH_MILLIS) continue;
+
+            batch->longestLine = state.longestLine;
+            batch->crlfBreaks = state.crlfBreaks;
+            batch->done = !more;
+            if (!PostMessage(hwnd, WM_FILE_INDEXED, 0, (LPARAM)batch.get())) return; // The window is gone
+            batch.release();
+            if (!more) return;
+            batch.reset(new MappedIndexBatch{generation, state.encoding, false});
+            started = GetTickCount();
+        }
+    });
+}
+
+void CancelMappedIndex() {
+    ++indexGeneration;
+    if (indexThread.joinable()) {
+        indexThread.join();
+    }
+    indexing.reset();
+}
+
+bool MappedIndexBuilding() {
+    return indexing != nullptr;
+}
+
+std::shared_ptr<MappedText> ReceiveMappedIndex(LPARAM lParam, bool& restarted) {
+    std::unique_ptr<MappedIndexBatch> batch((MappedIndexBatch*)lParam);
+    restarted = false;
+    if (!indexing || batch->generation != indexGeneration) return nullptr;
+
+    if (batch->restart) {
+        indexing->restart(batch->encoding);
+        restarted = true;
+    }
+    indexing->add(batch->checkpoints, batch->longestLine, batch->crlfBreaks);
+    std::shared_ptr<MappedText> text = indexing;
+    if (batch->done) {
+        indexThread.join(); // It posted this as its last act
+        indexing.reset();
+    }
+    return text;
+}
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "textEncoding.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Posted by the indexer of a mapped file as it goes, lParam owns a MappedIndexBatch (see ReceiveMappedIndex)
+#define WM_FILE_INDEXED (WM_APP + 4)
+
+// Where decoding can pick up again: the file offset, the text offset it is at once line
+// endings are normalized, the line breaks before it and the rolling hash of the text before it
+struct MappedCheckpoint {
+    uint64_t byte;
+    size_t offset;
+    size_t line;
+    uint64_t hash;
+};
+
+// How far the indexer has got
+struct MappedIndexState {
+    MappedCheckpoint at;
+    TextEncoding encoding;  // Drops to ANSI, and starts over, if the bytes aren't UTF-8 after all
+    size_t lineChars;       // Of the line the last block ended in
+    size_t longestLine;
+    size_t crlfBreaks;
+};
+
+struct MappedIndexBatch {
+    uint64_t generation;
+    TextEncoding encoding;
+    bool restart;            // The checkpoints start over, in encoding
+    std::vector<MappedCheckpoint> checkpoints;
+    size_t longestLine;      // In characters, over all the text indexed so far
+    size_t crlfBreaks;
+    bool done;
+};
+
+// A large file shown in place. It stays mapped read-only and its text is decoded a block at a
+// time as it is looked at, so opening it costs the same whatever its size and memory follows
+// what is viewed rather than the file. A block ends at a line break once it has
+// CHECKPOINT_LINES lines or is about to pass CHECKPOINT_BYTES, so finding any offset or line
+// takes decoding one block. The checkpoints between blocks are recorded by a worker thread
+// while the text is already on screen; until they are complete only the UI thread uses the
+// text, after that it never changes and snapshots read it from any thread.
+class MappedText {
+public:
+    static constexpr size_t CHECKPOINT_LINES = 256;
+    static constexpr size_t CHECKPOINT_BYTES = 16 * 1024;
+
+    // Takes over file, open for reading, and maps its size bytes; null if it can't be mapped
+    static std::shared_ptr<MappedText> map(HANDLE file, size_t size, const std::wstring& path);
+    ~MappedText();
+
+    TextEncoding encoding() const { return textEncoding; }
+    size_t length() const { return checkpoints.back().offset; } // Of the text indexed so far
+    size_t lineBreaks() const { return checkpoints.back().line; }
+    uint64_t hash() const { return checkpoints.back().hash; }
+    size_t longestLine() const { return longest; }
+    LineEnding lineEnding() const; // The style most of the line breaks so far use
+    double progress() const;       // Share of the file indexed
+
+    // Block b is the text between checkpoints b and b + 1
+    size_t blockCount() const { return checkpoints.size() - 1; }
+    const MappedCheckpoint& checkpoint(size_t block) const { return checkpoints[block]; }
+    size_t blockAt(size_t offset) const;      // Holding the text offset, offset < length()
+    size_t blockOfBreak(size_t index) const;  // Holding the index-th line break, from 0
+    void decode(size_t first, size_t last, std::wstring& text) const; // Blocks [first, last)
+    size_t nextBreak(size_t offset) const;    // First L'\n' at or after offset, length() if none
+
+    // Calls sink(const wchar_t* text, size_t count) for the text [offset, offset + count),
+    // decoding a few blocks at a time
+    template <typename Sink>
+    void forEachSpan(size_t offset, size_t count, Sink sink) const {
+        if (count == 0) return;
+        std::wstring text;
+        size_t end = blockAt(offset + count - 1) + 1;
+        for (size_t block = blockAt(offset); count > 0 && block < end;) {
+            size_t last = std::min(end, block + SPAN_BLOCKS);
+            decode(block, last, text);
+            size_t at = offset - checkpoints[block].offset;
+            size_t take = std::min(count, text.size() - at);
+            if (take > 0) sink(text.data() + at, take);
+            offset += take;
+            count -= take;
+            block = last;
+        }
+    }
+
+    // Indexing. indexBlock decodes the block starting at state and adds its end as a
+    // checkpoint to out, false at the end of the file; it only reads the mapping.
+    MappedIndexState startState() const;
+    bool indexBlock(MappedIndexState& state, std::vector<MappedCheckpoint>& out, std::wstring& scratch) const;
+    void restart(TextEncoding encoding); // Drops the checkpoints
+    void add(const std::vector<MappedCheckpoint>& more, size_t longestLine, size_t crlfBreaks);
+
+    // A save over the mapped file can't delete it, so it moves it to asidePath(), and the
+    // text deletes it there once nothing reads it any more
+    bool isFile(const std::wstring& path) const; // The same file, however the path is written
+    std::wstring asidePath() const { return filePath + L".original"; }
+    void movedAside() const { aside = true; }
+
+private:
+    static constexpr size_t SPAN_BLOCKS = 64;
+
+    HANDLE file;
+    HANDLE mapping;
+    const char* view;
+    size_t size;
+    size_t bomLength;
+    std::wstring filePath;
+    TextEncoding textEncoding;
+    std::vector<MappedCheckpoint> checkpoints; // The first is the start of the text
+    size_t longest;
+    size_t crlfCount;
+    mutable std::atomic<bool> aside;
+
+    MappedText();
+};
+
+// Indexes the first lines of text, up to firstLines, here and the rest on a worker thread
+// posting WM_FILE_INDEXED batches to hwnd every so often. Until the last one is taken the
+// text can be shown but not edited or snapshotted, since its checkpoints still grow.
+void StartMappedIndex(HWND hwnd, std::shared_ptr<MappedText> text, size_t firstLines);
+// Stops an index in flight (another document, exit)
+void CancelMappedIndex();
+bool MappedIndexBuilding();
+// WM_FILE_INDEXED: adds the batch to the text being indexed and returns it, restarted when
+// its checkpoints started over in another encoding. Null for a batch of an index since cancelled.
+std::shared_ptr<MappedText> ReceiveMappedIndex(LPARAM lParam, bool& restarted);
\ No newline at end of file
@@ -0,0 +1,208 @@
+#define NOMINMAX
+
+#include "matchList.h"
+
+namespace {
+    // xorshift32 for treap priorities
+    uint32_t nextPriority() {
+        static uint32_t state = 2463534242u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+}
+
+MatchList::MatchList() : root(-1) {}
+
+size_t MatchList::size() const {
+    return root == -1 ? 0 : nodes[root].count;
+}
+
+// Shifts are summed on the way down rather than pushed, so lookups stay const
+SearchMatch MatchList::operator[](size_t index) const {
+    int n = root;
+    int shift = 0;
+    while (n != -1) {
+        shift += nodes[n].shift;
+        size_t leftCount = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].count;
+        if (index < leftCount) {
+            n = nodes[n].left;
+        } else if (index == leftCount) {
+            SearchMatch match = nodes[n].match;
+            match.line += shift;
+            return match;
+        } else {
+            index -= leftCount + 1;
+            n = nodes[n].right;
+        }
+    }
+    return SearchMatch{0, 0, 0};
+}
+
+size_t MatchList::firstOnLine(int line) const {
+    int n = root;
+    int shift = 0;
+    size_t before = 0;
+    size_t found = size();
+    while (n != -1) {
+        shift += nodes[n].shift;
+        size_t leftCount = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].count;
+        if (nodes[n].match.line + shift >= line) {
+            found = before + leftCount;
+            n = nodes[n].left;
+        } else {
+            before += leftCount + 1;
+            n = nodes[n].right;
+        }
+    }
+    return found;
+}
+
+void MatchList::clear() {
+    nodes.clear();
+    freeNodes.clear();
+    root = -1;
+}
+
+void MatchList::append(const SearchMatch* matches, size_t count) {
+    root = merge(root, build(matches, count));
+}
+
+void MatchList::splice(int line, int removedLines, const std::vector<SearchMatch>& replacement, int delta) {
+    size_t first = firstOnLine(line);
+    size_t last = firstOnLine(line + removedLines + 1);
+    int left, middle, right, rest;
+    split(root, first, left, rest);
+    split(rest, last - first, middle, right);
+    freeSubtree(middle);
+    if (right != -1) {
+        nodes[right].shift += delta;
+    }
+    root = merge(merge(left, build(replacement.data(), replacement.size())), right);
+}
+
+void MatchList::copyTo(std::vector<SearchMatch>& out) const {
+    // In-order walk with an explicit stack, carrying each node's summed shift
+    std::vector<std::pair<int, int>> stack;
+    int n = root;
+    int shift = 0;
+    while (n != -1 || !stack.empty()) {
+        while (n != -1) {
+            shift += nodes[n].shift;
+            stack.emplace_back(n, shift);
+            n = nodes[n].left;
+        }
+        auto [top, topShift] = stack.back();
+        stack.pop_back();
+        SearchMatch match = nodes[top].match;
+        match.line += topShift;
+        out.push_back(match);
+        n = nodes[top].right;
+        shift = topShift;
+    }
+}
+
+// Builds a treap of the matches left to right in O(count), keeping the right spine on a stack
+int MatchList::build(const SearchMatch* matches, size_t count) {
+    spine.clear();
+    for (size_t i = 0; i < count; ++i) {
+        int n = newNode(matches[i]);
+        int last = -1;
+        while (!spine.empty() && nodes[spine.back()].priority < nodes[n].priority) {
+            last = spine.back();
+            spine.pop_back();
+            pull(last);
+        }
+        nodes[n].left = last;
+        if (!spine.empty()) {
+            nodes[spine.back()].right = n;
+        }
+        spine.push_back(n);
+    }
+    int top = -1;
+    while (!spine.empty()) {
+        pull(spine.back());
+        top = spine.back();
+        spine.pop_back();
+    }
+    return top;
+}
+
+int MatchList::newNode(const SearchMatch& match) {
+    int n;
+    if (!freeNodes.empty()) {
+        n = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        n = (int)nodes.size();
+        nodes.emplace_back();
+    }
+    nodes[n] = Node{match, 0, nextPriority(), -1, -1, 1};
+    return n;
+}
+
+// Shifts pending above n don't matter, the nodes are reused as they are
+void MatchList::freeSubtree(int n) {
+    if (n == -1) return;
+    freeSubtree(nodes[n].left);
+    freeSubtree(nodes[n].right);
+    freeNodes.push_back(n);
+}
+
+void MatchList::push(int n) {
+    Node& node = nodes[n];
+    if (node.shift == 0) return;
+    node.match.line += node.shift;
+    if (node.left != -1) nodes[node.left].shift += node.shift;
+    if (node.right != -1) nodes[node.right].shift += node.shift;
+    node.shift = 0;
+}
+
+void MatchList::pull(int n) {
+    Node& node = nodes[n];
+    node.count = 1;
+    if (node.left != -1) node.count += nodes[node.left].count;
+    if (node.right != -1) node.count += nodes[node.right].count;
+}
+
+int MatchList::merge(int a, int b) {
+    if (a == -1) return b;
+    if (b == -1) return a;
+    if (nodes[a].priority > nodes[b].priority) {
+        push(a);
+        int merged = merge(nodes[a].right, b);
+        nodes[a].right = merged;
+        pull(a);
+        return a;
+    }
+    push(b);
+    int merged = merge(a, nodes[b].left);
+    nodes[b].left = merged;
+    pull(b);
+    return b;
+}
+
+// Splits so that left holds the first index matches
+void MatchList::split(int n, size_t index, int& left, int& right) {
+    if (n == -1) {
+        left = right = -1;
+        return;
+    }
+    push(n);
+    size_t leftCount = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].count;
+    int a, b;
+    if (index <= leftCount) {
+        split(nodes[n].left, index, a, b);
+        nodes[n].left = b;
+        pull(n);
+        left = a;
+        right = n;
+    } else {
+        split(nodes[n].right, index - leftCount - 1, a, b);
+        nodes[n].right = a;
+        pull(n);
+        left = n;
+        right = b;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "searchWorker.h" // For SearchMatch
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Search matches sorted by line then column.
+// Kept in an implicit treap ordered by position, each node carrying a line shift still to be
+// applied to its subtree. Moving every match below an edit is one shift on the subtree
+// split off after it, so replacing the k matches of a few lines is O(k + log n) however many
+// matches follow. Index and line lookups are O(log n).
+class MatchList {
+public:
+    MatchList();
+
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    SearchMatch operator[](size_t index) const;
+    SearchMatch back() const { return (*this)[size() - 1]; }
+    size_t firstOnLine(int line) const; // Index of the first match on line or after it
+
+    void clear();
+    void append(const SearchMatch* matches, size_t count); // After every match already held
+    void push_back(const SearchMatch& match) { append(&match, 1); }
+    // Replaces the matches on lines [line, line + removedLines] with replacement, sorted and
+    // on the lines as they are now, and moves the matches after them by delta lines
+    void splice(int line, int removedLines, const std::vector<SearchMatch>& replacement, int delta);
+    void copyTo(std::vector<SearchMatch>& out) const; // Appends every match in order
+
+private:
+    struct Node {
+        SearchMatch match;
+        int shift; // Lines still to add to every match in the subtree, this one included
+        uint32_t priority;
+        int left;
+        int right;
+        size_t count; // Matches in the subtree
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<int> spine; // build's right spine, kept to save the allocation
+    int root;
+
+    int newNode(const SearchMatch& match);
+    int build(const SearchMatch* matches, size_t count);
+    void freeSubtree(int n);
+    void push(int n);
+    void pull(int n);
+    int merge(int a, int b);
+    void split(int n, size_t index, int& left, int& right);
+};
\ No newline at end of file
@@ -0,0 +1,734 @@
+#define NOMINMAX
+
+#include "pieceTable.h"
+#include "charScan.h"
+#include "rollingHash.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+    // xorshift32 for treap priorities, deterministic so timings are repeatable
+    uint32_t nextPriority() {
+        static uint32_t state = 2463534242u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    void recordBreaks(const wchar_t* text, size_t count, size_t base, std::vector<size_t>& breaks) {
+        for (size_t i = FindChar(text, count, L'\n'); i < count; i = i + 1 + FindChar(text + i + 1, count - i - 1, L'\n')) {
+            breaks.push_back(base + i);
+        }
+    }
+
+    const size_t HASH_CHECKPOINT = 64;  // Prefix hashes are kept every 64 chars
+
+    // Extends the running hash of a buffer by text, recording a checkpoint on every 64-char boundary.
+    // Whole checkpoints are hashed four at a time as separate chains, each folded in with
+    // hash(A + B) = hash(A) * BASE^|B| + hash(B), so the multiplies don't wait on each other,
+    // and each chain is only reduced at its end.
+    void recordHashes(const wchar_t* text, size_t count, size_t base, uint64_t& running, std::vector<uint64_t>& prefixes) {
+        static const uint64_t checkpointPow = powMod(HASH_CHECKPOINT);
+        size_t i = 0;
+        for (; i < count && (base + i) % HASH_CHECKPOINT != 0; ++i) {
+            running = hashStep(running, text[i]);
+            if ((base + i + 1) % HASH_CHECKPOINT == 0) {
+                prefixes.push_back(running);
+            }
+        }
+        for (; count - i >= 4 * HASH_CHECKPOINT; i += 4 * HASH_CHECKPOINT) {
+            const wchar_t* block = text + i;
+            uint64_t h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+            for (size_t j = 0; j < HASH_CHECKPOINT; ++j) {
+                h0 = hashStepPartial(h0, block[j]);
+                h1 = hashStepPartial(h1, block[HASH_CHECKPOINT + j]);
+                h2 = hashStepPartial(h2, block[2 * HASH_CHECKPOINT + j]);
+                h3 = hashStepPartial(h3, block[3 * HASH_CHECKPOINT + j]);
+            }
+            for (uint64_t h : {h0, h1, h2, h3}) {
+                running = addMod(mulMod(running, checkpointPow), reduceHash(h));
+                prefixes.push_back(running);
+            }
+        }
+        for (; i < count; ++i) {
+            running = hashStep(running, text[i]);
+            if ((base + i + 1) % HASH_CHECKPOINT == 0) {
+                prefixes.push_back(running);
+            }
+        }
+    }
+
+    // Below this many chars the index is built on the calling thread
+    const size_t PARALLEL_INDEX_MIN = 4 * 1024 * 1024;
+
+    // Blocks of a mapped original kept decoded, enough for a screen that straddles two
+    // and an edit elsewhere
+    const size_t DECODED_BLOCKS = 4;
+
+    // Room a new add buffer chunk is made with, unless one insert needs more
+    const size_t ADD_CHUNK_CHARS = 1 << 20;
+
+    // text holds the buffer from offset base on, which is a checkpoint at or before end
+    uint64_t prefixHash(const wchar_t* text, size_t base, const std::vector<uint64_t>& prefixes, size_t end) {
+        size_t checkpoint = end / HASH_CHECKPOINT;
+        uint64_t hash = prefixes[checkpoint];
+        for (size_t i = checkpoint * HASH_CHECKPOINT; i < end; ++i) {
+            hash = hashStep(hash, text[i - base]);
+        }
+        return hash;
+    }
+}
+
+PieceTable::PieceTable() : nextDecoded(0), editVersion(0), root(-1) {
+    clear();
+}
+
+void PieceTable::clear() {
+    originalBuffer = std::make_shared<const std::wstring>();
+    mapped.reset();
+    decodedBlocks.assign(DECODED_BLOCKS, DecodedBlock{SIZE_MAX, L"", {}});
+    originalBreaks.clear();
+    originalPrefixHashes.assign(1, 0);
+    addChunks.assign(1, AddChunk{0, std::make_shared<std::wstring>()}); // Snapshots may still read the old ones
+    addBreaks.clear();
+    addPrefixHashes.assign(1, 0);
+    addRunningHash = 0;
+    nodes.clear();
+    freeNodes.clear();
+    root = -1;
+    editVersion++;
+}
+
+void PieceTable::load(std::wstring text) {
+    clear();
+    originalBuffer = std::make_shared<const std::wstring>(std::move(text));
+    indexOriginal();
+    if (!originalBuffer->empty()) {
+        Piece piece{false, 0, originalBuffer->size(), originalBreaks.size()};
+        root = newNode(piece, nextPriority());
+    }
+}
+
+// The checkpoints of text stand in for the original buffer's indexes, so only the blocks
+// that get read are ever decoded
+void PieceTable::loadMapped(std::shared_ptr<const MappedText> text) {
+    clear();
+    mapped = std::move(text);
+    if (mapped->length() != 0) {
+        root = newNode(Piece{false, 0, mapped->length(), mapped->lineBreaks()}, nextPriority());
+    }
+}
+
+// Until the index is complete the document is the one piece of everything indexed so far
+void PieceTable::mappedGrew() {
+    Piece piece{false, 0, mapped->length(), mapped->lineBreaks()};
+    if (piece.length == 0) return;
+    if (root == -1) {
+        root = newNode(piece, nextPriority());
+    } else {
+        setPiece(root, piece);
+        pull(root);
+    }
+}
+
+const MappedText* PieceTable::mappedOriginal() const {
+    return mapped.get();
+}
+
+// Line breaks and hash checkpoints of the original buffer. Large buffers are cut into
+// checkpoint-aligned blocks indexed on worker threads, then stitched together in order.
+void PieceTable::indexOriginal() {
+    const wchar_t* data = originalBuffer->data();
+    size_t size = originalBuffer->size();
+    unsigned workers = size < PARALLEL_INDEX_MIN ? 1 : std::max(1u, std::min(std::thread::hardware_concurrency(), 16u));
+    if (workers == 1) {
+        originalBreaks.reserve(CountChar(data, size, L'\n'));
+        recordBreaks(data, size, 0, originalBreaks);
+        uint64_t running = 0;
+        recordHashes(data, size, 0, running, originalPrefixHashes);
+        return;
+    }
+
+    struct Block {
+        size_t start;
+        size_t end;
+        std::vector<size_t> breaks;
+        std::vector<uint64_t> hashes;  // Checkpoints of the block's own hash, as if it started the buffer
+        uint64_t endHash;
+    };
+    size_t blockSize = (size / workers / HASH_CHECKPOINT + 1) * HASH_CHECKPOINT;
+    std::vector<Block> blocks(workers);
+    std::vector<std::thread> threads;
+    for (unsigned b = 0; b < workers; ++b) {
+        Block& block = blocks[b];
+        block.start = std::min(size, b * blockSize);
+        block.end = std::min(size, block.start + blockSize);
+        block.endHash = 0;
+        threads.emplace_back([&block, data]() {
+            recordBreaks(data + block.start, block.end - block.start, block.start, block.breaks);
+            recordHashes(data + block.start, block.end - block.start, block.start, block.endHash, block.hashes);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // hash(A + B) = hash(A) * BASE^|B| + hash(B), applied at every checkpoint of B
+    size_t totalBreaks = 0;
+    for (const Block& block : blocks) totalBreaks += block.breaks.size();
+    originalBreaks.reserve(totalBreaks);
+    originalPrefixHashes.reserve(size / HASH_CHECKPOINT + 1);
+    const uint64_t checkpointPow = powMod(HASH_CHECKPOINT);
+    uint64_t startHash = 0;
+    for (const Block& block : blocks) {
+        originalBreaks.insert(originalBreaks.end(), block.breaks.begin(), block.breaks.end());
+        uint64_t pow = checkpointPow;
+        for (uint64_t hash : block.hashes) {
+            originalPrefixHashes.push_back(addMod(mulMod(startHash, pow), hash));
+            pow = mulMod(pow, checkpointPow);
+        }
+        startHash = addMod(mulMod(startHash, powMod(block.end - block.start)), block.endHash);
+    }
+}
+
+TextSnapshot PieceTable::snapshot() const {
+    TextSnapshot snapshot;
+    snapshot.original = originalBuffer;
+    snapshot.mapped = mapped;
+    snapshot.add.assign(addChunks.size(), nullptr);
+    for (size_t i = 0; i < addChunks.size(); ++i) snapshot.add[i] = addChunks[i].text;
+    snapshot.totalLength = length();
+    snapshot.editVersion = editVersion;
+    snapshot.hash = contentHash();
+    collectRuns(root, snapshot.runs);
+    return snapshot;
+}
+
+std::wstring PieceTable::getText() const {
+    return getRange(0, length());
+}
+
+size_t PieceTable::length() const {
+    return root == -1 ? 0 : nodes[root].subLength;
+}
+
+uint64_t PieceTable::version() const {
+    return editVersion;
+}
+
+uint64_t PieceTable::contentHash() const {
+    return root == -1 ? 0 : nodes[root].subHash;
+}
+
+size_t PieceTable::lineCount() const {
+    return (root == -1 ? 0 : nodes[root].subLineBreaks) + 1;
+}
+
+size_t PieceTable::lineStart(size_t line) const {
+    if (line == 0) return 0;
+
+    // Walk down to the piece holding the line-th L'\n'
+    size_t base = 0;
+    size_t remaining = line;
+    int n = root;
+    while (n != -1) {
+        const Node& node = nodes[n];
+        size_t leftBreaks = node.left == -1 ? 0 : nodes[node.left].subLineBreaks;
+        size_t leftLength = node.left == -1 ? 0 : nodes[node.left].subLength;
+
+        if (remaining <= leftBreaks) {
+            n = node.left;
+            continue;
+        }
+        remaining -= leftBreaks;
+        base += leftLength;
+
+        if (remaining <= node.piece.lineBreaks) {
+            return base + (nthBreak(node.piece, remaining) - node.piece.start) + 1;
+        }
+        remaining -= node.piece.lineBreaks;
+        base += node.piece.length;
+        n = node.right;
+    }
+    return length(); // Past the last line
+}
+
+void PieceTable::lineStarts(size_t line, size_t count, std::vector<size_t>& out) const {
+    out.clear();
+    if (line >= lineCount() || count == 0) return;
+    size_t limit = std::min(count, lineCount() - line);
+    size_t from = lineStart(line);
+    out.push_back(from);
+    collectLineStarts(root, 0, from, limit, out);
+}
+
+size_t PieceTable::lineLength(size_t line) const {
+    if (line >= lineCount()) return 0;
+    size_t end = (line + 1 < lineCount()) ? lineStart(line + 1) - 1 : length();
+    return end - lineStart(line);
+}
+
+std::wstring PieceTable::getLine(size_t line) const {
+    if (line >= lineCount()) return L"";
+    size_t start = lineStart(line);
+    size_t end = (line + 1 < lineCount()) ? lineStart(line + 1) - 1 : length();
+    return getRange(start, end - start);
+}
+
+void PieceTable::getLine(size_t line, std::wstring& out) const {
+    out.clear();
+    if (line >= lineCount()) return;
+    size_t start = lineStart(line);
+    size_t end = (line + 1 < lineCount()) ? lineStart(line + 1) - 1 : length();
+    collect(root, 0, start, end, out);
+}
+
+wchar_t PieceTable::charAt(size_t line, size_t col) const {
+    size_t offset = lineStart(line) + col;
+    int n = root;
+    while (n != -1) {
+        const Node& node = nodes[n];
+        size_t leftLength = node.left == -1 ? 0 : nodes[node.left].subLength;
+        if (offset < leftLength) {
+            n = node.left;
+        } else if (offset < leftLength + node.piece.length) {
+            size_t at = node.piece.start + offset - leftLength;
+            if (!node.piece.inAdd && mapped) {
+                size_t block = mapped->blockAt(at);
+                return decodedBlock(block).text[at - mapped->checkpoint(block).offset];
+            }
+            size_t base;
+            return bufferOf(node.piece, base)[at - base];
+        } else {
+            offset -= leftLength + node.piece.length;
+            n = node.right;
+        }
+    }
+    return L'\0';
+}
+
+void PieceTable::insertText(size_t line, size_t col, std::wstring_view text) {
+    if (line >= lineCount() || text.empty()) return;
+    col = std::min(col, lineLength(line));
+    insertAt(lineStart(line) + col, text.data(), text.size());
+}
+
+void PieceTable::insertChar(size_t line, size_t col, wchar_t ch) {
+    if (line >= lineCount()) return;
+    col = std::min(col, lineLength(line));
+    insertAt(lineStart(line) + col, &ch, 1);
+}
+
+void PieceTable::deleteText(size_t line, size_t col, size_t count) {
+    if (line >= lineCount()) return;
+    size_t len = lineLength(line);
+    if (col >= len) return;
+    eraseAt(lineStart(line) + col, std::min(count, len - col));
+}
+
+void PieceTable::splitLine(size_t line, size_t col) {
+    insertText(line, col, L"\n");
+}
+
+void PieceTable::mergeLines(size_t line) {
+    if (line + 1 >= lineCount()) return;
+    eraseAt(lineStart(line + 1) - 1, 1);
+}
+
+void PieceTable::appendLine(const std::wstring& text) {
+    std::wstring line = L"\n" + text;
+    insertAt(length(), line.data(), line.size());
+}
+
+std::wstring PieceTable::getRange(size_t offset, size_t count) const {
+    std::wstring out;
+    getRange(offset, count, out);
+    return out;
+}
+
+void PieceTable::getRange(size_t offset, size_t count, std::wstring& out) const {
+    out.clear();
+    if (offset >= length() || count == 0) return;
+    size_t to = std::min(length(), offset + count);
+    out.reserve(to - offset);
+    collect(root, 0, offset, to, out);
+}
+
+void PieceTable::insertAt(size_t offset, const wchar_t* text, size_t count) {
+    if (count == 0) return;
+    offset = std::min(offset, length());
+
+    growAdd(count);
+    AddChunk& chunk = addChunks.back();
+    size_t addStart = chunk.base + chunk.text->size();
+    size_t breaksBefore = addBreaks.size();
+    chunk.text->append(text, count);
+    recordBreaks(text, count, addStart, addBreaks);
+    recordHashes(text, count, addStart, addRunningHash, addPrefixHashes);
+    Piece piece{true, addStart, count, addBreaks.size() - breaksBefore};
+
+    // Consecutive typing lands right after the previous add piece, so grow it in place
+    if (!extendPieceEndingAt(root, offset, piece)) {
+        int left, right;
+        split(root, offset, left, right);
+        root = merge(merge(left, newNode(piece, nextPriority())), right);
+    }
+    editVersion++;
+}
+
+void PieceTable::reserveInserts(size_t count) {
+    growAdd(count);
+    addPrefixHashes.reserve(addPrefixHashes.size() + count / HASH_CHECKPOINT + 1);
+}
+
+void PieceTable::eraseAt(size_t offset, size_t count) {
+    if (count == 0 || offset >= length()) return;
+    count = std::min(count, length() - offset);
+    if (trimPieceEnd(root, offset, count)) {
+        editVersion++;
+        return;
+    }
+
+    int left, middle, right, rest;
+    split(root, offset, left, rest);
+    split(rest, count, middle, right);
+    freeSubtree(middle);
+    root = merge(left, right);
+    editVersion++;
+}
+
+// Buffer helpers
+
+// Room for count more characters in the last add buffer chunk, with HASH_CHECKPOINT to
+// spare for closing it. A full chunk is closed by padding it to the next checkpoint, so a
+// prefix hash never reads across two chunks and the gap keeps typing from growing a piece
+// over into the next one, and a new chunk is started after it.
+void PieceTable::growAdd(size_t count) {
+    AddChunk& last = addChunks.back();
+    size_t size = last.text->size();
+    if (size + count + HASH_CHECKPOINT <= last.text->capacity()) return;
+    if (size == 0) {
+        last.text->reserve(std::max(count, ADD_CHUNK_CHARS) + HASH_CHECKPOINT); // Nothing reads it yet
+        return;
+    }
+
+    size_t padding = HASH_CHECKPOINT - size % HASH_CHECKPOINT;
+    last.text->append(padding, L'\0');
+    recordHashes(last.text->data() + size, padding, last.base + size, addRunningHash, addPrefixHashes);
+    AddChunk chunk{last.base + size + padding, std::make_shared<std::wstring>()};
+    chunk.text->reserve(std::max(count, ADD_CHUNK_CHARS) + HASH_CHECKPOINT);
+    addChunks.push_back(std::move(chunk));
+}
+
+// Text of the original buffer, or of the add buffer chunk holding piece, which starts at
+// buffer offset base
+const wchar_t* PieceTable::bufferOf(const Piece& piece, size_t& base) const {
+    if (!piece.inAdd) {
+        base = 0;
+        return originalBuffer->data();
+    }
+    auto chunk = std::upper_bound(addChunks.begin(), addChunks.end(), piece.start,
+                                  [](size_t start, const AddChunk& chunk) { return start < chunk.base; }) - 1;
+    base = chunk->base;
+    return chunk->text->data();
+}
+
+const std::vector<size_t>& PieceTable::breaksOf(const Piece& piece) const {
+    return piece.inAdd ? addBreaks : originalBreaks;
+}
+
+size_t PieceTable::countBreaks(bool inAdd, size_t start, size_t length) const {
+    if (!inAdd && mapped) {
+        return mappedBreaksBefore(start + length) - mappedBreaksBefore(start);
+    }
+    const std::vector<size_t>& breaks = inAdd ? addBreaks : originalBreaks;
+    auto first = std::lower_bound(breaks.begin(), breaks.end(), start);
+    auto last = std::lower_bound(first, breaks.end(), start + length);
+    return last - first;
+}
+
+// Buffer position of the n-th (1-based) L'\n' inside the piece
+size_t PieceTable::nthBreak(const Piece& piece, size_t n) const {
+    if (!piece.inAdd && mapped) {
+        size_t index = mappedBreaksBefore(piece.start) + n - 1;
+        size_t block = mapped->blockOfBreak(index);
+        const MappedCheckpoint& at = mapped->checkpoint(block);
+        return at.offset + decodedBlock(block).breaks[index - at.line];
+    }
+    const std::vector<size_t>& breaks = breaksOf(piece);
+    auto first = std::lower_bound(breaks.begin(), breaks.end(), piece.start);
+    return *(first + (n - 1));
+}
+
+PieceTable::Hash PieceTable::rangeHash(const Piece& piece) const {
+    size_t base;
+    const wchar_t* text = bufferOf(piece, base);
+    const std::vector<uint64_t>& prefixes = piece.inAdd ? addPrefixHashes : originalPrefixHashes;
+    auto prefix = [&](size_t at) {
+        return !piece.inAdd && mapped ? mappedPrefixHash(at) : prefixHash(text, base, prefixes, at);
+    };
+    // hash(start, end) = prefix(end) - prefix(start) * BASE^length
+    uint64_t pow = powMod(piece.length);
+    uint64_t end = prefix(piece.start + piece.length);
+    uint64_t start = mulMod(prefix(piece.start), pow);
+    return Hash{end >= start ? end - start : end + HASH_MOD - start, pow};
+}
+
+void PieceTable::setPiece(int n, const Piece& piece) {
+    Hash hash = rangeHash(piece);
+    nodes[n].piece = piece;
+    nodes[n].pieceHash = hash.value;
+    nodes[n].piecePow = hash.pow;
+}
+
+// Mapped original helpers
+
+const PieceTable::DecodedBlock& PieceTable::decodedBlock(size_t block) const {
+    for (const DecodedBlock& decoded : decodedBlocks) {
+        if (decoded.block == block) return decoded;
+    }
+    DecodedBlock& decoded = decodedBlocks[nextDecoded];
+    nextDecoded = (nextDecoded + 1) % DECODED_BLOCKS;
+    decoded.block = block;
+    mapped->decode(block, block + 1, decoded.text);
+    decoded.breaks.clear();
+    recordBreaks(decoded.text.data(), decoded.text.size(), 0, decoded.breaks);
+    return decoded;
+}
+
+size_t PieceTable::mappedBreaksBefore(size_t offset) const {
+    if (offset >= mapped->length()) return mapped->lineBreaks();
+    size_t block = mapped->blockAt(offset);
+    const MappedCheckpoint& at = mapped->checkpoint(block);
+    const std::vector<size_t>& breaks = decodedBlock(block).breaks;
+    return at.line + (std::lower_bound(breaks.begin(), breaks.end(), offset - at.offset) - breaks.begin());
+}
+
+// Every checkpoint carries the hash of the text before it, so this hashes at most a block
+uint64_t PieceTable::mappedPrefixHash(size_t end) const {
+    if (end >= mapped->length()) return mapped->hash();
+    size_t block = mapped->blockAt(end);
+    const MappedCheckpoint& at = mapped->checkpoint(block);
+    if (end == at.offset) return at.hash;
+    return extendHash(at.hash, decodedBlock(block).text.data(), end - at.offset);
+}
+
+void PieceTable::appendMapped(size_t from, size_t to, std::wstring& out) const {
+    while (from < to) {
+        size_t block = mapped->blockAt(from);
+        size_t blockStart = mapped->checkpoint(block).offset;
+        const std::wstring& text = decodedBlock(block).text;
+        size_t count = std::min(to, blockStart + text.size()) - from;
+        out.append(text, from - blockStart, count);
+        from += count;
+    }
+}
+
+// Treap helpers
+
+int PieceTable::newNode(const Piece& piece, uint32_t priority) {
+    int n;
+    if (!freeNodes.empty()) {
+        n = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        n = (int)nodes.size();
+        nodes.emplace_back();
+    }
+    nodes[n] = Node{piece, priority, -1, -1, 0, 1, 0, 0, 0, 1};
+    setPiece(n, piece);
+    pull(n);
+    return n;
+}
+
+void PieceTable::freeSubtree(int n) {
+    if (n == -1) return;
+    freeSubtree(nodes[n].left);
+    freeSubtree(nodes[n].right);
+    freeNodes.push_back(n);
+}
+
+void PieceTable::pull(int n) {
+    Node& node = nodes[n];
+    node.subLength = node.piece.length;
+    node.subLineBreaks = node.piece.lineBreaks;
+    node.subHash = node.pieceHash;
+    node.subPow = node.piecePow;
+    if (node.left != -1) {
+        const Node& left = nodes[node.left];
+        node.subLength += left.subLength;
+        node.subLineBreaks += left.subLineBreaks;
+        // hash(AB) = hash(A) * BASE^|B| + hash(B)
+        node.subHash = addMod(mulMod(left.subHash, node.piecePow), node.pieceHash);
+        node.subPow = mulMod(left.subPow, node.piecePow);
+    }
+    if (node.right != -1) {
+        const Node& right = nodes[node.right];
+        node.subLength += right.subLength;
+        node.subLineBreaks += right.subLineBreaks;
+        node.subHash = addMod(mulMod(node.subHash, right.subPow), right.subHash);
+        node.subPow = mulMod(node.subPow, right.subPow);
+    }
+}
+
+int PieceTable::merge(int a, int b) {
+    if (a == -1) return b;
+    if (b == -1) return a;
+    if (nodes[a].priority > nodes[b].priority) {
+        int merged = merge(nodes[a].right, b);
+        nodes[a].right = merged;
+        pull(a);
+        return a;
+    }
+    int merged = merge(a, nodes[b].left);
+    nodes[b].left = merged;
+    pull(b);
+    return b;
+}
+
+// Splits so that left holds exactly the first offset characters, cutting a piece in two if needed
+void PieceTable::split(int n, size_t offset, int& left, int& right) {
+    if (n == -1) {
+        left = right = -1;
+        return;
+    }
+    size_t leftLength = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].subLength;
+    size_t pieceLength = nodes[n].piece.length;
+
+    if (offset <= leftLength) {
+        int a, b;
+        split(nodes[n].left, offset, a, b);
+        nodes[n].left = b;
+        pull(n);
+        left = a;
+        right = n;
+    } else if (offset >= leftLength + pieceLength) {
+        int a, b;
+        split(nodes[n].right, offset - leftLength - pieceLength, a, b);
+        nodes[n].right = a;
+        pull(n);
+        left = n;
+        right = b;
+    } else {
+        size_t cut = offset - leftLength;
+        Piece head = nodes[n].piece;
+        Piece tail = head;
+        head.length = cut;
+        head.lineBreaks = countBreaks(head.inAdd, head.start, head.length);
+        tail.start += cut;
+        tail.length -= cut;
+        tail.lineBreaks -= head.lineBreaks;
+
+        // The tail inherits the priority, so it can sit above n's old right subtree
+        int m = newNode(tail, nodes[n].priority);
+        setPiece(n, head);
+        nodes[m].right = nodes[n].right;
+        nodes[n].right = -1;
+        pull(n);
+        pull(m);
+        left = n;
+        right = m;
+    }
+}
+
+// Grows the piece that ends at offset by piece, when piece continues it in the add buffer,
+// and refreshes the subtree caches on the way back up
+bool PieceTable::extendPieceEndingAt(int n, size_t offset, const Piece& piece) {
+    if (n == -1 || offset == 0) return false;
+    size_t leftLength = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].subLength;
+    size_t pieceEnd = leftLength + nodes[n].piece.length;
+    if (offset <= leftLength) {
+        if (!extendPieceEndingAt(nodes[n].left, offset, piece)) return false;
+    } else if (offset > pieceEnd) {
+        if (!extendPieceEndingAt(nodes[n].right, offset - pieceEnd, piece)) return false;
+    } else {
+        Piece grown = nodes[n].piece;
+        if (offset != pieceEnd || !grown.inAdd || grown.start + grown.length != piece.start) return false;
+        grown.length += piece.length;
+        grown.lineBreaks += piece.lineBreaks;
+        setPiece(n, grown);
+    }
+    pull(n);
+    return true;
+}
+
+// Cuts [offset, offset + count) off a piece when it is that piece's head or tail, leaving
+// at least one character so the node stays
+bool PieceTable::trimPieceEnd(int n, size_t offset, size_t count) {
+    if (n == -1) return false;
+    size_t leftLength = nodes[n].left == -1 ? 0 : nodes[nodes[n].left].subLength;
+    size_t pieceEnd = leftLength + nodes[n].piece.length;
+    if (offset + count <= leftLength) {
+        if (!trimPieceEnd(nodes[n].left, offset, count)) return false;
+    } else if (offset >= pieceEnd) {
+        if (!trimPieceEnd(nodes[n].right, offset - pieceEnd, count)) return false;
+    } else {
+        Piece trimmed = nodes[n].piece;
+        if (offset < leftLength || offset + count > pieceEnd || count >= trimmed.length) return false;
+        size_t cut = offset - leftLength;
+        if (cut != 0 && cut + count != trimmed.length) return false;
+        trimmed.lineBreaks -= countBreaks(trimmed.inAdd, trimmed.start + cut, count);
+        if (cut == 0) trimmed.start += count;
+        trimmed.length -= count;
+        setPiece(n, trimmed);
+    }
+    pull(n);
+    return true;
+}
+
+void PieceTable::collectRuns(int n, std::vector<TextSnapshot::Run>& runs) const {
+    if (n == -1) return;
+    collectRuns(nodes[n].left, runs);
+    const Piece& piece = nodes[n].piece;
+    size_t base;
+    const wchar_t* text = !piece.inAdd && mapped ? nullptr : bufferOf(piece, base) + (piece.start - base);
+    runs.push_back(TextSnapshot::Run{text, piece.start, piece.length});
+    collectRuns(nodes[n].right, runs);
+}
+
+// Appends the offset after every L'\n' at or past from, until out holds limit offsets
+void PieceTable::collectLineStarts(int n, size_t base, size_t from, size_t limit, std::vector<size_t>& out) const {
+    if (n == -1 || out.size() >= limit) return;
+    const Node& node = nodes[n];
+    if (from >= base + node.subLength) return;
+
+    collectLineStarts(node.left, base, from, limit, out);
+    size_t pieceBase = base + (node.left == -1 ? 0 : nodes[node.left].subLength);
+    const Piece& piece = node.piece;
+    if (out.size() < limit && from < pieceBase + piece.length && piece.lineBreaks > 0) {
+        size_t skip = from > pieceBase ? from - pieceBase : 0;
+        if (!piece.inAdd && mapped) {
+            size_t k = countBreaks(false, piece.start, skip) + 1;
+            for (; k <= piece.lineBreaks && out.size() < limit; ++k) {
+                out.push_back(pieceBase + (nthBreak(piece, k) - piece.start) + 1);
+            }
+        } else {
+            const std::vector<size_t>& breaks = breaksOf(piece);
+            auto at = std::lower_bound(breaks.begin(), breaks.end(), piece.start + skip);
+            for (; at != breaks.end() && *at < piece.start + piece.length && out.size() < limit; ++at) {
+                out.push_back(pieceBase + (*at - piece.start) + 1);
+            }
+        }
+    }
+    collectLineStarts(node.right, pieceBase + piece.length, from, limit, out);
+}
+
+void PieceTable::collect(int n, size_t base, size_t from, size_t to, std::wstring& out) const {
+    if (n == -1) return;
+    const Node& node = nodes[n];
+    if (to <= base || from >= base + node.subLength) return;
+
+    collect(node.left, base, from, to, out);
+    size_t pieceBase = base + (node.left == -1 ? 0 : nodes[node.left].subLength);
+    size_t first = std::max(from, pieceBase);
+    size_t last = std::min(to, pieceBase + node.piece.length);
+    if (first < last && !node.piece.inAdd && mapped) {
+        appendMapped(node.piece.start + (first - pieceBase), node.piece.start + (last - pieceBase), out);
+    } else if (first < last) {
+        size_t base;
+        out.append(bufferOf(node.piece, base) + (node.piece.start - base) + (first - pieceBase), last - first);
+    }
+    collect(node.right, pieceBase + node.piece.length, from, to, out);
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "mappedText.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only copy of the document for other threads (background save, search).
+// Shares both buffers and copies only the piece order, so taking one costs O(pieces)
+// rather than O(text). Text in the add buffer never moves once written, so later edits
+// never touch what it reads. A mapped original is decoded a few blocks at a time as
+// the runs are read.
+class TextSnapshot {
+public:
+    size_t length() const { return totalLength; }
+    uint64_t version() const { return editVersion; }
+    uint64_t contentHash() const { return hash; }
+
+    // Calls sink(const wchar_t* text, size_t count) for each run of text in document order
+    template <typename Sink>
+    void forEachRun(Sink sink) const {
+        for (const Run& run : runs) {
+            if (!run.text) {
+                mapped->forEachSpan(run.start, run.length, sink);
+            } else {
+                sink(run.text, run.length);
+            }
+        }
+    }
+
+    // Calls sink(const wchar_t* text, size_t start, size_t count) for each piece in document
+    // order, with text null for a piece still in the mapped file at start
+    template <typename Sink>
+    void forEachPiece(Sink sink) const {
+        for (const Run& run : runs) {
+            sink(run.text, run.start, run.length);
+        }
+    }
+
+    const MappedText* mappedOriginal() const { return mapped.get(); } // Null unless the file is read in place
+
+private:
+    friend class PieceTable;
+    struct Run {
+        const wchar_t* text; // Null while it is still in the mapped file
+        size_t start;        // In the buffer the piece points into
+        size_t length;
+    };
+    std::shared_ptr<const std::wstring> original;
+    std::shared_ptr<const MappedText> mapped;
+    std::vector<std::shared_ptr<const std::wstring>> add; // Keeps the runs' add buffer chunks alive
+    std::vector<Run> runs;
+    size_t totalLength = 0;
+    uint64_t editVersion = 0;
+    uint64_t hash = 0;
+};
+
+// Piece-table document model.
+// The text lives in two buffers: the original buffer (read-only, filled on load)
+// and the add buffer (append-only, filled by edits, in chunks so its text never moves).
+// The document is the in-order concatenation of the pieces stored in a treap. Every
+// node caches the length and line-break count of its subtree, so finding a line or
+// splicing text is O(log n) instead of shifting every later line like the old
+// std::vector<std::wstring>.
+// A large file can be the original buffer where it lies (loadMapped), in which case
+// its pieces are read through the file's checkpoints instead of originalBreaks.
+class PieceTable {
+public:
+    PieceTable();
+    PieceTable(const PieceTable&) = delete; // Snapshots share the add buffer it appends to
+    PieceTable& operator=(const PieceTable&) = delete;
+
+    // Whole document
+    void clear();                      // Back to a single empty line
+    void load(std::wstring text);      // Replace contents, text becomes the original buffer
+    void loadMapped(std::shared_ptr<const MappedText> text); // Or the file it is read from in place
+    void mappedGrew();                 // More of the mapped text is indexed, nothing edited yet
+    const MappedText* mappedOriginal() const; // Null unless the original is read in place
+    std::wstring getText() const;
+    TextSnapshot snapshot() const;
+    size_t length() const;             // Characters, including the L'\n' between lines
+
+    // Line-oriented accessors (lines never contain the L'\n')
+    size_t lineCount() const;
+    std::wstring getLine(size_t line) const;
+    void getLine(size_t line, std::wstring& out) const; // Reuses out's storage
+    size_t lineLength(size_t line) const;
+    size_t lineStart(size_t line) const;  // Document offset of the first char of line
+    // lineStart of count lines from line on, fewer past the end, in one walk of the pieces
+    void lineStarts(size_t line, size_t count, std::vector<size_t>& out) const;
+    wchar_t charAt(size_t line, size_t col) const;
+
+    // Line-oriented editing, col is clamped to the line length
+    void insertText(size_t line, size_t col, std::wstring_view text);
+    void insertChar(size_t line, size_t col, wchar_t ch);   // Typing, nothing to build a string for
+    void deleteText(size_t line, size_t col, size_t count); // Never crosses a line break
+    void splitLine(size_t line, size_t col);
+    void mergeLines(size_t line);                            // Joins line and line + 1
+    void appendLine(const std::wstring& text = L"");
+
+    // Offset-based access. An edit at either end of a piece, which is where typing and
+    // backspace land, grows or shrinks that piece in place without splitting the tree.
+    std::wstring getRange(size_t offset, size_t count) const;
+    void getRange(size_t offset, size_t count, std::wstring& out) const; // Reuses out's storage
+    void insertAt(size_t offset, const wchar_t* text, size_t count);
+    void eraseAt(size_t offset, size_t count);
+    // Room for count more inserted characters, so a bulk edit made of many large inserts
+    // lands in one add buffer chunk rather than starting a new one every megabyte
+    void reserveInserts(size_t count);
+
+    // Change tracking, both O(1)
+    uint64_t version() const;      // Bumped by every mutation
+    uint64_t contentHash() const;  // Rolling hash of the whole text, equal texts give equal hashes
+
+private:
+    struct Piece {
+        bool inAdd;         // Which buffer the piece points into
+        size_t start;
+        size_t length;
+        size_t lineBreaks;  // Number of L'\n' inside the piece
+    };
+
+    struct Node {
+        Piece piece;
+        uint32_t priority;
+        int left;
+        int right;
+        uint64_t pieceHash;    // Rolling hash of the piece text and HASH_BASE^length
+        uint64_t piecePow;
+        size_t subLength;      // Cached over the whole subtree
+        size_t subLineBreaks;
+        uint64_t subHash;
+        uint64_t subPow;
+    };
+
+    struct Hash {
+        uint64_t value;
+        uint64_t pow;
+    };
+
+    // Recently read blocks of a mapped original, with the positions of their L'\n'
+    struct DecodedBlock {
+        size_t block;
+        std::wstring text;
+        std::vector<size_t> breaks;
+    };
+
+    std::shared_ptr<const std::wstring> originalBuffer; // Shared with snapshots
+    std::shared_ptr<const MappedText> mapped;  // Stands in for originalBuffer and its indexes when set
+    mutable std::vector<DecodedBlock> decodedBlocks;
+    mutable size_t nextDecoded;
+    std::vector<size_t> originalBreaks;  // Positions of L'\n' in originalBuffer
+    std::vector<uint64_t> originalPrefixHashes; // Hash of originalBuffer[0, 64 * i)
+    // The add buffer, chunk by chunk. A chunk is never appended to past the capacity it was
+    // made with, so neither a snapshot sharing it nor growing the buffer copies its text.
+    struct AddChunk {
+        size_t base;  // Add buffer offset of its first char
+        std::shared_ptr<std::wstring> text;
+    };
+    std::vector<AddChunk> addChunks;
+    std::vector<size_t> addBreaks;       // Positions of L'\n' in the add buffer
+    std::vector<uint64_t> addPrefixHashes;
+    uint64_t addRunningHash;             // Hash of the whole add buffer
+    uint64_t editVersion;
+
+    std::vector<Node> nodes;   // Node pool, indices instead of pointers
+    std::vector<int> freeNodes;
+    int root;
+
+    void indexOriginal();
+    void growAdd(size_t count);
+    const DecodedBlock& decodedBlock(size_t block) const;
+    size_t mappedBreaksBefore(size_t offset) const;
+    uint64_t mappedPrefixHash(size_t end) const;
+    void appendMapped(size_t from, size_t to, std::wstring& out) const;
+    const wchar_t* bufferOf(const Piece& piece, size_t& base) const;
+    const std::vector<size_t>& breaksOf(const Piece& piece) const;
+    size_t countBreaks(bool inAdd, size_t start, size_t length) const;
+    size_t nthBreak(const Piece& piece, size_t n) const;
+    Hash rangeHash(const Piece& piece) const;
+    void setPiece(int n, const Piece& piece);
+
+    int newNode(const Piece& piece, uint32_t priority);
+    void freeSubtree(int n);
+    void pull(int n);
+    int merge(int a, int b);
+    void split(int n, size_t offset, int& left, int& right);
+    bool extendPieceEndingAt(int n, size_t offset, const Piece& piece);
+    bool trimPieceEnd(int n, size_t offset, size_t count);
+    void collectRuns(int n, std::vector<TextSnapshot::Run>& runs) const;
+    void collect(int n, size_t base, size_t from, size_t to, std::wstring& out) const;
+    void collectLineStarts(int n, size_t base, size_t from, size_t limit, std::vector<size_t>& out) const;
+};
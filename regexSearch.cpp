@@ -0,0 +1,675 @@
+#include "regexSearch.h"
+#include "charScan.h" // For FoldCase
+
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <map>
+
+namespace {
+    typedef std::vector<std::pair<wchar_t, wchar_t>> CharRanges; // Inclusive, over UTF-16 units
+
+    const wchar_t MAX_UNIT = 0xFFFF;
+    const int MAX_REPEAT = 1000;
+    const size_t MAX_NFA_STATES = 20000;
+    // Each DFA's cache is thrown away and refilled from the current state when it outgrows this
+    const size_t DFA_CACHE_BYTES = 4 * 1024 * 1024;
+
+    struct RegexNode {
+        enum Kind { EMPTY, SET, CONCAT, ALT, STAR, PLUS, QUEST, BOL, EOL } kind;
+        CharRanges ranges;
+        std::vector<RegexNode> children;
+    };
+
+    size_t nodeCount(const RegexNode& n) {
+        size_t count = 1;
+        for (const RegexNode& child : n.children) count += nodeCount(child);
+        return count;
+    }
+
+    class RegexParser {
+    public:
+        RegexParser(const std::wstring& pattern, bool ignoreCase) : pattern(pattern), ignoreCase(ignoreCase) {}
+
+        bool parse(RegexNode& root, std::wstring& error) {
+            root = alternation();
+            if (this->error.empty() && pos < pattern.length()) {
+                this->error = L"Unmatched )";
+            }
+            error = this->error;
+            return error.empty();
+        }
+
+    private:
+        const std::wstring& pattern;
+        bool ignoreCase;
+        size_t pos = 0;
+        std::wstring error;
+
+        bool more() const { return error.empty() && pos < pattern.length(); }
+
+        RegexNode alternation() {
+            RegexNode first = concatenation();
+            if (!more() || pattern[pos] != L'|') return first;
+            RegexNode alt{RegexNode::ALT};
+            alt.children.push_back(std::move(first));
+            while (more() && pattern[pos] == L'|') {
+                pos++;
+                alt.children.push_back(concatenation());
+            }
+            return alt;
+        }
+
+        RegexNode concatenation() {
+            RegexNode concat{RegexNode::CONCAT};
+            while (more() && pattern[pos] != L'|' && pattern[pos] != L')') {
+                concat.children.push_back(repetition());
+            }
+            if (concat.children.size() == 1) return std::move(concat.children[0]);
+            return concat;
+        }
+
+        bool number(int& value) {
+            size_t start = pos;
+            value = 0;
+            while (pos < pattern.length() && iswdigit(pattern[pos]) && value <= MAX_REPEAT) {
+                value = value * 10 + (pattern[pos++] - L'0');
+            }
+            return pos > start;
+        }
+
+        RegexNode repetition() {
+            RegexNode node = atom();
+            while (more()) {
+                wchar_t op = pattern[pos];
+                RegexNode::Kind kind;
+                if (op == L'*') kind = RegexNode::STAR;
+                else if (op == L'+') kind = RegexNode::PLUS;
+                else if (op == L'?') kind = RegexNode::QUEST;
+                else if (op == L'{') {
+                    node = counted(std::move(node));
+                    continue;
+                } else break;
+                pos++;
+                RegexNode wrapped{kind};
+                wrapped.children.push_back(std::move(node));
+                node = std::move(wrapped);
+            }
+            return node;
+        }
+
+        // x{m,n} becomes m copies of x followed by n - m optional ones, x{m,} ends in x*
+        RegexNode counted(RegexNode node) {
+            pos++;
+            int low, high;
+            if (!number(low)) {
+                error = L"Expected a count after {";
+                return node;
+            }
+            high = low;
+            bool unbounded = false;
+            if (pos < pattern.length() && pattern[pos] == L',') {
+                pos++;
+                if (!number(high)) {
+                    high = low;
+                    unbounded = true;
+                }
+            }
+            if (pos >= pattern.length() || pattern[pos] != L'}') {
+                error = L"Unterminated {";
+                return node;
+            }
+            pos++;
+            if (low > MAX_REPEAT || high > MAX_REPEAT || high < low) {
+                error = L"Bad repeat count";
+                return node;
+            }
+            if (nodeCount(node) * (size_t)std::max(low, high + 1) > MAX_NFA_STATES) {
+                error = L"Pattern is too large";
+                return node;
+            }
+
+            RegexNode concat{RegexNode::CONCAT};
+            for (int i = 0; i < low; ++i) concat.children.push_back(node);
+            if (unbounded) {
+                RegexNode star{RegexNode::STAR};
+                star.children.push_back(node);
+                concat.children.push_back(std::move(star));
+            }
+            for (int i = low; i < high; ++i) {
+                RegexNode quest{RegexNode::QUEST};
+                quest.children.push_back(node);
+                concat.children.push_back(std::move(quest));
+            }
+            return concat;
+        }
+
+        static RegexNode set(CharRanges ranges) {
+            RegexNode node{RegexNode::SET};
+            node.ranges = std::move(ranges);
+            return node;
+        }
+
+        // Ignoring case, a literal or [...] set also takes every unit that folds the same as one
+        // of its own. Shorthands and . are left alone, and [^...] is complemented after this.
+        CharRanges caseless(CharRanges ranges) const {
+            if (!ignoreCase) return ranges;
+            std::vector<bool> folded(MAX_UNIT + 1, false);
+            for (const auto& [lo, hi] : ranges) {
+                for (unsigned unit = lo; unit <= hi; ++unit) folded[(uint16_t)FoldCase((wchar_t)unit)] = true;
+            }
+            CharRanges result;
+            for (unsigned unit = 0; unit <= MAX_UNIT; ++unit) {
+                if (!folded[(uint16_t)FoldCase((wchar_t)unit)]) continue;
+                if (!result.empty() && (unsigned)result.back().second + 1 == unit) {
+                    result.back().second = (wchar_t)unit;
+                } else {
+                    result.emplace_back((wchar_t)unit, (wchar_t)unit);
+                }
+            }
+            return result;
+        }
+
+        static CharRanges complement(CharRanges ranges) {
+            std::sort(ranges.begin(), ranges.end());
+            CharRanges result;
+            unsigned next = 0;
+            for (const auto& [lo, hi] : ranges) {
+                if (lo > next) result.emplace_back((wchar_t)next, (wchar_t)(lo - 1));
+                next = std::max(next, (unsigned)hi + 1);
+            }
+            if (next <= MAX_UNIT) result.emplace_back((wchar_t)next, MAX_UNIT);
+            return result;
+        }
+
+        // Class shorthands, or an empty list when ch is an ordinary escaped character
+        static CharRanges shorthand(wchar_t ch) {
+            CharRanges digits = {{L'0', L'9'}};
+            CharRanges word = {{L'0', L'9'}, {L'A', L'Z'}, {L'_', L'_'}, {L'a', L'z'}};
+            CharRanges space = {{L'\t', L'\r'}, {L' ', L' '}};
+            switch (ch) {
+                case L'd': return digits;
+                case L'D': return complement(digits);
+                case L'w': return word;
+                case L'W': return complement(word);
+                case L's': return space;
+                case L'S': return complement(space);
+            }
+            return CharRanges();
+        }
+
+        static wchar_t escapedChar(wchar_t ch) {
+            switch (ch) {
+                case L't': return L'\t';
+                case L'n': return L'\n';
+                case L'r': return L'\r';
+            }
+            return ch;
+        }
+
+        RegexNode atom() {
+            wchar_t ch = pattern[pos++];
+            switch (ch) {
+                case L'(': {
+                    if (pos < pattern.length() && pattern[pos] == L')') {
+                        pos++;
+                        return RegexNode{RegexNode::EMPTY};
+                    }
+                    RegexNode inner = alternation();
+                    if (error.empty() && (pos >= pattern.length() || pattern[pos] != L')')) {
+                        error = L"Unmatched (";
+                    }
+                    pos++;
+                    return inner;
+                }
+                case L'[': return bracket();
+                case L'.': return set({{0, MAX_UNIT}});
+                case L'^': return RegexNode{RegexNode::BOL};
+                case L'$': return RegexNode{RegexNode::EOL};
+                case L'*': case L'+': case L'?': case L'{':
+                    error = L"Nothing to repeat";
+                    return RegexNode{RegexNode::EMPTY};
+                case L'\\': {
+                    if (pos >= pattern.length()) {
+                        error = L"Trailing \\";
+                        return RegexNode{RegexNode::EMPTY};
+                    }
+                    wchar_t escaped = pattern[pos++];
+                    CharRanges ranges = shorthand(escaped);
+                    if (!ranges.empty()) return set(std::move(ranges));
+                    escaped = escapedChar(escaped);
+                    return set(caseless({{escaped, escaped}}));
+                }
+            }
+            return set(caseless({{ch, ch}}));
+        }
+
+        RegexNode bracket() {
+            bool negate = pos < pattern.length() && pattern[pos] == L'^';
+            if (negate) pos++;
+            CharRanges ranges;
+            bool first = true;
+            while (pos < pattern.length() && (pattern[pos] != L']' || first)) {
+                first = false;
+                wchar_t lo = pattern[pos++];
+                if (lo == L'\\' && pos < pattern.length()) {
+                    CharRanges named = shorthand(pattern[pos]);
+                    if (!named.empty()) {
+                        pos++;
+                        ranges.insert(ranges.end(), named.begin(), named.end());
+                        continue;
+                    }
+                    lo = escapedChar(pattern[pos++]);
+                }
+                wchar_t hi = lo;
+                if (pos + 1 < pattern.length() && pattern[pos] == L'-' && pattern[pos + 1] != L']') {
+                    pos++;
+                    hi = pattern[pos++];
+                    if (hi == L'\\' && pos < pattern.length()) hi = escapedChar(pattern[pos++]);
+                    if (hi < lo) {
+                        error = L"Bad range in []";
+                        return RegexNode{RegexNode::EMPTY};
+                    }
+                }
+                ranges.emplace_back(lo, hi);
+            }
+            if (pos >= pattern.length()) {
+                error = L"Unterminated [";
+                return RegexNode{RegexNode::EMPTY};
+            }
+            pos++;
+            ranges = caseless(std::move(ranges));
+            return set(negate ? complement(std::move(ranges)) : std::move(ranges));
+        }
+    };
+
+    struct NfaState {
+        enum Kind { SET, SPLIT, BOL, EOL, MATCH } kind;
+        int out = -1;
+        int out1 = -1;            // SPLIT only
+        std::vector<bool> accepts; // SET only, indexed by character class
+    };
+
+    struct Nfa {
+        std::vector<NfaState> states;
+        int start = 0;
+    };
+}
+
+struct RegexProgram {
+    Nfa forward;
+    Nfa reverse;                   // Matches the reversed text, so starts can be found scanning backwards
+    std::vector<uint16_t> classOf; // Units no pattern set tells apart share a class
+    int classCount = 0;
+};
+
+namespace {
+    // Thompson construction, built back to front: each node is given the state it continues
+    // to and returns its own entry state. Reversed, concatenations run the other way and the
+    // line anchors swap.
+    class NfaBuilder {
+    public:
+        NfaBuilder(Nfa& nfa, const RegexProgram& program, bool reversed)
+            : nfa(nfa), program(program), reversed(reversed) {}
+
+        bool build(const RegexNode& root) {
+            int match = add(NfaState::MATCH);
+            nfa.start = node(root, match);
+            return nfa.states.size() <= MAX_NFA_STATES;
+        }
+
+    private:
+        Nfa& nfa;
+        const RegexProgram& program;
+        bool reversed;
+
+        int add(NfaState::Kind kind, int out = -1, int out1 = -1) {
+            nfa.states.push_back(NfaState{kind, out, out1});
+            return (int)nfa.states.size() - 1;
+        }
+
+        int node(const RegexNode& n, int next) {
+            if (nfa.states.size() > MAX_NFA_STATES) return next;
+            switch (n.kind) {
+                case RegexNode::EMPTY:
+                    return next;
+                case RegexNode::SET: {
+                    int state = add(NfaState::SET, next);
+                    std::vector<bool> accepts(program.classCount, false);
+                    for (const auto& [lo, hi] : n.ranges) {
+                        for (int c = program.classOf[lo]; c <= program.classOf[hi]; ++c) accepts[c] = true;
+                    }
+                    nfa.states[state].accepts = std::move(accepts);
+                    return state;
+                }
+                case RegexNode::CONCAT:
+                    if (reversed) {
+                        for (const RegexNode& child : n.children) next = node(child, next);
+                    } else {
+                        for (auto it = n.children.rbegin(); it != n.children.rend(); ++it) next = node(*it, next);
+                    }
+                    return next;
+                case RegexNode::ALT: {
+                    int entry = node(n.children.back(), next);
+                    for (size_t i = n.children.size() - 1; i-- > 0;) {
+                        entry = add(NfaState::SPLIT, node(n.children[i], next), entry);
+                    }
+                    return entry;
+                }
+                case RegexNode::QUEST:
+                    return add(NfaState::SPLIT, node(n.children[0], next), next);
+                case RegexNode::STAR: {
+                    int loop = add(NfaState::SPLIT, -1, next);
+                    int body = node(n.children[0], loop);
+                    nfa.states[loop].out = body;
+                    return loop;
+                }
+                case RegexNode::PLUS: {
+                    int loop = add(NfaState::SPLIT, -1, next);
+                    int body = node(n.children[0], loop);
+                    nfa.states[loop].out = body;
+                    return body;
+                }
+                case RegexNode::BOL:
+                    return add(reversed ? NfaState::EOL : NfaState::BOL, next);
+                case RegexNode::EOL:
+                    return add(reversed ? NfaState::BOL : NfaState::EOL, next);
+            }
+            return next;
+        }
+    };
+
+    void collectRanges(const RegexNode& n, std::vector<bool>& boundary) {
+        for (const auto& [lo, hi] : n.ranges) {
+            boundary[lo] = true;
+            if (hi < MAX_UNIT) boundary[hi + 1] = true;
+        }
+        for (const RegexNode& child : n.children) collectRanges(child, boundary);
+    }
+
+    // Subset construction done on demand. A state is the sorted set of NFA states it stands
+    // for: consuming states, MATCH, and pending EOL assertions that only resolve at the line end.
+    class LazyDfa {
+    public:
+        LazyDfa(const Nfa& nfa, const RegexProgram& program, bool unanchored)
+            : nfa(nfa), program(program), unanchored(unanchored), visited(nfa.states.size(), 0) {}
+
+        // Unanchored, the start state holds no threads yet; the pattern's start is entered
+        // on every step instead, so only matches of at least one unit are ever reported
+        int start(bool atLineStart) {
+            int& cached = startState[atLineStart];
+            if (cached < 0) {
+                std::vector<int> set;
+                if (!unanchored) closure({nfa.start}, atLineStart, false, set);
+                cached = intern(std::move(set), atLineStart);
+            }
+            return cached;
+        }
+
+        int step(int state, wchar_t ch) {
+            int cls = program.classOf[(uint16_t)ch];
+            int next = states[state].next[cls];
+            return next >= 0 ? next : computeStep(state, cls);
+        }
+
+        bool matches(int state) const { return states[state].match; }
+        bool matchesAtEnd(int state) const { return states[state].matchAtEnd; }
+        bool dead(int state) const { return states[state].nfa.empty(); }
+        // Changes whenever the cache is thrown away and state numbers are reused
+        unsigned flushes() const { return flushCount; }
+
+    private:
+        struct State {
+            std::vector<int> nfa;
+            bool lineStart;
+            bool match;
+            bool matchAtEnd;
+            std::vector<int> next; // Per character class, -1 until computed
+        };
+
+        const Nfa& nfa;
+        const RegexProgram& program;
+        bool unanchored; // The start state is re-entered at every position
+        std::vector<State> states;
+        std::map<std::pair<bool, std::vector<int>>, int> index;
+        size_t cacheBytes = 0;
+        int startState[2] = {-1, -1};
+        std::vector<int> entry[2]; // Unanchored, the closure of the pattern's start, by lineStart
+        bool entryDone[2] = {false, false};
+        unsigned flushCount = 0;
+        std::vector<uint32_t> visited;
+        uint32_t visitMark = 0;
+
+        // Follows SPLIT edges, BOL only at the line start and EOL only at its end
+        void closure(const std::vector<int>& from, bool atLineStart, bool atLineEnd, std::vector<int>& set) {
+            if (++visitMark == 0) {
+                std::fill(visited.begin(), visited.end(), 0);
+                visitMark = 1;
+            }
+            std::vector<int> stack(from.rbegin(), from.rend());
+            while (!stack.empty()) {
+                int id = stack.back();
+                stack.pop_back();
+                if (visited[id] == visitMark) continue;
+                visited[id] = visitMark;
+                const NfaState& s = nfa.states[id];
+                switch (s.kind) {
+                    case NfaState::SPLIT:
+                        stack.push_back(s.out1);
+                        stack.push_back(s.out);
+                        break;
+                    case NfaState::BOL:
+                        if (atLineStart) stack.push_back(s.out);
+                        break;
+                    case NfaState::EOL:
+                        if (atLineEnd) stack.push_back(s.out);
+                        else set.push_back(id);
+                        break;
+                    default:
+                        set.push_back(id);
+                }
+            }
+            std::sort(set.begin(), set.end());
+        }
+
+        int intern(std::vector<int> set, bool lineStart) {
+            auto key = std::make_pair(lineStart, set);
+            auto found = index.find(key);
+            if (found != index.end()) return found->second;
+
+            State state{std::move(set), lineStart, false, false, std::vector<int>(program.classCount, -1)};
+            std::vector<int> atEnd;
+            closure(state.nfa, lineStart, true, atEnd);
+            for (int id : state.nfa) {
+                if (nfa.states[id].kind == NfaState::MATCH) state.match = true;
+            }
+            for (int id : atEnd) {
+                if (nfa.states[id].kind == NfaState::MATCH) state.matchAtEnd = true;
+            }
+            cacheBytes += sizeof(State) + (state.nfa.size() * 2 + program.classCount) * sizeof(int);
+            states.push_back(std::move(state));
+            index.emplace(std::move(key), (int)states.size() - 1);
+            return (int)states.size() - 1;
+        }
+
+        int computeStep(int state, int cls) {
+            std::vector<int> moved;
+            for (int id : states[state].nfa) {
+                const NfaState& s = nfa.states[id];
+                if (s.kind == NfaState::SET && s.accepts[cls]) moved.push_back(s.out);
+            }
+            if (unanchored) {
+                bool lineStart = states[state].lineStart;
+                if (!entryDone[lineStart]) {
+                    closure({nfa.start}, lineStart, false, entry[lineStart]);
+                    entryDone[lineStart] = true;
+                }
+                for (int id : entry[lineStart]) {
+                    const NfaState& s = nfa.states[id];
+                    if (s.kind == NfaState::SET && s.accepts[cls]) moved.push_back(s.out);
+                }
+            }
+            std::vector<int> set;
+            closure(moved, false, false, set);
+
+            // Only the state being stepped from is held by the caller, the rest can go
+            if (cacheBytes > DFA_CACHE_BYTES) {
+                states.clear();
+                index.clear();
+                cacheBytes = 0;
+                startState[0] = startState[1] = -1;
+                flushCount++;
+                return intern(std::move(set), false);
+            }
+            int next = intern(std::move(set), false);
+            states[state].next[cls] = next;
+            return next;
+        }
+    };
+}
+
+struct RegexCaches {
+    LazyDfa forward; // Anchored, walks from a known start to the longest match end
+    LazyDfa reverse; // Unanchored, marks every column a match can start at
+
+    // Forward scans that reach a column in a DFA state an earlier scan of the line was in
+    // stop there: what follows is the same, so is the longest match end it leads to. Every
+    // (column, state) is walked once, which keeps a line linear however the scans overlap.
+    struct Known {
+        int state;
+        int end;  // Longest match end reachable from here, -1 when there is none
+        int next; // Next entry for the same column
+    };
+    struct Step {
+        size_t col;
+        int state;
+        bool match;
+    };
+    std::vector<int> knownAt; // Per column, first entry or -1
+    std::vector<Known> known;
+    std::vector<Step> path;
+    unsigned knownFlushes = 0;
+
+    explicit RegexCaches(const RegexProgram& program)
+        : forward(program.forward, program, false), reverse(program.reverse, program, true) {}
+
+    bool lookup(size_t col, int state, int& end) const {
+        for (int at = knownAt[col]; at >= 0; at = known[at].next) {
+            if (known[at].state == state) {
+                end = known[at].end;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+std::shared_ptr<const RegexProgram> CompileRegex(const std::wstring& pattern, bool ignoreCase, std::wstring& error) {
+    RegexNode root;
+    RegexParser parser(pattern, ignoreCase);
+    if (!parser.parse(root, error)) return nullptr;
+
+    auto program = std::make_shared<RegexProgram>();
+    std::vector<bool> boundary(MAX_UNIT + 1, false);
+    collectRanges(root, boundary);
+    program->classOf.resize(MAX_UNIT + 1);
+    int cls = 0;
+    for (size_t unit = 0; unit <= MAX_UNIT; ++unit) {
+        if (boundary[unit] && unit > 0) cls++;
+        program->classOf[unit] = (uint16_t)cls;
+    }
+    program->classCount = cls + 1;
+
+    if (!NfaBuilder(program->forward, *program, false).build(root) ||
+        !NfaBuilder(program->reverse, *program, true).build(root)) {
+        error = L"Pattern is too large";
+        return nullptr;
+    }
+    return program;
+}
+
+RegexMatcher::RegexMatcher(std::shared_ptr<const RegexProgram> program)
+    : program(program), caches(new RegexCaches(*program)) {}
+
+RegexMatcher::~RegexMatcher() = default;
+
+void RegexMatcher::cancelWhenChanged(const std::atomic<uint64_t>* counter, uint64_t expected) {
+    cancelCounter = counter;
+    cancelExpected = expected;
+}
+
+// One backward pass finds every column a match can start at, then each match is extended
+// from the leftmost remaining start to its longest end
+bool RegexMatcher::findAll(const wchar_t* line, size_t length, std::vector<std::pair<int, int>>& matches) {
+    const size_t CANCEL_CHECK = 4096; // Units scanned between looks at the cancel counter
+    size_t sinceCheck = 0;
+    auto cancelled = [&]() {
+        if (++sinceCheck < CANCEL_CHECK || !cancelCounter) return false;
+        sinceCheck = 0;
+        return cancelCounter->load(std::memory_order_relaxed) != cancelExpected;
+    };
+
+    canStart.assign(length + 1, 0);
+    bool any = false;
+    int state = caches->reverse.start(true);
+    for (size_t i = length;; --i) {
+        if (caches->reverse.matches(state) || (i == 0 && caches->reverse.matchesAtEnd(state))) {
+            canStart[i] = 1;
+            any = true;
+        }
+        if (i == 0) break;
+        if (cancelled()) return false;
+        state = caches->reverse.step(state, line[i - 1]);
+    }
+    if (!any) return true;
+
+    LazyDfa& forward = caches->forward;
+    caches->knownAt.assign(length + 1, -1);
+    caches->known.clear();
+    caches->knownFlushes = forward.flushes();
+    size_t from = 0;
+    while (from <= length) {
+        size_t start = std::find(canStart.begin() + from, canStart.end(), 1) - canStart.begin();
+        if (start > length) break;
+
+        // Walk until the DFA dies, the line ends or a known (column, state) is reached
+        int end = -1;
+        caches->path.clear();
+        state = forward.start(start == 0);
+        for (size_t i = start;; ++i) {
+            if (caches->lookup(i, state, end)) break;
+            if (i == length) {
+                caches->path.push_back({i, state, forward.matchesAtEnd(state)});
+                break;
+            }
+            caches->path.push_back({i, state, forward.matches(state)});
+            if (cancelled()) return false;
+            state = forward.step(state, line[i]);
+            if (forward.dead(state)) break;
+        }
+
+        // State numbers are only comparable while the cache hasn't been thrown away
+        bool keep = forward.flushes() == caches->knownFlushes;
+        if (!keep) {
+            caches->knownAt.assign(length + 1, -1);
+            caches->known.clear();
+            caches->knownFlushes = forward.flushes();
+        }
+        for (size_t step = caches->path.size(); step-- > 0;) {
+            const RegexCaches::Step& at = caches->path[step];
+            if (end < 0 && at.match) end = (int)at.col;
+            if (keep) {
+                caches->known.push_back({at.state, end, caches->knownAt[at.col]});
+                caches->knownAt[at.col] = (int)caches->known.size() - 1;
+            }
+        }
+
+        if (end > (int)start) {
+            matches.emplace_back((int)start, end - (int)start);
+            from = end;
+        } else {
+            from = start + 1;
+        }
+    }
+    return true;
+}
\ No newline at end of file
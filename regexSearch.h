@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Regular expressions matched one line at a time by lazy DFAs, so there is no backtracking
+// and a line is never rescanned per alternative. Supported: literals, ., [...] and [^...],
+// \d \w \s \D \W \S, ^ and $ at line ends, (...) groups, | and the * + ? {m} {m,} {m,n}
+// quantifiers. Matches are leftmost-longest; empty matches are skipped.
+
+struct RegexProgram; // Compiled pattern, immutable and shared between search threads
+
+// Null on a syntax error, with error describing it. Ignoring case, literals and [...] sets
+// match every unit that folds the same (see FoldCase).
+std::shared_ptr<const RegexProgram> CompileRegex(const std::wstring& pattern, bool ignoreCase, std::wstring& error);
+
+struct RegexCaches;
+
+// Per-thread matcher, owns the DFA state caches that fill in as the text is scanned
+class RegexMatcher {
+public:
+    explicit RegexMatcher(std::shared_ptr<const RegexProgram> program);
+    ~RegexMatcher();
+
+    // Appends (col, length) of each match in line, in order and without overlap. Linear in
+    // the line's length. False when it was cancelled part way, with only some matches appended.
+    bool findAll(const wchar_t* line, size_t length, std::vector<std::pair<int, int>>& matches);
+
+    // findAll gives up once *counter no longer holds expected, checking every few thousand units
+    void cancelWhenChanged(const std::atomic<uint64_t>* counter, uint64_t expected);
+
+private:
+    std::shared_ptr<const RegexProgram> program;
+    std::unique_ptr<RegexCaches> caches;
+    std::vector<char> canStart; // Per column of the line being searched, some match starts there
+    const std::atomic<uint64_t>* cancelCounter = nullptr;
+    uint64_t cancelExpected = 0;
+};
\ No newline at end of file
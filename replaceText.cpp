@@ -0,0 +1,142 @@
+#include "replaceText.h"
+#include "textEditorGlobals.h"
+#include "isModified.h"
+#include "frameScheduler.h"
+
+namespace {
+    // Neighbouring touched lines are rebuilt together up to about this many characters
+    const size_t BLOCK_CHARS = 1 << 20;
+
+    struct SpanEdit {
+        int line;
+        int col;
+        int length;
+        const wchar_t* text; // What the span becomes
+        size_t textLength;
+    };
+
+    // Edits [first, last), whose lines are rebuilt together
+    struct SpanBlock {
+        size_t first;
+        size_t last;
+    };
+
+    // Document offset just past the text of line
+    size_t LineEnd(int line) {
+        return line + 1 < (int)textBuffer.lineCount() ? textBuffer.lineStart(line + 1) - 1 : textBuffer.length();
+    }
+
+    // Each run of neighbouring touched lines is fetched once, rebuilt with its edits applied
+    // and put back as one erase and one insert, so the cost is a single pass over the
+    // touched text however many edits there are. The old text of every span is appended
+    // to removed. Spans never hold a line break, so line numbers don't move, and the
+    // LinesChanged hooks see the whole range once, after the last block is back.
+    void ApplySpanEdits(const std::vector<SpanEdit>& edits, std::wstring* removed) {
+        if (edits.empty()) return;
+
+        // Lines between the touched ones come along unchanged, so a match on most lines
+        // still makes a few large blocks rather than one per run of adjacent lines
+        std::vector<SpanBlock> blocks;
+        size_t inserted = 0;
+        for (size_t i = 0; i < edits.size();) {
+            SpanBlock block{i, i};
+            size_t start = textBuffer.lineStart(edits[i].line);
+            size_t end = LineEnd(edits[i].line);
+            int lastLine = edits[i].line;
+            for (; block.last < edits.size(); ++block.last) {
+                const SpanEdit& edit = edits[block.last];
+                if (edit.line != lastLine) {
+                    size_t lineEnd = LineEnd(edit.line);
+                    if (lineEnd - start > BLOCK_CHARS) break;
+                    lastLine = edit.line;
+                    end = lineEnd;
+                }
+                inserted += edit.textLength - edit.length;
+            }
+            inserted += end - start;
+            blocks.push_back(block);
+            i = block.last;
+        }
+        textBuffer.reserveInserts(inserted);
+
+        std::wstring original, rebuilt; // Reused from block to block
+        std::vector<size_t> lineStarts;
+        for (const SpanBlock& block : blocks) {
+            // Offsets are only taken now, the blocks before this one have changed length
+            int firstLine = edits[block.first].line;
+            int lastLine = edits[block.last - 1].line;
+            size_t start = textBuffer.lineStart(firstLine);
+            textBuffer.getRange(start, LineEnd(lastLine) - start, original);
+            textBuffer.lineStarts(firstLine, lastLine - firstLine + 1, lineStarts);
+            rebuilt.clear();
+            rebuilt.reserve(original.length());
+            size_t copied = 0;
+            for (size_t k = block.first; k < block.last; ++k) {
+                size_t at = lineStarts[edits[k].line - firstLine] - start + edits[k].col;
+                rebuilt.append(original.data() + copied, at - copied);
+                rebuilt.append(edits[k].text, edits[k].textLength);
+                if (removed) removed->append(original.data() + at, edits[k].length);
+                copied = at + edits[k].length;
+            }
+            rebuilt.append(original.data() + copied, original.length() - copied);
+
+            EraseAtOffset(start, original.length());
+            InsertAtOffset(start, rebuilt.data(), rebuilt.length());
+        }
+        int touchedLines = edits.back().line - edits.front().line;
+        LinesChanged(edits.front().line, touchedLines, touchedLines);
+    }
+}
+
+void ReplaceMatches(HWND hwnd, const std::vector<SearchMatch>& matches, const std::wstring& replacement) {
+    if (matches.empty()) return;
+
+    std::vector<ReplacedSpan> spans;
+    spans.reserve(matches.size());
+    std::vector<SpanEdit> edits;
+    edits.reserve(matches.size());
+    for (const SearchMatch& match : matches) {
+        spans.push_back(ReplacedSpan{match.line, match.col, match.length});
+        edits.push_back(SpanEdit{match.line, match.col, match.length, replacement.data(), replacement.length()});
+    }
+    std::wstring removed;
+    ApplySpanEdits(edits, &removed);
+    undoHistory.push(UndoEntry{UndoActionType::REPLACE, matches[0].line, matches[0].col,
+                               removed, replacement, spans.data(), spans.size()});
+
+    isModifiedTag(textBuffer, hwnd);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
+}
+
+// Spans are where the matches were before, so later ones on a line have moved by the
+// difference in length of those replaced ahead of them
+void UndoReplace(const UndoEntry& action) {
+    int grown = (int)action.replacement.length();
+    std::vector<SpanEdit> edits;
+    edits.reserve(action.spanCount);
+    const wchar_t* oldText = action.text.data();
+    int line = -1;
+    int shift = 0;
+    for (size_t i = 0; i < action.spanCount; ++i) {
+        const ReplacedSpan& span = action.spans[i];
+        if (span.line != line) {
+            line = span.line;
+            shift = 0;
+        }
+        edits.push_back(SpanEdit{span.line, span.col + shift, grown, oldText, (size_t)span.length});
+        oldText += span.length;
+        shift += grown - span.length;
+    }
+    ApplySpanEdits(edits, nullptr);
+}
+
+void RedoReplace(const UndoEntry& action) {
+    std::vector<SpanEdit> edits;
+    edits.reserve(action.spanCount);
+    for (size_t i = 0; i < action.spanCount; ++i) {
+        const ReplacedSpan& span = action.spans[i];
+        edits.push_back(SpanEdit{span.line, span.col, span.length, action.replacement.data(),
+                                 action.replacement.length()});
+    }
+    ApplySpanEdits(edits, nullptr);
+}
\ No newline at end of file
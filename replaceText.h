@@ -0,0 +1,15 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "searchWorker.h" // For SearchMatch
+#include "undoStack.h"
+
+// Replaces matches, which are in document order, don't overlap and stay inside their
+// lines, with replacement. The whole replace goes into the undo history as one entry.
+void ReplaceMatches(HWND hwnd, const std::vector<SearchMatch>& matches, const std::wstring& replacement);
+
+// Puts back the text a REPLACE entry replaced, or replaces it again
+void UndoReplace(const UndoEntry& action);
+void RedoReplace(const UndoEntry& action);
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+// Polynomial rolling hash modulo the Mersenne prime 2^61 - 1, shared by the piece table and
+// the index of a mapped file so both give the same hash for the same text.
+// hash(A + B) = hash(A) * BASE^|B| + hash(B), which is what lets pieces be combined.
+
+const uint64_t HASH_MOD = (1ULL << 61) - 1;
+const uint64_t HASH_BASE = 1000003;
+
+inline uint64_t mulMod(uint64_t a, uint64_t b) {
+    unsigned __int128 product = (unsigned __int128)a * b;
+    uint64_t folded = (uint64_t)(product & HASH_MOD) + (uint64_t)(product >> 61);
+    return folded >= HASH_MOD ? folded - HASH_MOD : folded;
+}
+
+inline uint64_t addMod(uint64_t a, uint64_t b) {
+    uint64_t sum = a + b;
+    return sum >= HASH_MOD ? sum - HASH_MOD : sum;
+}
+
+inline uint64_t powMod(uint64_t exponent) {
+    uint64_t result = 1;
+    uint64_t base = HASH_BASE;
+    while (exponent > 0) {
+        if (exponent & 1) result = mulMod(result, base);
+        base = mulMod(base, base);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+inline uint64_t hashStep(uint64_t hash, wchar_t ch) {
+    return addMod(mulMod(hash, HASH_BASE), (uint64_t)ch + 1);
+}
+
+// hashStep left unreduced, for a chain of steps reduced once at its end by reduceHash.
+// Any hash below 2^62 stays below it, so a chain can be as long as it likes.
+inline uint64_t hashStepPartial(uint64_t hash, wchar_t ch) {
+    unsigned __int128 product = (unsigned __int128)hash * HASH_BASE;
+    return (uint64_t)(product & HASH_MOD) + (uint64_t)(product >> 61) + (uint64_t)ch + 1;
+}
+
+inline uint64_t reduceHash(uint64_t hash) {
+    uint64_t folded = (hash & HASH_MOD) + (hash >> 61);
+    return folded >= HASH_MOD ? folded - HASH_MOD : folded;
+}
+
+// Extends hash by text, 64-char groups four at a time as separate chains so the multiplies
+// don't wait on each other, each reduced only at its end
+inline uint64_t extendHash(uint64_t hash, const wchar_t* text, size_t count) {
+    static const uint64_t groupPow = powMod(64);
+    size_t i = 0;
+    for (; count - i >= 4 * 64; i += 4 * 64) {
+        const wchar_t* block = text + i;
+        uint64_t h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+        for (size_t j = 0; j < 64; ++j) {
+            h0 = hashStepPartial(h0, block[j]);
+            h1 = hashStepPartial(h1, block[64 + j]);
+            h2 = hashStepPartial(h2, block[2 * 64 + j]);
+            h3 = hashStepPartial(h3, block[3 * 64 + j]);
+        }
+        for (uint64_t h : {h0, h1, h2, h3}) {
+            hash = addMod(mulMod(hash, groupPow), reduceHash(h));
+        }
+    }
+    for (; i < count; ++i) {
+        hash = hashStep(hash, text[i]);
+    }
+    return hash;
+}
\ No newline at end of file
@@ -3,13 +3,29 @@
 #include "textMetrics.h"
 #include "updateCaretAndScroll.h"
 #include "infoBar.h"
+#include "damageTracker.h"
+#include "frameScheduler.h"
+#include "viewport.h"
+#include "searchWorker.h"
+#include "regexSearch.h"
+#include "charScan.h"
+#include "replaceText.h"
+#include "trigramIndex.h"
+#include "matchList.h"
+#include "mappedText.h"
 #include <windows.h>
 #include <algorithm>
+#include <memory>
 
 bool isSearchMode = false;
+bool searchRegex = false;
+bool searchIgnoreCase = false;
+bool searchWholeWord = false;
+bool isReplaceMode = false;
+std::wstring replaceBoxText = L"Replace: ";
 std::wstring searchQuery;
 std::wstring searchBoxText = L"Search: ";
-std::vector<std::pair<int, int>> searchMatches;
+MatchList searchMatches;
 size_t currentMatchIndex = 0;
 int searchBoxHeight = 30;
 int searchCaretPos = 8;
@@ -17,12 +33,52 @@ int savedCaretCol;
 int savedCaretLine;
 int savedScrollOffsetX;
 int savedScrollOffsetY;
+size_t searchChecked = 0;
+double searchMillis = 0;
+bool searchInProgress = false;
+
+// Every occurrence of candidatesQuery, overlapping ones included. searchMatches is the
+// non-overlapping subset; keeping all of them is what makes narrowing exact, since
+// "aab" in "aaab" starts inside the skipped overlap of "aa".
+static MatchList searchCandidates;
+static std::wstring candidatesQuery;
+static uint64_t candidatesVersion = 0;
+static uint64_t searchGeneration = 0;     // Generation of the scan whose batches are being collected
+static LARGE_INTEGER searchStarted;
+// Where the last match ends, so batches can be appended without re-deriving earlier matches
+static int lastMatchLine = -1;
+static int lastMatchEnd = 0;
+static std::wstring patternError; // Why the regex didn't compile, shown in place of the match count
+// The current query, for re-searching the lines an edit touches on the UI thread
+static std::unique_ptr<SubstringSearcher> lineSearcher;
+static std::unique_ptr<RegexMatcher> lineRegex;
+static HWND searchWindow = NULL;       // Of the last FindAllMatches, where an edit starts one again
+static bool jumpToFirstResult = true; // Off when an edit started the scan, the caret stays put
+// An edit over more than this many characters is searched again by the workers, not on the UI thread
+static const size_t RESEARCH_EDIT_CHARS = 1024 * 1024;
+// Highlight brushes, made on first paint and kept until ReleaseSearchBrushes
+static HBRUSH matchBrush = NULL;
+static HBRUSH currentMatchBrush = NULL;
+// The replace row sits under the search row, keys and characters go to whichever has focus
+static const int SEARCH_ROW_HEIGHT = 30;
+static const int REPLACE_PREFIX = 9; // "Replace: "
+static bool replaceFocused = false;
+static int replaceCaretPos = REPLACE_PREFIX;
+
+// searchMatches is sorted by line then column, so a line's matches start here
+static size_t FirstMatchOnLine(int line) {
+    return searchMatches.firstOnLine(line);
+}
 
 void ActivateSearchMode(HWND hwnd) {
     isSearchMode = true;
     searchBoxText = L"Search: ";
     searchQuery.clear();
     searchMatches.clear();
+    searchCandidates.clear();
+    candidatesQuery.clear();
+    searchChecked = 0;
+    searchMillis = 0;
     currentMatchIndex = 0;
     searchCaretPos = 8;
     
@@ -32,11 +88,27 @@ void ActivateSearchMode(HWND hwnd) {
     savedScrollOffsetX = scrollOffsetX;
     savedScrollOffsetY = scrollOffsetY;
     
-    InvalidateRect(hwnd, NULL, TRUE);
+    DamageAll(); // Search box and match highlights appear
+}
+
+void ShowReplace(HWND hwnd) {
+    if (!isSearchMode) {
+        ActivateSearchMode(hwnd);
+    }
+    isReplaceMode = true;
+    searchBoxHeight = SEARCH_ROW_HEIGHT * 2;
+    replaceFocused = !searchQuery.empty();
+    replaceCaretPos = (int)replaceBoxText.length();
+    DamageAll(); // The box grows over the text
 }
 
 void DeactivateSearchMode(HWND hwnd) {
     isSearchMode = false;
+    isReplaceMode = false;
+    replaceFocused = false;
+    searchBoxHeight = SEARCH_ROW_HEIGHT;
+    CancelSearch();
+    searchInProgress = false;
     
     // Restore saved editor state instead of zeroing out
     caretCol = savedCaretCol;
@@ -44,9 +116,8 @@ void DeactivateSearchMode(HWND hwnd) {
     scrollOffsetX = savedScrollOffsetX;
     scrollOffsetY = savedScrollOffsetY;
     
-    UpdateCaretPosition(hwnd);
-    InvalidateRect(hwnd, NULL, TRUE);
-    UpdateScrollBars(hwnd);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
+    DamageAll(); // Search box and match highlights go away
 }
 
 void DrawSearchBox(HWND hwnd, HDC hdc) {
@@ -79,12 +150,39 @@ void DrawSearchBox(HWND hwnd, HDC hdc) {
     // Draw text
     SetBkMode(hdc, TRANSPARENT);
     TextOutW(hdc, 10, searchRect.top + 8, searchBoxText.c_str(), (int)searchBoxText.length());
+
+    // Match count, partial while the worker is still scanning
+    if (!searchQuery.empty()) {
+        wchar_t status[64];
+        if (!patternError.empty()) {
+            swprintf(status, 64, L"%ls", patternError.c_str());
+        } else if (searchInProgress) {
+            swprintf(status, 64, L"Searching\u2026 %zu", searchMatches.size());
+        } else {
+            swprintf(status, 64, L"%zu matches", searchMatches.size());
+        }
+        RECT statusRect = {clientRect.right / 2, searchRect.top, clientRect.right - 172,
+                           searchRect.top + SEARCH_ROW_HEIGHT};
+        DrawTextW(hdc, status, -1, &statusRect, DT_RIGHT | DT_VCENTER | DT_SINGLELINE);
+    }
    
     // Draw buttons - Simple approach
     int buttonSize = 24;
     int buttonTop = searchRect.top + 3;
     
     HBRUSH btnBrush = CreateSolidBrush(RGB(220, 220, 220));
+    HBRUSH btnOnBrush = CreateSolidBrush(RGB(170, 200, 240));
+
+    // Option toggles - left of the arrows, tinted while on
+    RECT caseBtn = {clientRect.right - 164, buttonTop, clientRect.right - 140, buttonTop + buttonSize};
+    FillRect(hdc, &caseBtn, searchIgnoreCase ? btnOnBrush : btnBrush);
+    TextOutW(hdc, caseBtn.left + 3, caseBtn.top + 4, L"Aa", 2);
+    RECT wordBtn = {clientRect.right - 136, buttonTop, clientRect.right - 112, buttonTop + buttonSize};
+    FillRect(hdc, &wordBtn, searchWholeWord ? btnOnBrush : btnBrush);
+    TextOutW(hdc, wordBtn.left + 6, wordBtn.top + 4, L"W", 1);
+    RECT regexBtn = {clientRect.right - 108, buttonTop, clientRect.right - 84, buttonTop + buttonSize};
+    FillRect(hdc, &regexBtn, searchRegex ? btnOnBrush : btnBrush);
+    TextOutW(hdc, regexBtn.left + 5, regexBtn.top + 4, L".*", 2);
     
     // Up button - rightmost
     RECT upBtn = {clientRect.right - 80, buttonTop, clientRect.right - 56, buttonTop + buttonSize};
@@ -100,25 +198,48 @@ void DrawSearchBox(HWND hwnd, HDC hdc) {
     RECT xBtn = {clientRect.right - 28, buttonTop, clientRect.right - 4, buttonTop + buttonSize};
     FillRect(hdc, &xBtn, btnBrush);
     TextOutW(hdc, xBtn.left + 8, xBtn.top + 4, L"X", 1);
+
+    // Replace row - replace the current match, or all of them
+    int rowTop = searchRect.top;
+    if (isReplaceMode) {
+        rowTop += SEARCH_ROW_HEIGHT;
+        TextOutW(hdc, 10, rowTop + 8, replaceBoxText.c_str(), (int)replaceBoxText.length());
+        RECT replaceBtn = {clientRect.right - 108, rowTop + 3, clientRect.right - 44, rowTop + 3 + buttonSize};
+        FillRect(hdc, &replaceBtn, btnBrush);
+        DrawTextW(hdc, L"Replace", -1, &replaceBtn, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+        RECT allBtn = {clientRect.right - 42, rowTop + 3, clientRect.right - 4, rowTop + 3 + buttonSize};
+        FillRect(hdc, &allBtn, btnBrush);
+        DrawTextW(hdc, L"All", -1, &allBtn, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+    }
    
     // Cleanup
     DeleteObject(bgBrush);
     DeleteObject(borderPen);
     DeleteObject(btnBrush);
+    DeleteObject(btnOnBrush);
    
-    // Draw caret
+    // Draw caret in whichever row has focus
     if (isSearchMode) {
+        const std::wstring& text = replaceFocused ? replaceBoxText : searchBoxText;
+        int caretTop = replaceFocused ? rowTop : searchRect.top;
         SIZE textSize;
-        GetTextExtentPoint32W(hdc, searchBoxText.c_str(), searchCaretPos, &textSize);
-        MoveToEx(hdc, 10 + textSize.cx, searchRect.top + 5, NULL);
-        LineTo(hdc, 10 + textSize.cx, searchRect.bottom - 5);
+        GetTextExtentPoint32W(hdc, text.c_str(), replaceFocused ? replaceCaretPos : searchCaretPos, &textSize);
+        MoveToEx(hdc, 10 + textSize.cx, caretTop + 5, NULL);
+        LineTo(hdc, 10 + textSize.cx, caretTop + SEARCH_ROW_HEIGHT - 5);
     }
 }
 
 void JumpToMatch(HWND hwnd, size_t index) {
     if (index >= searchMatches.size()) return;
     
-    auto [line, col] = searchMatches[index];
+    auto [line, col, length] = searchMatches[index];
+    // The current-match highlight moves from the old match to this one
+    if (currentMatchIndex < searchMatches.size()) {
+        int previousLine = searchMatches[currentMatchIndex].line;
+        DamageLines(previousLine, previousLine);
+    }
+    currentMatchIndex = index;
+    DamageLines(line, line);
     caretLine = line;
     caretCol = col;
     
@@ -142,11 +263,11 @@ void JumpToMatch(HWND hwnd, size_t index) {
     
     // Vertical scrolling - center the match vertically
     int targetScrollY = line - (availableLines / 2);
-    scrollOffsetY = std::max(0, std::min(targetScrollY, (int)textBuffer.size() - availableLines));
+    scrollOffsetY = std::max(0, std::min(targetScrollY, (int)textBuffer.lineCount() - availableLines));
     
     // Horizontal scrolling - ensure the entire match is visible
     int matchStartCol = col;
-    int matchEndCol = col + (int)searchQuery.length();
+    int matchEndCol = col + length;
     
     // If match extends beyond right edge, scroll to show the end
     if (matchEndCol * charWidth > scrollOffsetX + availableWidth) {
@@ -161,135 +282,442 @@ void JumpToMatch(HWND hwnd, size_t index) {
     // Ensure we don't scroll past the beginning
     scrollOffsetX = std::max(0, scrollOffsetX);
     
-    // Force immediate update and refresh
-    UpdateCaretPosition(hwnd);
-    UpdateScrollBars(hwnd);
-    InvalidateRect(hwnd, NULL, TRUE);
-    UpdateWindow(hwnd);
+    // A scroll is picked up by FlushDamage, no forced repaint
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
 }
 
+// Only the matches on lines inside the paint rect are visited; the text itself is drawn
+// over the highlights afterwards by WM_PAINT
 void DrawSearchMatches(HDC hdc, const RECT& paintRect) {
     if (!isSearchMode || searchQuery.empty()) return;
 
-    // Setup highlight colors (yellow for search matches)
-    HBRUSH hbrHighlight = CreateSolidBrush(RGB(255, 255, 150));  // Light yellow
-    COLORREF oldTextColor = SetTextColor(hdc, RGB(0, 0, 0));
-    COLORREF oldBkColor = SetBkColor(hdc, RGB(255, 255, 150));
-
-    // Highlight current match differently (orange)
-    HBRUSH hbrCurrent = CreateSolidBrush(RGB(255, 200, 100));
-    
-    // Calculate visible area accounting for search box
-    int visibleHeight = paintRect.bottom - searchBoxHeight;
-    if (showInfoBar) {
-        visibleHeight -= infoBarHeight;
+    if (!matchBrush) {
+        matchBrush = CreateSolidBrush(RGB(255, 255, 150));         // Light yellow
+        currentMatchBrush = CreateSolidBrush(RGB(255, 200, 100));  // Orange for the current match
     }
-    int maxVisibleLine = scrollOffsetY + (visibleHeight / charHeight);
-    
-    // Draw all visible matches
-    for (const auto& [line, col] : searchMatches) {
-        // Skip if line isn't visible (accounting for search box)
-        if (line < scrollOffsetY || line > maxVisibleLine) {
-            continue;
-        }
+
+    LineRange lines = VisibleLineRange(paintRect.top, paintRect.bottom, charHeight,
+                                       scrollOffsetY, textBuffer.lineCount());
+    for (size_t i = FirstMatchOnLine(lines.first); i < searchMatches.size(); ++i) {
+        auto [line, col, length] = searchMatches[i];
+        if (line >= lines.last) break;
 
         RECT rcMatch;
         rcMatch.top = (line - scrollOffsetY) * charHeight;
         rcMatch.bottom = rcMatch.top + charHeight;
-        
-        // Calculate match bounds
-        rcMatch.left = col * charWidth - scrollOffsetX;
-        rcMatch.right = (col + searchQuery.length()) * charWidth - scrollOffsetX;
-        
-        // Clip to visible area
-        rcMatch.left = std::max(rcMatch.left, paintRect.left);
-        rcMatch.right = std::min(rcMatch.right, paintRect.right);
-        
+        rcMatch.left = std::max((LONG)(col * charWidth - scrollOffsetX), paintRect.left);
+        rcMatch.right = std::min((LONG)((col + length) * charWidth - scrollOffsetX), paintRect.right);
         if (rcMatch.right > rcMatch.left) {
-            // Use different color for current match
-            bool isCurrent = (line == caretLine && col == caretCol);
-            FillRect(hdc, &rcMatch, isCurrent ? hbrCurrent : hbrHighlight);
-            
-            // Redraw text with highlight colors
-            int textStart = std::max(0, ((int)rcMatch.left + scrollOffsetX) / charWidth);
-            int textEnd = std::min((int)textBuffer[line].length(), 
-                             ((int)rcMatch.right + scrollOffsetX) / charWidth);
-            
-            if (textEnd > textStart) {
-                std::wstring visibleText = textBuffer[line].substr(
-                    textStart, textEnd - textStart);
-                TextOutW(hdc, 
-                        textStart * charWidth - scrollOffsetX, 
-                        rcMatch.top,
-                        visibleText.c_str(), 
-                        visibleText.length());
-            }
+            FillRect(hdc, &rcMatch, i == currentMatchIndex ? currentMatchBrush : matchBrush);
+        }
+    }
+}
+
+void ReleaseSearchBrushes() {
+    if (matchBrush) {
+        DeleteObject(matchBrush);
+        DeleteObject(currentMatchBrush);
+        matchBrush = currentMatchBrush = NULL;
+    }
+}
+
+// Offset of previous inside query when query only grew at either end, npos otherwise
+static size_t ExtensionOffset(const std::wstring& previous, const std::wstring& query) {
+    if (previous.empty() || previous.length() > query.length()) return std::wstring::npos;
+    if (query.compare(0, previous.length(), previous) == 0) return 0;
+    size_t tail = query.length() - previous.length();
+    if (query.compare(tail, previous.length(), previous) == 0) return tail;
+    return std::wstring::npos;
+}
+
+// Matches don't overlap, the same as scanning on from the end of each one
+static void AppendMatches(const SearchMatch* candidates, size_t count) {
+    std::vector<SearchMatch> matches;
+    for (size_t i = 0; i < count; ++i) {
+        const SearchMatch& match = candidates[i];
+        if (match.line != lastMatchLine || match.col >= lastMatchEnd) {
+            matches.push_back(match);
+            lastMatchLine = match.line;
+            lastMatchEnd = match.col + match.length;
         }
     }
+    searchMatches.append(matches.data(), matches.size());
+}
+
+// Every occurrence of query contains one of the previous query at offset, so only those are checked
+static void NarrowCandidates(const std::wstring& query, size_t offset) {
+    std::wstring folded(query);
+    if (searchIgnoreCase) {
+        for (wchar_t& unit : folded) unit = FoldCase(unit);
+    }
+    std::vector<SearchMatch> candidates, narrowed;
+    searchCandidates.copyTo(candidates);
+    std::wstring lineText;
+    int fetchedLine = -1;
+    for (const auto& [line, col, length] : candidates) {
+        int start = col - (int)offset;
+        if (start < 0) continue;
+        if (line != fetchedLine) {
+            lineText = textBuffer.getLine(line);
+            fetchedLine = line;
+        }
+        bool same = start + query.length() <= lineText.length();
+        for (size_t k = 0; same && k < query.length(); ++k) {
+            wchar_t unit = lineText[start + k];
+            same = (searchIgnoreCase ? FoldCase(unit) : unit) == folded[k];
+        }
+        if (same) {
+            narrowed.push_back(SearchMatch{line, start, (int)query.length()});
+        }
+    }
+    searchChecked = candidates.size();
+    searchCandidates.clear();
+    searchCandidates.append(narrowed.data(), narrowed.size());
+    AppendMatches(narrowed.data(), narrowed.size());
+}
 
-    // Restore DC state
-    SetTextColor(hdc, oldTextColor);
-    SetBkColor(hdc, oldBkColor);
-    DeleteObject(hbrHighlight);
-    DeleteObject(hbrCurrent);
+static double MillisSince(const LARGE_INTEGER& started) {
+    LARGE_INTEGER frequency, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return (now.QuadPart - started.QuadPart) * 1000.0 / frequency.QuadPart;
 }
 
 void FindAllMatches(HWND hwnd) {
+    QueryPerformanceCounter(&searchStarted);
+    searchWindow = hwnd;
+    jumpToFirstResult = true;
+
     searchMatches.clear();
+    lastMatchLine = -1;
+    lastMatchEnd = 0;
     searchQuery = searchBoxText.substr(8); // Get text after "Search: "
+    patternError.clear();
+    lineSearcher.reset();
+    lineRegex.reset();
+    DamageAll(); // Highlights can change anywhere on screen
+    DamageSearchBox();
+    UpdateInfoBar(hwnd);
     
     if (searchQuery.empty()) {
-        InvalidateRect(hwnd, NULL, TRUE);
+        CancelSearch();
+        searchInProgress = false;
+        searchCandidates.clear();
+        candidatesQuery.clear();
+        searchChecked = 0;
+        searchMillis = 0;
         return;
     }
     
-    // Find all matches in the document
-    for (int line = 0; line < textBuffer.size(); line++) {
-        size_t pos = 0;
-        while ((pos = textBuffer[line].find(searchQuery, pos)) != std::wstring::npos) {
-            searchMatches.emplace_back(line, pos);
-            pos += searchQuery.length();
+    std::shared_ptr<const RegexProgram> regex;
+    if (searchRegex) {
+        regex = CompileRegex(searchQuery, searchIgnoreCase, patternError);
+        if (!regex) {
+            CancelSearch();
+            searchInProgress = false;
+            searchCandidates.clear();
+            candidatesQuery.clear();
+            return;
         }
+        lineRegex.reset(new RegexMatcher(regex));
+    } else {
+        lineSearcher.reset(new SubstringSearcher(searchQuery, searchIgnoreCase));
     }
-    
+
+    // The workers can't read a file whose index is still growing, ReceiveFileIndex searches
+    // again once it is complete; until then it shows as searching and replace waits
+    if (MappedIndexBuilding()) {
+        CancelSearch();
+        searchGeneration = 0;
+        searchCandidates.clear();
+        candidatesQuery.clear();
+        searchInProgress = true;
+        return;
+    }
+
+    // A longer literal query only narrows a finished result, deletions and edits need a full scan.
+    // Whole-word results dropped the occurrences inside words, which the longer query may need.
+    size_t offset = (searchRegex || searchWholeWord) ? std::wstring::npos
+                                                     : ExtensionOffset(candidatesQuery, searchQuery);
+    bool narrow = offset != std::wstring::npos && !searchInProgress && candidatesVersion == textBuffer.version();
+    candidatesQuery = searchQuery;
+    candidatesVersion = textBuffer.version();
     currentMatchIndex = 0;
+    if (!narrow) {
+        searchCandidates.clear();
+        searchChecked = 0;
+
+        // The index of a large document rules out most lines of a literal query up front
+        std::vector<std::pair<int, int>> spans;
+        std::vector<ScanRange> ranges;
+        if (!regex && TrigramCandidateLines(searchQuery, spans)) {
+            if (spans.empty()) {
+                CancelSearch();
+                searchInProgress = false;
+                searchMillis = MillisSince(searchStarted);
+                UpdateInfoBar(hwnd);
+                return;
+            }
+            size_t lines = textBuffer.lineCount();
+            for (const auto& [first, count] : spans) {
+                size_t end = (size_t)(first + count);
+                ranges.push_back(ScanRange{textBuffer.lineStart(first),
+                                           end < lines ? textBuffer.lineStart(end) : textBuffer.length() + 1, first});
+            }
+        }
+
+        // Off the UI thread, results arrive through ReceiveSearchResults
+        searchInProgress = true;
+        searchGeneration = StartSearch(hwnd, searchQuery, regex, SearchOptions{searchIgnoreCase, searchWholeWord},
+                                       std::move(ranges));
+        return;
+    }
+
+    NarrowCandidates(searchQuery, offset);
+    searchMillis = MillisSince(searchStarted);
     if (!searchMatches.empty()) {
         JumpToMatch(hwnd, 0); // Jump to first match
     }
 }
 
+void ReceiveSearchResults(HWND hwnd, LPARAM lParam) {
+    std::unique_ptr<SearchBatch> batch((SearchBatch*)lParam);
+    if (!searchInProgress || batch->generation != searchGeneration) {
+        return; // Superseded by a newer query
+    }
+    if (candidatesVersion != textBuffer.version()) {
+        bool jump = jumpToFirstResult;
+        FindAllMatches(hwnd); // The document changed under the scan, start over
+        jumpToFirstResult = jump;
+        return;
+    }
+
+    size_t firstMatch = searchMatches.size();
+    searchCandidates.append(batch->occurrences.data(), batch->occurrences.size());
+    AppendMatches(batch->occurrences.data(), batch->occurrences.size());
+    searchChecked += batch->checked;
+    if (batch->done) {
+        searchInProgress = false;
+        searchMillis = MillisSince(searchStarted);
+    }
+
+    if (searchMatches.size() > firstMatch) {
+        DamageLines(searchMatches[firstMatch].line, searchMatches.back().line);
+        if (firstMatch == 0 && jumpToFirstResult) {
+            JumpToMatch(hwnd, 0); // First result, the rest keep streaming in behind it
+        }
+    }
+    DamageSearchBox();
+    UpdateInfoBar(hwnd);
+}
+
+// Occurrences of the current query in one line, overlapping ones included for a literal
+static void SearchLine(int line, std::vector<SearchMatch>& found) {
+    // Both kept between calls, so searching a typed-in line doesn't allocate
+    static std::wstring text;
+    static std::vector<std::pair<int, int>> lineMatches;
+    textBuffer.getLine(line, text);
+    if (lineRegex) {
+        lineMatches.clear();
+        lineRegex->findAll(text.data(), text.length(), lineMatches);
+        for (const auto& [col, length] : lineMatches) {
+            if (!searchWholeWord || IsWholeWord(text.data(), text.length(), col, length)) {
+                found.push_back(SearchMatch{line, col, length});
+            }
+        }
+        return;
+    }
+    for (size_t pos = lineSearcher->find(text.data(), text.length()); pos < text.length();
+         pos = lineSearcher->find(text.data(), text.length(), pos + 1)) {
+        if (!searchWholeWord || IsWholeWord(text.data(), text.length(), pos, lineSearcher->length())) {
+            found.push_back(SearchMatch{line, (int)pos, (int)lineSearcher->length()});
+        }
+    }
+}
+
+// Characters in count lines from firstLine, line breaks included
+static size_t LineRangeChars(int firstLine, int count) {
+    size_t end = firstLine + count < (int)textBuffer.lineCount() ? textBuffer.lineStart(firstLine + count)
+                                                                 : textBuffer.length();
+    return end - textBuffer.lineStart(firstLine);
+}
+
+// Called after every edit. Only the touched lines are searched again; matches below them
+// keep their columns and just move with the line count, which MatchList does without
+// visiting them. A scan still streaming in is
+// restarted by ReceiveSearchResults instead, since its batches predate the edit.
+void SearchLinesChanged(int line, int removedLines, int insertedLines) {
+    if (searchInProgress || (!lineSearcher && !lineRegex)) return;
+    if (candidatesVersion == textBuffer.version()) return;
+    if (LineRangeChars(line, insertedLines + 1) > RESEARCH_EDIT_CHARS) {
+        // A replace-all, or a large paste: the workers stream the matches back as for a new query
+        FindAllMatches(searchWindow);
+        jumpToFirstResult = false;
+        return;
+    }
+
+    static std::vector<SearchMatch> candidates, matches; // Reused, one edit after another
+    candidates.clear();
+    matches.clear();
+    for (int i = line; i <= line + insertedLines && i < (int)textBuffer.lineCount(); ++i) {
+        SearchLine(i, candidates);
+    }
+    for (const SearchMatch& match : candidates) {
+        if (matches.empty() || match.line != matches.back().line ||
+            match.col >= matches.back().col + matches.back().length) {
+            matches.push_back(match);
+        }
+    }
+
+    // The current match keeps its place unless it was on one of the touched lines
+    size_t firstTouched = FirstMatchOnLine(line);
+    size_t pastTouched = FirstMatchOnLine(line + removedLines + 1);
+    if (currentMatchIndex >= pastTouched && currentMatchIndex < searchMatches.size()) {
+        currentMatchIndex = currentMatchIndex - pastTouched + firstTouched + matches.size();
+    } else if (currentMatchIndex >= firstTouched) {
+        currentMatchIndex = firstTouched;
+    }
+
+    int delta = insertedLines - removedLines;
+    searchCandidates.splice(line, removedLines, candidates, delta);
+    searchMatches.splice(line, removedLines, matches, delta);
+    candidatesVersion = textBuffer.version();
+    if (currentMatchIndex >= searchMatches.size()) {
+        currentMatchIndex = 0;
+    }
+    if (isSearchMode) {
+        DamageSearchBox(); // Match count
+    }
+}
+
+// Results under one set of options say nothing about another, so the query is searched again from scratch
+static void ToggleSearchOption(HWND hwnd, bool& option) {
+    option = !option;
+    candidatesQuery.clear();
+    DamageSearchBox();
+    if (searchBoxText.length() > 8) {
+        FindAllMatches(hwnd);
+    }
+}
+
+void ToggleRegexSearch(HWND hwnd) {
+    ToggleSearchOption(hwnd, searchRegex);
+}
+
+void ToggleIgnoreCase(HWND hwnd) {
+    ToggleSearchOption(hwnd, searchIgnoreCase);
+}
+
+void ToggleWholeWord(HWND hwnd) {
+    ToggleSearchOption(hwnd, searchWholeWord);
+}
+
+// Replaces the current match, then moves on to the first match after the replacement
+void ReplaceCurrentMatch(HWND hwnd) {
+    if (searchInProgress || currentMatchIndex >= searchMatches.size()) return;
+
+    SearchMatch match = searchMatches[currentMatchIndex];
+    std::wstring replacement = replaceBoxText.substr(REPLACE_PREFIX);
+    ReplaceMatches(hwnd, std::vector<SearchMatch>{match}, replacement);
+
+    size_t next = FirstMatchOnLine(match.line);
+    int resumeCol = match.col + (int)replacement.length();
+    while (next < searchMatches.size() && searchMatches[next].line == match.line &&
+           searchMatches[next].col < resumeCol) {
+        next++;
+    }
+    if (!searchMatches.empty()) {
+        JumpToMatch(hwnd, next < searchMatches.size() ? next : 0);
+    }
+    DamageSearchBox();
+}
+
+// One pass over the touched lines and one undo action, whatever the number of matches
+void ReplaceAllMatches(HWND hwnd) {
+    if (searchInProgress || searchMatches.empty()) return;
+
+    std::vector<SearchMatch> matches; // Edits re-search the lines they touch
+    searchMatches.copyTo(matches);
+    ReplaceMatches(hwnd, matches, replaceBoxText.substr(REPLACE_PREFIX));
+    caretLine = matches[0].line;
+    caretCol = matches[0].col;
+    currentMatchIndex = 0;
+    DamageSearchBox();
+}
+
 void FindNext(HWND hwnd) {
     if (searchMatches.empty()) {
+        if (searchInProgress) return; // Still looking
         FindAllMatches(hwnd); // Find matches if none exist
         return;
     }
     
     // Cycle to next match (wrap around if needed)
-    currentMatchIndex = (currentMatchIndex + 1) % searchMatches.size();
-    JumpToMatch(hwnd, currentMatchIndex);
+    JumpToMatch(hwnd, (currentMatchIndex + 1) % searchMatches.size());
 }
 
 void FindPrevious(HWND hwnd) {
     if (searchMatches.empty()) {
+        if (searchInProgress) return;
         FindAllMatches(hwnd);
         return;
     }
     
     // Cycle to previous match (wrap around if needed)
-    currentMatchIndex = (currentMatchIndex == 0) ? searchMatches.size() - 1 : currentMatchIndex - 1;
-    JumpToMatch(hwnd, currentMatchIndex);
+    JumpToMatch(hwnd, (currentMatchIndex == 0) ? searchMatches.size() - 1 : currentMatchIndex - 1);
+}
+
+// Editing keys for the replace row, the rest fall through to the search row's handling
+static bool HandleReplaceKeyDown(HWND hwnd, WPARAM wParam) {
+    switch (wParam) {
+        case VK_LEFT:
+            if (replaceCaretPos > REPLACE_PREFIX) replaceCaretPos--;
+            break;
+        case VK_RIGHT:
+            if (replaceCaretPos < (int)replaceBoxText.length()) replaceCaretPos++;
+            break;
+        case VK_BACK:
+            if (replaceCaretPos > REPLACE_PREFIX) {
+                replaceBoxText.erase(replaceCaretPos - 1, 1);
+                replaceCaretPos--;
+            }
+            break;
+        case VK_RETURN:
+            if (GetKeyState(VK_CONTROL) & 0x8000) {
+                ReplaceAllMatches(hwnd);
+            } else {
+                ReplaceCurrentMatch(hwnd);
+            }
+            break;
+        default:
+            return false;
+    }
+    DamageSearchBox();
+    return true;
+}
+
+void FocusReplaceRow(bool focused) {
+    replaceFocused = focused && isReplaceMode;
+    DamageSearchBox();
 }
 
 void HandleSearchKeyDown(HWND hwnd, WPARAM wParam) {
+    if (wParam == VK_TAB && isReplaceMode) {
+        FocusReplaceRow(!replaceFocused);
+        return;
+    }
+    if (replaceFocused && HandleReplaceKeyDown(hwnd, wParam)) {
+        return;
+    }
     switch (wParam) {
         case VK_LEFT:
             if (searchCaretPos > 8) searchCaretPos--;
-            InvalidateRect(hwnd, NULL, TRUE);
+            DamageSearchBox();
             break;
             
         case VK_RIGHT:
             if (searchCaretPos < searchBoxText.length()) searchCaretPos++;
-            InvalidateRect(hwnd, NULL, TRUE);
+            DamageSearchBox();
             break;
             
         case VK_BACK:
@@ -297,13 +725,13 @@ void HandleSearchKeyDown(HWND hwnd, WPARAM wParam) {
                 searchBoxText.erase(searchCaretPos - 1, 1);
                 searchCaretPos--;
                 FindAllMatches(hwnd); // Update search immediately on deletion
-                InvalidateRect(hwnd, NULL, TRUE);
+                DamageSearchBox();
             } else if (searchBoxText == L"Search: ") {
                 // If search box is empty, clear matches
                 searchQuery.clear();
                 searchMatches.clear();
                 FindAllMatches(hwnd); // Update search immediately on deletion
-                InvalidateRect(hwnd, NULL, TRUE);
+                DamageSearchBox();
             }
             break;
             
@@ -327,7 +755,11 @@ void HandleSearchKeyDown(HWND hwnd, WPARAM wParam) {
 
 void HandleSearchCharacterDown(HWND hwnd, wchar_t ch) {
     // Handle printable characters only
-    if (ch >= 32 && ch <= 126) {
+    if (ch >= 32 && ch <= 126 && replaceFocused) {
+        replaceBoxText.insert(replaceCaretPos, 1, ch);
+        replaceCaretPos++;
+        DamageSearchBox();
+    } else if (ch >= 32 && ch <= 126) {
         searchBoxText.insert(searchCaretPos, 1, ch);
         searchCaretPos++;
         
@@ -335,6 +767,6 @@ void HandleSearchCharacterDown(HWND hwnd, wchar_t ch) {
         if (searchBoxText.length() > 8) { // "Search: " = 8 chars
             FindAllMatches(hwnd);
         }
-        InvalidateRect(hwnd, NULL, TRUE);
+        DamageSearchBox();
     }
 }
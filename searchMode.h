@@ -1,10 +1,19 @@
+#pragma once
+
 #include <windows.h>
 #include <string>
 #include <vector>
+#include "searchWorker.h" // For SearchMatch
+#include "matchList.h"
 extern bool isSearchMode;
+extern bool searchRegex; // The query is a regular expression, toggled with Ctrl+R or the .* button
+extern bool searchIgnoreCase; // Ctrl+I or the Aa button
+extern bool searchWholeWord;  // Matches must start and end on word boundaries, Ctrl+W or the W button
 extern std::wstring searchQuery;
 extern std::wstring searchBoxText;
-extern std::vector<std::pair<int, int>> searchMatches;
+extern bool isReplaceMode;          // The replace row is showing, Ctrl+H
+extern std::wstring replaceBoxText; // "Replace: " followed by the replacement
+extern MatchList searchMatches;
 extern size_t currentMatchIndex;
 extern int searchBoxHeight;
 extern int searchCaretPos;
@@ -12,14 +21,27 @@ extern int savedCaretCol;
 extern int savedCaretLine;
 extern int savedScrollOffsetX;
 extern int savedScrollOffsetY;
+extern size_t searchChecked;  // Candidate positions the last search looked at
+extern double searchMillis;   // and how long it took
+extern bool searchInProgress; // The worker is still streaming results in
 
 void ActivateSearchMode(HWND hwnd);
 void DeactivateSearchMode(HWND hwnd);
+void ShowReplace(HWND hwnd);
+void FocusReplaceRow(bool focused);
 void DrawSearchBox(HWND hwnd, HDC hdc);
 void HandleSearchKeyDown(HWND hwnd, WPARAM wParam);
 void HandleSearchCharacterDown(HWND hwnd, wchar_t ch);
 void FindAllMatches(HWND hwnd);
+void ToggleRegexSearch(HWND hwnd);
+void ToggleIgnoreCase(HWND hwnd);
+void ToggleWholeWord(HWND hwnd);
+void ReceiveSearchResults(HWND hwnd, LPARAM lParam); // WM_SEARCH_RESULTS
+void SearchLinesChanged(int line, int removedLines, int insertedLines); // From LinesChanged
 void JumpToMatch(HWND hwnd, size_t index);
+void ReplaceCurrentMatch(HWND hwnd);
+void ReplaceAllMatches(HWND hwnd);
 void FindNext(HWND hwnd);
 void FindPrevious(HWND hwnd);
-void DrawSearchMatches(HDC hdc, const RECT& paintRect);
\ No newline at end of file
+void DrawSearchMatches(HDC hdc, const RECT& paintRect);
+void ReleaseSearchBrushes(); // WM_DESTROY
\ No newline at end of file
@@ -0,0 +1,383 @@
+#define NOMINMAX
+
+#include "searchWorker.h"
+#include "textEditorGlobals.h" // For textBuffer
+#include "charScan.h"
+#include "regexSearch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+namespace {
+    // Chunks are sized so each thread gets several, letting fast threads take over from slow ones
+    const size_t MIN_CHUNK = 256 * 1024;
+    const size_t CHUNKS_PER_THREAD = 8;
+    const unsigned MAX_THREADS = 64;
+    // A chunk of a mapped file is decoded whole before it is scanned, this bounds the copy
+    const size_t MAX_MAPPED_CHUNK = 4 * 1024 * 1024;
+
+    std::atomic<uint64_t> currentGeneration{0};
+
+    bool cancelled(uint64_t generation) {
+        return currentGeneration.load(std::memory_order_relaxed) != generation;
+    }
+
+    // The snapshot's runs with their document offsets, for random access by offset. A run
+    // still in a mapped file has no text, it is decoded from source when it is read.
+    struct SnapshotText {
+        struct Run {
+            const wchar_t* text;
+            size_t source;
+            size_t length;
+        };
+        std::vector<Run> runs;
+        std::vector<size_t> starts;
+        size_t length = 0;
+        const MappedText* mapped = nullptr;
+
+        SnapshotText() = default;
+        explicit SnapshotText(const TextSnapshot& snapshot) : mapped(snapshot.mappedOriginal()) {
+            snapshot.forEachPiece([this](const wchar_t* text, size_t source, size_t count) {
+                runs.push_back(Run{text, source, count});
+                starts.push_back(length);
+                length += count;
+            });
+        }
+        // Decoded text, a whole number of lines, that starts at offset base of the document
+        SnapshotText(const std::wstring& text, size_t base)
+            : runs{Run{text.data(), 0, text.size()}}, starts{base}, length(base + text.size()) {}
+
+        size_t runAt(size_t offset) const {
+            return std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+        }
+
+        // Offset of the first L'\n' at or after offset, length if there is none
+        size_t findNewline(size_t offset) const {
+            for (size_t run = offset < length ? runAt(offset) : runs.size(); run < runs.size(); ++run) {
+                size_t at = offset > starts[run] ? offset - starts[run] : 0;
+                size_t found = runs[run].text
+                    ? at + FindChar(runs[run].text + at, runs[run].length - at, L'\n')
+                    : mapped->nextBreak(runs[run].source + at) - runs[run].source;
+                if (found < runs[run].length) return starts[run] + found;
+            }
+            return length;
+        }
+
+        // Appends the text of [from, to) to out, decoding what is still mapped
+        void copy(size_t from, size_t to, std::wstring& out) const {
+            for (size_t run = from < to ? runAt(from) : runs.size(); run < runs.size() && starts[run] < to; ++run) {
+                size_t first = std::max(from, starts[run]) - starts[run];
+                size_t last = std::min(to, starts[run] + runs[run].length) - starts[run];
+                if (runs[run].text) {
+                    out.append(runs[run].text + first, last - first);
+                } else {
+                    mapped->forEachSpan(runs[run].source + first, last - first,
+                                        [&](const wchar_t* text, size_t count) { out.append(text, count); });
+                }
+            }
+        }
+
+        // Text of [from, to), copied into scratch only when it spans runs
+        std::wstring_view range(size_t from, size_t to, std::wstring& scratch) const {
+            if (from == to) return std::wstring_view();
+            size_t run = runAt(from);
+            if (to <= starts[run] + runs[run].length && runs[run].text) {
+                return std::wstring_view(runs[run].text + (from - starts[run]), to - from);
+            }
+            scratch.clear();
+            copy(from, to, scratch);
+            return scratch;
+        }
+    };
+
+    struct ChunkResult {
+        std::vector<SearchMatch> occurrences; // Lines relative to the chunk's first line
+        int lines = 0;
+        size_t checked = 0;
+        bool done = false;
+    };
+
+    // Occurrences of the query in block, which holds whole lines starting at the chunk's line
+    // result.lines. The query never contains a newline, so lines are only counted between hits,
+    // and the line breaks around a line make its ends word boundaries.
+    void scanBlock(const wchar_t* block, size_t length, const SubstringSearcher& searcher, bool wholeWord,
+                   ChunkResult& result) {
+        int matchLength = (int)searcher.length();
+        size_t lineBegin = 0;
+        size_t counted = 0;
+        for (size_t pos = searcher.find(block, length); pos < length; pos = searcher.find(block, length, pos + 1)) {
+            size_t newlines = CountChar(block + counted, pos - counted, L'\n');
+            if (newlines != 0) {
+                result.lines += (int)newlines;
+                lineBegin = pos;
+                while (block[lineBegin - 1] != L'\n') lineBegin--;
+            }
+            counted = pos;
+            if (!wholeWord || IsWholeWord(block, length, pos, matchLength)) {
+                result.occurrences.push_back(SearchMatch{result.lines, (int)(pos - lineBegin), matchLength});
+            }
+        }
+        result.lines += (int)CountChar(block + counted, length - counted, L'\n');
+    }
+
+    // What a worker matches lines against. The searcher is shared, the regex matcher's
+    // DFA caches belong to the one worker.
+    struct LinePattern {
+        const SubstringSearcher* literal;
+        RegexMatcher* regex;
+        bool wholeWord;
+        std::vector<std::pair<int, int>> lineMatches;
+        std::wstring chunkText; // The decoded lines of a mapped file's chunk
+    };
+
+    // Scans the lines starting at lineStart that start before to. For a literal, runs of whole
+    // lines inside one piece are searched as a single block; anything else goes a line at a
+    // time, copying the lines that cross pieces.
+    void scanLines(const SnapshotText& text, size_t lineStart, size_t to, LinePattern& pattern,
+                   uint64_t generation, ChunkResult& result) {
+        std::wstring scratch;
+        while (lineStart < to && lineStart <= text.length && !cancelled(generation)) {
+            if (pattern.literal && lineStart < text.length) {
+                size_t run = text.runAt(lineStart);
+                size_t limit = std::min(to, text.starts[run] + text.runs[run].length);
+                const wchar_t* block = text.runs[run].text + (lineStart - text.starts[run]);
+                size_t lastNewline = limit - lineStart;
+                while (lastNewline > 0 && block[lastNewline - 1] != L'\n') lastNewline--;
+                if (lastNewline > 0) {
+                    scanBlock(block, lastNewline, *pattern.literal, pattern.wholeWord, result);
+                    result.checked += lastNewline;
+                    lineStart += lastNewline;
+                    continue;
+                }
+            }
+            size_t lineEnd = text.findNewline(lineStart);
+            std::wstring_view line = text.range(lineStart, lineEnd, scratch);
+            if (pattern.literal) {
+                const SubstringSearcher& searcher = *pattern.literal;
+                for (size_t pos = searcher.find(line.data(), line.length()); pos < line.length();
+                     pos = searcher.find(line.data(), line.length(), pos + 1)) {
+                    if (!pattern.wholeWord || IsWholeWord(line.data(), line.length(), pos, searcher.length())) {
+                        result.occurrences.push_back(SearchMatch{result.lines, (int)pos, (int)searcher.length()});
+                    }
+                }
+            } else {
+                pattern.lineMatches.clear();
+                pattern.regex->findAll(line.data(), line.length(), pattern.lineMatches);
+                for (const auto& [col, length] : pattern.lineMatches) {
+                    if (!pattern.wholeWord || IsWholeWord(line.data(), line.length(), col, length)) {
+                        result.occurrences.push_back(SearchMatch{result.lines, col, length});
+                    }
+                }
+            }
+            result.checked += line.length() + 1;
+            result.lines++;
+            lineStart = lineEnd + 1;
+        }
+    }
+
+    // A chunk owns the lines that start inside [from, to). Those of a mapped file are decoded
+    // first, so only the chunks being scanned are ever held decoded.
+    void scanChunk(const SnapshotText& text, size_t from, size_t to, LinePattern& pattern,
+                   uint64_t generation, ChunkResult& result) {
+        size_t lineStart = from == 0 ? 0 : text.findNewline(from - 1) + 1;
+        if (!text.mapped || lineStart > text.length) {
+            scanLines(text, lineStart, to, pattern, generation, result);
+            return;
+        }
+        size_t end = to > text.length ? text.length : std::min(text.length, text.findNewline(to - 1) + 1);
+        pattern.chunkText.clear();
+        if (lineStart < end) text.copy(lineStart, end, pattern.chunkText);
+        scanLines(SnapshotText(pattern.chunkText, lineStart), lineStart, to, pattern, generation, result);
+    }
+
+    // One search: what to match, the snapshot it runs over and the chunks it is cut into
+    struct SearchJob {
+        HWND hwnd;
+        uint64_t generation;
+        TextSnapshot snapshot;
+        SubstringSearcher searcher;
+        std::shared_ptr<const RegexProgram> regex;
+        SearchOptions options;
+        std::vector<ScanRange> ranges;
+
+        SnapshotText text; // Filled in by the coordinator, with the rest
+        std::vector<ScanRange> chunks;
+        std::vector<ChunkResult> results;
+        std::atomic<size_t> nextChunk{0};
+        std::mutex doneMutex;
+        std::condition_variable chunkDone;
+
+        SearchJob(HWND hwnd, uint64_t generation, TextSnapshot snapshot, const std::wstring& query,
+                  std::shared_ptr<const RegexProgram> regex, SearchOptions options, std::vector<ScanRange> ranges)
+            : hwnd(hwnd), generation(generation), snapshot(std::move(snapshot)), searcher(query, options.ignoreCase),
+              regex(std::move(regex)), options(options), ranges(std::move(ranges)) {}
+    };
+
+    // The pool is started by the first search and kept for the next ones. The coordinator
+    // cuts the requested job into chunks and publishes it as the running one; the workers
+    // pick up each running job once and pull its chunks off a shared counter.
+    unsigned poolSize = 0; // Workers, all hardware threads unless SetSearchThreads says otherwise
+    std::vector<std::thread> pool;
+    std::mutex poolMutex;
+    std::condition_variable poolWake;
+    std::shared_ptr<SearchJob> requested;
+    std::shared_ptr<SearchJob> running;
+    bool stopping = false;
+
+    unsigned workerCount() {
+        unsigned threads = poolSize != 0 ? poolSize : std::thread::hardware_concurrency();
+        return std::max(1u, std::min(threads, MAX_THREADS));
+    }
+
+    // Ranges are cut into chunks; only the first chunk of a range knows its line number,
+    // the others carry on counting from the chunk before
+    void cutIntoChunks(SearchJob& job, unsigned threads) {
+        job.text = SnapshotText(job.snapshot);
+        if (job.ranges.empty()) {
+            job.ranges.push_back(ScanRange{0, job.text.length + 1, 0});
+        }
+        size_t total = 0;
+        for (const ScanRange& range : job.ranges) total += range.to - range.from;
+
+        size_t chunkSize = std::max(MIN_CHUNK, total / (threads * CHUNKS_PER_THREAD));
+        if (job.text.mapped) chunkSize = std::min(chunkSize, MAX_MAPPED_CHUNK);
+        for (const ScanRange& range : job.ranges) {
+            for (size_t from = range.from; from < range.to; from += chunkSize) {
+                job.chunks.push_back(ScanRange{from, std::min(range.to, from + chunkSize),
+                                               from == range.from ? range.firstLine : -1});
+            }
+        }
+        job.results.resize(job.chunks.size());
+    }
+
+    // Hands finished chunks to the UI in document order, until the job is done or cancelled
+    void deliverResults(SearchJob& job) {
+        size_t chunkCount = job.chunks.size();
+        int lineBase = 0;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            {
+                std::unique_lock<std::mutex> lock(job.doneMutex);
+                job.chunkDone.wait(lock, [&]() { return job.results[chunk].done; });
+            }
+            if (cancelled(job.generation)) break;
+
+            ChunkResult& result = job.results[chunk];
+            if (job.chunks[chunk].firstLine >= 0) {
+                lineBase = job.chunks[chunk].firstLine;
+            }
+            SearchBatch* batch = new SearchBatch{job.generation, std::move(result.occurrences), result.checked,
+                                                 chunk + 1 == chunkCount};
+            for (auto& occurrence : batch->occurrences) {
+                occurrence.line += lineBase;
+            }
+            lineBase += result.lines;
+            if (!PostMessage(job.hwnd, WM_SEARCH_RESULTS, 0, (LPARAM)batch)) {
+                delete batch; // The window is gone or its queue is full
+            }
+        }
+    }
+
+    void coordinate(unsigned threads) {
+        for (;;) {
+            std::shared_ptr<SearchJob> job;
+            {
+                std::unique_lock<std::mutex> lock(poolMutex);
+                poolWake.wait(lock, []() { return stopping || requested; });
+                if (stopping) return;
+                job = std::move(requested);
+            }
+            if (cancelled(job->generation)) continue;
+            cutIntoChunks(*job, threads);
+            {
+                std::lock_guard<std::mutex> lock(poolMutex);
+                if (stopping) return;
+                running = job;
+            }
+            poolWake.notify_all();
+            deliverResults(*job);
+            {
+                // Don't hold on to the snapshot once the search is over
+                std::lock_guard<std::mutex> lock(poolMutex);
+                if (running == job) running.reset();
+            }
+        }
+    }
+
+    // Nothing is locked while scanning, each worker fills the result slots of its own chunks.
+    // A published job is always drained before stopping, so the coordinator never waits for
+    // chunks nobody will scan.
+    void work() {
+        uint64_t seen = 0;
+        for (;;) {
+            std::shared_ptr<SearchJob> job;
+            {
+                std::unique_lock<std::mutex> lock(poolMutex);
+                poolWake.wait(lock, [&]() { return (running && running->generation != seen) || stopping; });
+                if (!running || running->generation == seen) return;
+                job = running;
+                seen = job->generation;
+            }
+            std::unique_ptr<RegexMatcher> matcher(job->regex ? new RegexMatcher(job->regex) : nullptr);
+            if (matcher) matcher->cancelWhenChanged(&currentGeneration, job->generation);
+            LinePattern pattern{job->regex ? nullptr : &job->searcher, matcher.get(), job->options.wholeWord};
+            size_t chunk;
+            while ((chunk = job->nextChunk.fetch_add(1)) < job->chunks.size()) {
+                scanChunk(job->text, job->chunks[chunk].from, job->chunks[chunk].to, pattern, job->generation,
+                          job->results[chunk]);
+                std::lock_guard<std::mutex> lock(job->doneMutex);
+                job->results[chunk].done = true;
+                job->chunkDone.notify_one();
+            }
+        }
+    }
+}
+
+uint64_t StartSearch(HWND hwnd, const std::wstring& query, std::shared_ptr<const RegexProgram> regex,
+                     SearchOptions options, std::vector<ScanRange> ranges) {
+    uint64_t generation = ++currentGeneration; // Cancels the scan in flight
+    auto job = std::make_shared<SearchJob>(hwnd, generation, textBuffer.snapshot(), query, std::move(regex),
+                                           options, std::move(ranges));
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (pool.empty()) {
+            unsigned threads = workerCount();
+            pool.emplace_back(coordinate, threads);
+            for (unsigned t = 0; t < threads; ++t) {
+                pool.emplace_back(work);
+            }
+        }
+        requested = std::move(job);
+    }
+    poolWake.notify_all();
+    return generation;
+}
+
+void CancelSearch() {
+    ++currentGeneration; // Workers check this between lines, and within long lines for a regex
+}
+
+void SetSearchThreads(unsigned threads) {
+    StopSearch();
+    poolSize = threads;
+}
+
+void StopSearch() {
+    ++currentGeneration;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+        requested.reset();
+    }
+    poolWake.notify_all();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    pool.clear();
+    running.reset();
+    stopping = false;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct RegexProgram;
+
+// Posted by the search worker as results come in, lParam owns a SearchBatch
+#define WM_SEARCH_RESULTS (WM_APP + 2)
+
+struct SearchMatch {
+    int line;
+    int col;
+    int length; // Regex matches vary, literal ones are the query's length
+};
+
+struct SearchBatch {
+    uint64_t generation;
+    std::vector<SearchMatch> occurrences; // In document order, overlapping literal ones included
+    size_t checked;  // Characters scanned since the previous batch
+    bool done;       // Last batch of the generation
+};
+
+// How the query is matched, the search box toggles. A regex folds case when it is
+// compiled, so only wholeWord applies to one.
+struct SearchOptions {
+    bool ignoreCase;
+    bool wholeWord;
+};
+
+// Document offsets [from, to) to scan, from at the start of line firstLine. The range owns
+// the lines that start inside it; to is one past the end of the text for the last line.
+struct ScanRange {
+    size_t from;
+    size_t to;
+    int firstLine;
+};
+
+// Scans a snapshot of textBuffer for query on a worker thread, cancelling any scan in
+// flight. Results stream back as WM_SEARCH_RESULTS tagged with the returned generation.
+// With a regex the query text is ignored and each line is matched against the program.
+// Only the given ranges are scanned, all of the text when there are none.
+// The threads are started by the first search and wait for the next one.
+uint64_t StartSearch(HWND hwnd, const std::wstring& query, std::shared_ptr<const RegexProgram> regex,
+                     SearchOptions options, std::vector<ScanRange> ranges);
+// Drops the scan in flight without waiting for it; a batch still posted for it carries
+// its old generation
+void CancelSearch();
+// Workers for the searches after this, 0 for one per hardware thread
+void SetSearchThreads(unsigned threads);
+// Cancels and joins every search thread, before the window goes away
+void StopSearch();
\ No newline at end of file
@@ -0,0 +1,153 @@
+#define NOMINMAX
+
+#include "spillFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const size_t IO_CHUNK = 64 * 1024 * 1024; // Bytes per ReadFile/WriteFile, they take a DWORD
+    const wchar_t* TEMP_PREFIX = L"und";      // GetTempFileNameW adds four hex digits and .tmp
+
+    std::wstring tempDirectory() {
+        wchar_t directory[MAX_PATH];
+        DWORD length = GetTempPathW(MAX_PATH, directory);
+        if (length == 0 || length > MAX_PATH) return L"";
+        return std::wstring(directory, length);
+    }
+
+    OVERLAPPED overlappedAt(uint64_t offset) {
+        OVERLAPPED at = {};
+        at.Offset = (DWORD)offset;
+        at.OffsetHigh = (DWORD)(offset >> 32);
+        return at;
+    }
+}
+
+SpillFile::~SpillFile() {
+    close();
+}
+
+bool SpillFile::open(const std::wstring& path, DWORD disposition) {
+    close();
+    file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, disposition,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        close();
+        return false;
+    }
+    filePath = path;
+    fileSize = (uint64_t)size.QuadPart;
+    return true;
+}
+
+bool SpillFile::create(const std::wstring& path) {
+    return open(path, CREATE_ALWAYS);
+}
+
+bool SpillFile::createTemp() {
+    std::wstring directory = tempDirectory();
+    wchar_t path[MAX_PATH];
+    if (directory.empty() || GetTempFileNameW(directory.c_str(), TEMP_PREFIX, 0, path) == 0) {
+        return false;
+    }
+    if (!open(path, CREATE_ALWAYS)) {
+        DeleteFileW(path);
+        return false;
+    }
+    return true;
+}
+
+// Files are opened exclusively, so one another editor is using can't be opened here
+void SpillFile::removeStaleTemps(const char* magic) {
+    std::wstring directory = tempDirectory();
+    if (directory.empty()) return;
+    WIN32_FIND_DATAW entry;
+    HANDLE search = FindFirstFileW((directory + TEMP_PREFIX + L"????.tmp").c_str(), &entry);
+    if (search == INVALID_HANDLE_VALUE) return;
+    do {
+        SpillFile file;
+        char start[4];
+        if (file.openExisting(directory + entry.cFileName) && file.size() >= sizeof(start) &&
+            file.read(0, start, sizeof(start)) && memcmp(start, magic, sizeof(start)) == 0) {
+            file.remove();
+        }
+    } while (FindNextFileW(search, &entry));
+    FindClose(search);
+}
+
+bool SpillFile::openExisting(const std::wstring& path) {
+    return open(path, OPEN_EXISTING);
+}
+
+void SpillFile::close() {
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+    fileSize = 0;
+}
+
+void SpillFile::remove() {
+    bool wasOpen = isOpen();
+    close();
+    if (wasOpen) {
+        DeleteFileW(filePath.c_str());
+    }
+    filePath.clear();
+}
+
+bool SpillFile::moveTo(const std::wstring& path) {
+    std::wstring from = filePath;
+    close();
+    if (MoveFileExW(from.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED)) {
+        return openExisting(path);
+    }
+    openExisting(from);
+    return false;
+}
+
+bool SpillFile::read(uint64_t offset, void* data, size_t bytes) const {
+    char* out = (char*)data;
+    while (bytes > 0) {
+        OVERLAPPED at = overlappedAt(offset);
+        DWORD done = 0;
+        if (!ReadFile(file, out, (DWORD)std::min(bytes, IO_CHUNK), &done, &at) || done == 0) {
+            return false;
+        }
+        out += done;
+        offset += done;
+        bytes -= done;
+    }
+    return true;
+}
+
+bool SpillFile::write(uint64_t offset, const void* data, size_t bytes) {
+    const char* in = (const char*)data;
+    while (bytes > 0) {
+        OVERLAPPED at = overlappedAt(offset);
+        DWORD done = 0;
+        if (!WriteFile(file, in, (DWORD)std::min(bytes, IO_CHUNK), &done, &at) || done == 0) {
+            return false;
+        }
+        in += done;
+        offset += done;
+        bytes -= done;
+        fileSize = std::max(fileSize, offset);
+    }
+    return true;
+}
+
+bool SpillFile::truncate(uint64_t size) {
+    LARGE_INTEGER at;
+    at.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(file, at, NULL, FILE_BEGIN) || !SetEndOfFile(file)) return false;
+    fileSize = size;
+    return true;
+}
+
+bool SpillFile::flush() {
+    return FlushFileBuffers(file) != 0;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <string>
+
+// A file read and written at explicit offsets, for data paged out of memory (undo history)
+// and the edit journal.
+// The handle is opened exclusively and closed with the object.
+class SpillFile {
+public:
+    SpillFile() = default;
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+    ~SpillFile();
+
+    bool create(const std::wstring& path);  // Empty file, replacing any already there
+    bool createTemp();                      // Empty file in the temp directory
+    // Deletes the temp files that start with magic and that no one has open, left by a crash
+    static void removeStaleTemps(const char* magic);
+    bool openExisting(const std::wstring& path);
+    void close();
+    void remove();                          // Closes and deletes it
+    bool moveTo(const std::wstring& path);  // Renames it, replacing any file already there
+
+    bool isOpen() const { return file != INVALID_HANDLE_VALUE; }
+    uint64_t size() const { return fileSize; }
+
+    bool read(uint64_t offset, void* data, size_t bytes) const;
+    bool write(uint64_t offset, const void* data, size_t bytes);
+    bool append(const void* data, size_t bytes) { return write(fileSize, data, bytes); }
+    bool truncate(uint64_t size);
+    bool flush();
+
+private:
+    HANDLE file = INVALID_HANDLE_VALUE;
+    std::wstring filePath;
+    uint64_t fileSize = 0;
+
+    bool open(const std::wstring& path, DWORD disposition);
+};
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "textEditorGlobals.h" 
 
 
-std::vector<std::wstring> textBuffer; 
+PieceTable textBuffer; 
 
 int caretLine = 0;
 int caretCol = 0;
@@ -16,6 +16,8 @@ int bufferZoneY = 2; //visible lines when scrolling back up
 int bufferZoneX = 50;//visible lines when deleting characters in a line
 
 std::wstring currentFilePath=L"";
+TextEncoding documentEncoding = TextEncoding::UTF8;
+LineEnding documentLineEnding = LineEnding::CRLF;
 bool documentModified = false;
 Selection selection;
 std::wstring selectedText;
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "resource.h"
+#include "pieceTable.h"
+#include "textEncoding.h"
 #include <vector>
 #include <string>
 
 
-// Global text buffer and stack
-extern std::vector<std::wstring> textBuffer;
+// Global text buffer (piece table, see pieceTable.h)
+extern PieceTable textBuffer;
 
 
 // Caret and scroll variables
@@ -22,6 +24,8 @@ extern int bufferZoneY;
 extern int bufferZoneX;
 
 extern std::wstring currentFilePath;
+extern TextEncoding documentEncoding;   // As found on load, written back on save
+extern LineEnding documentLineEnding;
 extern bool documentModified;
 
 struct Selection {
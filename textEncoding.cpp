@@ -0,0 +1,286 @@
+#define NOMINMAX
+
+#include "textEncoding.h"
+#include "charScan.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <cwchar> // For WCHAR_MAX
+
+#if WCHAR_MAX == 0xFFFF && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define TEXTENCODING_SSE2 1
+#endif
+
+namespace {
+    // MultiByteToWideChar takes int lengths, big files go through in chunks
+    const size_t DECODE_CHUNK = 16 * 1024 * 1024;
+
+    // Chunks end after a '\n' byte, which is never part of a UTF-8 sequence or a DBCS pair
+    size_t chunkEnd(const char* data, size_t size, UINT codePage) {
+        if (size <= DECODE_CHUNK) return size;
+        size_t end = DECODE_CHUNK;
+        while (end > 0 && data[end - 1] != '\n') end--;
+        if (end > 0) return end;
+        // No line break in the whole chunk, at least don't split a UTF-8 sequence
+        end = DECODE_CHUNK;
+        if (codePage == CP_UTF8) {
+            for (int back = 0; back < 3 && ((unsigned char)data[end] & 0xC0) == 0x80; ++back) end--;
+        }
+        return end;
+    }
+
+    bool decodeMultiByte(UINT codePage, DWORD flags, const char* data, size_t size, std::wstring& text) {
+        text.resize(size); // Never more UTF-16 units than input bytes
+        size_t in = 0;
+        size_t out = 0;
+        while (in < size) {
+            size_t chunk = chunkEnd(data + in, size - in, codePage);
+            int written = MultiByteToWideChar(codePage, flags, data + in, (int)chunk,
+                                              &text[out], (int)std::min(text.size() - out, (size_t)INT_MAX));
+            if (written == 0) return false;
+            in += chunk;
+            out += written;
+        }
+        text.resize(out);
+        return true;
+    }
+}
+
+TextEncoding DetectEncoding(const char* data, size_t size, size_t& bomLength) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    bomLength = 0;
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        bomLength = 3;
+        return TextEncoding::UTF8_BOM;
+    }
+    if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        bomLength = 2;
+        return TextEncoding::UTF16LE;
+    }
+    if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        bomLength = 2;
+        return TextEncoding::UTF16BE;
+    }
+
+    // Mostly-ASCII UTF-16 has a zero in every other byte, UTF-8 text has none
+    size_t sample = std::min(size, (size_t)4096) & ~(size_t)1;
+    size_t evenZeros = 0;
+    size_t oddZeros = 0;
+    for (size_t i = 0; i < sample; ++i) {
+        if (bytes[i] == 0) {
+            (i & 1 ? oddZeros : evenZeros)++;
+        }
+    }
+    size_t units = sample / 2;
+    if (units > 0 && oddZeros * 5 > units * 2 && evenZeros * 10 < units) return TextEncoding::UTF16LE;
+    if (units > 0 && evenZeros * 5 > units * 2 && oddZeros * 10 < units) return TextEncoding::UTF16BE;
+    return TextEncoding::UTF8;
+}
+
+TextEncoding DecodeText(const char* data, size_t size, TextEncoding encoding, std::wstring& text) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    switch (encoding) {
+        case TextEncoding::UTF16LE:
+        case TextEncoding::UTF16BE: {
+            int high = encoding == TextEncoding::UTF16BE ? 0 : 1;
+            text.resize(size / 2); // A trailing odd byte is dropped
+            for (size_t i = 0; i < text.size(); ++i) {
+                text[i] = (wchar_t)(bytes[2 * i + 1 - high] | (bytes[2 * i + high] << 8));
+            }
+            return encoding;
+        }
+        case TextEncoding::ANSI:
+            decodeMultiByte(CP_ACP, 0, data, size, text);
+            return encoding;
+        default:
+            if (decodeMultiByte(CP_UTF8, MB_ERR_INVALID_CHARS, data, size, text)) {
+                return encoding;
+            }
+            decodeMultiByte(CP_ACP, 0, data, size, text);
+            return TextEncoding::ANSI;
+    }
+}
+
+LineEnding NormalizeLineEndings(std::wstring& text) {
+    size_t size = text.size();
+    size_t in = FindChar(text.data(), size, L'\r');
+    if (in == size) return LineEnding::LF; // The common case, nothing to move
+
+    // Compact in place, copying the runs between carriage returns
+    wchar_t* data = &text[0];
+    size_t out = in;
+    size_t crlfCount = 0;
+    while (in < size) {
+        if (in + 1 < size && data[in + 1] == L'\n') {
+            in++; // Drop the \r, lone ones are kept
+            crlfCount++;
+        }
+        size_t next = in + 1 + FindChar(data + in + 1, size - in - 1, L'\r');
+        std::memmove(data + out, data + in, (next - in) * sizeof(wchar_t));
+        out += next - in;
+        in = next;
+    }
+    text.resize(out);
+
+    size_t lineBreaks = CountChar(text.data(), text.size(), L'\n');
+    return crlfCount * 2 >= lineBreaks ? LineEnding::CRLF : LineEnding::LF;
+}
+
+namespace {
+    bool isHighSurrogate(unsigned c) { return c >= 0xD800 && c <= 0xDBFF; }
+    bool isLowSurrogate(unsigned c) { return c >= 0xDC00 && c <= 0xDFFF; }
+
+    unsigned char* putUtf8(unsigned char* dst, unsigned codePoint) {
+        if (codePoint < 0x80) {
+            *dst++ = (unsigned char)codePoint;
+        } else if (codePoint < 0x800) {
+            *dst++ = (unsigned char)(0xC0 | (codePoint >> 6));
+            *dst++ = (unsigned char)(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            *dst++ = (unsigned char)(0xE0 | (codePoint >> 12));
+            *dst++ = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+            *dst++ = (unsigned char)(0x80 | (codePoint & 0x3F));
+        } else {
+            *dst++ = (unsigned char)(0xF0 | (codePoint >> 18));
+            *dst++ = (unsigned char)(0x80 | ((codePoint >> 12) & 0x3F));
+            *dst++ = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+            *dst++ = (unsigned char)(0x80 | (codePoint & 0x3F));
+        }
+        return dst;
+    }
+
+    const unsigned REPLACEMENT_CHAR = 0xFFFD; // For unpaired surrogates
+}
+
+TextEncoder::TextEncoder(TextEncoding encoding, LineEnding lineEnding)
+    : encoding(encoding), lineEnding(lineEnding), pendingHigh(0) {}
+
+void TextEncoder::writeBom(std::string& out) const {
+    switch (encoding) {
+        case TextEncoding::UTF8_BOM: out.append("\xEF\xBB\xBF"); break;
+        case TextEncoding::UTF16LE:  out.append("\xFF\xFE"); break;
+        case TextEncoding::UTF16BE:  out.append("\xFE\xFF"); break;
+        default: break;
+    }
+}
+
+void TextEncoder::encode(const wchar_t* text, size_t count, std::string& out) {
+    switch (encoding) {
+        case TextEncoding::UTF16LE:
+        case TextEncoding::UTF16BE: encodeUtf16(text, count, out); break;
+        case TextEncoding::ANSI:    encodeAnsi(text, count, out); break;
+        default:                    encodeUtf8(text, count, out); break;
+    }
+}
+
+void TextEncoder::finish(std::string& out) {
+    if (pendingHigh != 0) {
+        unsigned char bytes[4];
+        out.append((const char*)bytes, putUtf8(bytes, REPLACEMENT_CHAR) - bytes);
+        pendingHigh = 0;
+    }
+}
+
+void TextEncoder::encodeUtf8(const wchar_t* text, size_t count, std::string& out) {
+    if (count == 0) return;
+    // Worst case is 3 bytes per unit, plus a pair completed from the last batch
+    size_t base = out.size();
+    out.resize(base + count * 3 + 4);
+    unsigned char* start = (unsigned char*)&out[base];
+    unsigned char* dst = start;
+    bool crlf = lineEnding == LineEnding::CRLF;
+
+    size_t i = 0;
+    if (pendingHigh != 0) {
+        if (count > 0 && isLowSurrogate(text[0])) {
+            dst = putUtf8(dst, 0x10000 + ((pendingHigh - 0xD800) << 10) + (text[0] - 0xDC00));
+            i = 1;
+        } else {
+            dst = putUtf8(dst, REPLACEMENT_CHAR);
+        }
+        pendingHigh = 0;
+    }
+
+    while (i < count) {
+#ifdef TEXTENCODING_SSE2
+        if (i + 8 <= count) {
+            // Eight ASCII units (and no \n to expand) narrow straight to eight bytes
+            __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+            __m128i high = _mm_and_si128(block, _mm_set1_epi16((short)0xFF80));
+            int ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128()));
+            if (crlf) {
+                ascii &= ~_mm_movemask_epi8(_mm_cmpeq_epi16(block, _mm_set1_epi16(L'\n')));
+            }
+            if (ascii == 0xFFFF) {
+                _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(block, block));
+                dst += 8;
+                i += 8;
+                continue;
+            }
+        }
+#endif
+        unsigned c = text[i];
+        if (c == L'\n' && crlf) {
+            *dst++ = '\r';
+            *dst++ = '\n';
+            i++;
+        } else if (isHighSurrogate(c)) {
+            if (i + 1 == count) {
+                pendingHigh = (wchar_t)c; // Completed by the next batch
+                i++;
+            } else if (isLowSurrogate(text[i + 1])) {
+                dst = putUtf8(dst, 0x10000 + ((c - 0xD800) << 10) + (text[i + 1] - 0xDC00));
+                i += 2;
+            } else {
+                dst = putUtf8(dst, REPLACEMENT_CHAR);
+                i++;
+            }
+        } else {
+            dst = putUtf8(dst, isLowSurrogate(c) ? REPLACEMENT_CHAR : c);
+            i++;
+        }
+    }
+    out.resize(base + (dst - start));
+}
+
+void TextEncoder::encodeUtf16(const wchar_t* text, size_t count, std::string& out) const {
+    bool crlf = lineEnding == LineEnding::CRLF;
+    int high = encoding == TextEncoding::UTF16BE ? 0 : 1;
+    size_t base = out.size();
+    out.resize(base + count * 4);
+    char* dst = &out[base];
+    for (size_t i = 0; i < count; ++i) {
+        if (text[i] == L'\n' && crlf) {
+            dst[1 - high] = '\r';
+            dst[high] = 0;
+            dst += 2;
+        }
+        dst[1 - high] = (char)(text[i] & 0xFF);
+        dst[high] = (char)((text[i] >> 8) & 0xFF);
+        dst += 2;
+    }
+    out.resize(dst - out.data());
+}
+
+// Pairs split between batches come out as two '?', which is what the code page gives a pair anyway
+void TextEncoder::encodeAnsi(const wchar_t* text, size_t count, std::string& out) const {
+    bool crlf = lineEnding == LineEnding::CRLF;
+    size_t i = 0;
+    while (i < count) {
+        size_t lineEnd = i + FindChar(text + i, count - i, L'\n');
+        if (lineEnd > i) {
+            int length = (int)(lineEnd - i);
+            int bytes = WideCharToMultiByte(CP_ACP, 0, text + i, length, NULL, 0, NULL, NULL);
+            size_t base = out.size();
+            out.resize(base + bytes);
+            WideCharToMultiByte(CP_ACP, 0, text + i, length, &out[base], bytes, NULL, NULL);
+        }
+        if (lineEnd < count) {
+            out.append(crlf ? "\r\n" : "\n");
+        }
+        i = lineEnd + 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// File bytes <-> document text.
+// The document always holds UTF-16 with bare L'\n' line breaks; the encoding and
+// line-ending style found on load are remembered so a save can write them back.
+
+enum class TextEncoding {
+    UTF8,
+    UTF8_BOM,
+    UTF16LE,
+    UTF16BE,
+    ANSI      // Not valid UTF-8 and no BOM, decoded with the system code page
+};
+
+enum class LineEnding {
+    LF,
+    CRLF
+};
+
+// Looks at the BOM, or failing that guesses UTF-16 from the zero bytes of the first few KB
+TextEncoding DetectEncoding(const char* data, size_t size, size_t& bomLength);
+// Decodes into text with a single allocation; UTF8 falls back to ANSI if the bytes aren't valid
+TextEncoding DecodeText(const char* data, size_t size, TextEncoding encoding, std::wstring& text);
+// Turns every \r\n into \n in place, returning the style the text used
+LineEnding NormalizeLineEndings(std::wstring& text);
+
+// Streams document text back out as file bytes, the reverse of DecodeText and
+// NormalizeLineEndings. Text is fed in batches; UTF-8 goes through a hand-rolled
+// transcoder that copies plain ASCII eight units at a time.
+class TextEncoder {
+public:
+    TextEncoder(TextEncoding encoding, LineEnding lineEnding);
+
+    void writeBom(std::string& out) const;
+    // Appends the bytes for text to out; a surrogate pair split between batches is held back
+    void encode(const wchar_t* text, size_t count, std::string& out);
+    void finish(std::string& out);
+
+private:
+    TextEncoding encoding;
+    LineEnding lineEnding;
+    wchar_t pendingHigh;    // High surrogate that ended the previous batch
+
+    void encodeUtf8(const wchar_t* text, size_t count, std::string& out);
+    void encodeUtf16(const wchar_t* text, size_t count, std::string& out) const;
+    void encodeAnsi(const wchar_t* text, size_t count, std::string& out) const;
+};
\ No newline at end of file
@@ -2,8 +2,10 @@
 
 #include "TextMetrics.h" 
 #include "TextEditorGlobals.h" // For textBuffer and maxLineWidthPixels
+#include "glyphAdvances.h"
 
 #include <algorithm> 
+#include <climits>
 #include <vector>    
 HFONT font = NULL; 
 TEXTMETRICW textMetrics;
@@ -11,7 +13,67 @@ int charWidth = 0;
 int charHeight = 0;      
 int linesPerPage = 0;    
 int maxCharWidth = 0;  
-void calcTextMetrics(HWND hwnd){
+int clientWidth = 0;
+bool fixedPitch = true;
+LineWidths lineWidths;
+// A file read in place has too many lines to measure them all, so its width is estimated
+// from its longest line and only ever raised by the lines edits touch
+static int mappedLineWidth = 0;
+
+// Memory DC with the editor font selected, so measuring doesn't need a GetDC round-trip
+HDC measureDC = NULL;
+HFONT measureFont = NULL;
+
+HDC getMeasureDC() {
+    if (measureDC == NULL) {
+        measureDC = CreateCompatibleDC(NULL);
+    }
+    if (measureFont != font) {
+        SelectObject(measureDC, font);
+        measureFont = font;
+    }
+    return measureDC;
+}
+
+void releaseMeasureDC() {
+    if (measureDC != NULL) {
+        DeleteDC(measureDC);
+        measureDC = NULL;
+        measureFont = NULL;
+    }
+}
+
+int measureLine(size_t line) {
+    if (fixedPitch) {
+        return (int)textBuffer.lineLength(line) * charWidth; // As caretXFromColumn places the caret
+    }
+    static std::wstring text; // Kept between calls, so measuring a typed-in line doesn't allocate
+    textBuffer.getLine(line, text);
+    SIZE size;
+    GetTextExtentPoint32W(getMeasureDC(), text.c_str(), text.length(), &size);
+    return size.cx;
+}
+
+// Widths of count lines from first on. With a fixed pitch font the line starts come from
+// one walk of the piece table rather than a lineLength lookup per line.
+static void measureLines(size_t first, size_t count, int* widths) {
+    if (!fixedPitch) {
+        for (size_t i = 0; i < count; ++i) widths[i] = measureLine(first + i);
+        return;
+    }
+    static std::vector<size_t> starts; // Reused, one edit after another
+    textBuffer.lineStarts(first, count + 1, starts);
+    starts.resize(count + 1, textBuffer.length() + 1); // The last line ends with the text
+    for (size_t i = 0; i < count; ++i) {
+        widths[i] = (int)(starts[i + 1] - 1 - starts[i]) * charWidth;
+    }
+}
+
+void refreshMaxLineWidth() {
+    maxLineWidthPixels = std::max({lineWidths.maxWidth(), mappedLineWidth, clientWidth}); // Ensure at least client width
+}
+
+void calcFontMetrics(HWND hwnd){
     HDC hdc = GetDC(hwnd);
 
     // Create or get a font. Planning on adding custom fonts
@@ -34,6 +96,8 @@ void calcTextMetrics(HWND hwnd){
     charWidth = textMetrics.tmAveCharWidth;
     charHeight = textMetrics.tmHeight + textMetrics.tmExternalLeading;
     maxCharWidth = textMetrics.tmMaxCharWidth;
+    // TMPF_FIXED_PITCH is set for variable pitch fonts (the name is backwards)
+    fixedPitch = !(textMetrics.tmPitchAndFamily & TMPF_FIXED_PITCH) && charWidth == maxCharWidth;
     
     RECT clientRect;
     GetClientRect(hwnd, &clientRect);
@@ -45,17 +109,62 @@ void calcTextMetrics(HWND hwnd){
     }
     // Ensure at least one line is always shown
     if (linesPerPage == 0) {linesPerPage = 1;}
-    maxLineWidthPixels = 0;
-    SIZE size;
-    for (const auto& line : textBuffer) {
-        GetTextExtentPoint32W(hdc, line.c_str(), line.length(), &size);
-        if (size.cx > maxLineWidthPixels) {
-            maxLineWidthPixels = size.cx;
-        }
-    }
-    maxLineWidthPixels = std::max(maxLineWidthPixels, (int)clientRect.right); // Ensure at least client width
+    clientWidth = clientRect.right;
+    refreshMaxLineWidth();
     // Select the old font back into the device context
     SelectObject(hdc, hOldFont);
 
     ReleaseDC(hwnd, hdc); // Release the device context
+}
+
+void measureAllLines() {
+    clearGlyphAdvances();
+    if (const MappedText* mapped = textBuffer.mappedOriginal()) {
+        lineWidths.assign({});
+        double estimate = (double)mapped->longestLine() * (fixedPitch ? charWidth : maxCharWidth);
+        mappedLineWidth = (int)std::min(estimate, (double)(INT_MAX / 2));
+        refreshMaxLineWidth();
+        return;
+    }
+    mappedLineWidth = 0;
+    std::vector<int> widths(textBuffer.lineCount());
+    measureLines(0, widths.size(), widths.data());
+    lineWidths.assign(widths);
+    refreshMaxLineWidth();
+}
+
+void updateLineWidths(int line, int removedLines, int insertedLines) {
+    if (textBuffer.mappedOriginal()) {
+        for (int i = 0; i <= insertedLines; ++i) {
+            mappedLineWidth = std::max(mappedLineWidth, measureLine(line + i));
+        }
+        refreshMaxLineWidth();
+        return;
+    }
+    if (removedLines > insertedLines) {
+        lineWidths.eraseLines(line + 1, removedLines - insertedLines);
+    }
+    int addedLines = std::max(0, insertedLines - removedLines);
+    if (lineWidths.size() + addedLines != textBuffer.lineCount()) {
+        measureAllLines(); // Out of step with the buffer, start over
+        return;
+    }
+    // Only the touched lines are measured again. More than one goes back in as a single
+    // block, so a replace across a million lines doesn't split the tree once per line.
+    int keptLines = std::min(removedLines, insertedLines);
+    if (keptLines == 0 && addedLines == 0) {
+        lineWidths.set(line, measureLine(line)); // Typing
+    } else {
+        static std::vector<int> widths; // Reused, one edit after another
+        widths.resize(keptLines + 1 + addedLines);
+        measureLines(line, widths.size(), widths.data());
+        lineWidths.eraseLines(line, keptLines + 1);
+        lineWidths.insertLines(line, widths.data(), widths.size());
+    }
+    refreshMaxLineWidth();
+}
+
+void calcTextMetrics(HWND hwnd){
+    calcFontMetrics(hwnd);
+    measureAllLines();
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <windows.h> 
+#include "lineWidths.h"
 
 // Global font and metrics variables
 extern HFONT font; 
@@ -9,6 +10,17 @@ extern int charWidth;
 extern int charHeight;
 extern int linesPerPage;
 extern int maxCharWidth; // Max char width (useful for monospace, not used in code)
+extern int clientWidth;
+extern bool fixedPitch; // Every glyph advances charWidth
+extern LineWidths lineWidths; // Pixel width of every line, kept in step with edits
 
-// Function to calculate and update text metrics
-void calcTextMetrics(HWND hwnd);
\ No newline at end of file
+// Font metrics plus a full measurement of every line (startup, load, new document)
+void calcTextMetrics(HWND hwnd);
+// Font and page metrics only, line widths are left alone (resize)
+void calcFontMetrics(HWND hwnd);
+void measureAllLines();
+// Lines [line, line + removedLines] were replaced by [line, line + insertedLines]
+void updateLineWidths(int line, int removedLines, int insertedLines);
+// Memory DC with the editor font selected, for measuring outside WM_PAINT
+HDC getMeasureDC();
+void releaseMeasureDC();
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "trigramIndex.h"
+#include "textEditorGlobals.h" // For textBuffer
+#include "charScan.h"          // For FoldCase
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace {
+    // Smaller documents are searched in full quickly enough
+    const size_t INDEX_MIN_CHARS = 4 * 1024 * 1024;
+    // A block is closed at the first line end past this many characters
+    const size_t BLOCK_CHARS = 1024;
+    // An edited block is re-indexed as one block until it grows past this, so typing rewrites
+    // it in place instead of shifting every block after it
+    const size_t BLOCK_SPLIT_CHARS = 8 * BLOCK_CHARS;
+    // An edit over more lines of text than this is indexed again on a worker, like the first build
+    const size_t REBUILD_EDIT_CHARS = 1024 * 1024;
+    // Blocks emptied by deletions keep their place with no lines until they are this share
+    const size_t EMPTY_BLOCK_DIVISOR = 8;
+    // 4096 signature bits, so a full block sets around a fifth of them
+    const int SIGNATURE_WORDS = 64;
+    const int SIGNATURE_SHIFT = 64 - 12;
+
+    struct TrigramBlock {
+        int lines;
+        bool dirty; // Edited before its signature was rebuilt, searched unconditionally
+        uint64_t bits[SIGNATURE_WORDS];
+    };
+
+    struct IndexResult {
+        uint64_t generation;
+        std::vector<TrigramBlock> blocks;
+        double millis;
+    };
+
+    struct LineEdit {
+        int line;
+        int removedLines;
+        int insertedLines;
+    };
+
+    std::vector<TrigramBlock> blocks;
+    std::vector<int> lineTree; // Fenwick tree over the blocks' line counts
+    size_t emptyBlocks = 0;
+    std::vector<TrigramBlock> freshBlocks; // applyEdit's scratch, kept between edits
+    std::wstring lineText;
+    bool indexReady = false;
+    bool indexBuilding = false;
+    double buildMillis = 0;
+    std::vector<LineEdit> pendingEdits; // Made while the build was running, replayed when it lands
+    std::atomic<uint64_t> buildGeneration{0};
+    std::thread buildThread;
+    HWND indexWindow = NULL; // Where builds post, a rebuild after a large edit included
+
+    inline unsigned trigramBit(wchar_t a, wchar_t b, wchar_t c) {
+        uint64_t key = ((uint64_t)(uint16_t)a << 32) | ((uint64_t)(uint16_t)b << 16) | (uint16_t)c;
+        return (unsigned)((key * 0x9E3779B97F4A7C15ull) >> SIGNATURE_SHIFT);
+    }
+
+    // Takes text one unit at a time and cuts it into blocks of whole lines
+    struct BlockBuilder {
+        std::vector<TrigramBlock>& out;
+        TrigramBlock current{};
+        size_t chars = 0;
+        size_t lineUnits = 0;
+        wchar_t prev1 = 0;
+        wchar_t prev2 = 0;
+
+        explicit BlockBuilder(std::vector<TrigramBlock>& out) : out(out) {}
+
+        void put(wchar_t ch) {
+            if (ch == L'\n') {
+                endLine();
+                return;
+            }
+            ch = FoldCase(ch); // The same index serves case-insensitive queries
+            if (lineUnits >= 2) {
+                unsigned bit = trigramBit(prev2, prev1, ch);
+                current.bits[bit >> 6] |= 1ull << (bit & 63);
+            }
+            prev2 = prev1;
+            prev1 = ch;
+            lineUnits++;
+            chars++;
+        }
+
+        void endLine() {
+            current.lines++;
+            chars++;
+            lineUnits = 0;
+            if (chars >= BLOCK_CHARS) flush();
+        }
+
+        void flush() {
+            if (current.lines > 0) out.push_back(current);
+            current = TrigramBlock{};
+            chars = 0;
+        }
+    };
+
+    // Fresh blocks for count lines of textBuffer from firstLine, returns the characters read
+    size_t indexLines(int firstLine, int count, std::vector<TrigramBlock>& out) {
+        BlockBuilder builder(out);
+        size_t chars = 0;
+        for (int line = firstLine; line < firstLine + count; ++line) {
+            textBuffer.getLine(line, lineText);
+            for (wchar_t ch : lineText) builder.put(ch);
+            builder.endLine();
+            chars += lineText.length() + 1;
+        }
+        builder.flush();
+        return chars;
+    }
+
+    // Characters in count lines from firstLine, line breaks included
+    size_t lineChars(int firstLine, int count) {
+        size_t end = firstLine + count < (int)textBuffer.lineCount() ? textBuffer.lineStart(firstLine + count)
+                                                                     : textBuffer.length();
+        return end - textBuffer.lineStart(firstLine);
+    }
+
+    // After any change to which blocks there are, O(n)
+    void rebuildLineTree() {
+        lineTree.assign(blocks.size() + 1, 0);
+        for (size_t i = 1; i <= blocks.size(); ++i) {
+            lineTree[i] += blocks[i - 1].lines;
+            size_t parent = i + (i & (0 - i));
+            if (parent <= blocks.size()) lineTree[parent] += lineTree[i];
+        }
+    }
+
+    void setBlockLines(size_t b, int lines) {
+        int delta = lines - blocks[b].lines;
+        blocks[b].lines = lines;
+        for (size_t i = b + 1; i < lineTree.size(); i += i & (0 - i)) lineTree[i] += delta;
+    }
+
+    // The block holding line and the line it starts at, O(log n). Empty blocks hold no line,
+    // so they are never the answer.
+    size_t blockAt(int line, int& firstLine) {
+        size_t at = 0;
+        int before = 0;
+        size_t step = 1;
+        while (step * 2 < lineTree.size()) step *= 2;
+        for (; step > 0; step /= 2) {
+            if (at + step < lineTree.size() && before + lineTree[at + step] <= line) {
+                at += step;
+                before += lineTree[at];
+            }
+        }
+        if (at >= blocks.size()) { // Past the end, the last block with lines takes it
+            at = blocks.size() - 1;
+            while (at > 0 && blocks[at].lines == 0) at--;
+            before -= blocks[at].lines;
+        }
+        firstLine = before;
+        return at;
+    }
+
+    void dropEmptyBlocks() {
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                    [](const TrigramBlock& block) { return block.lines == 0; }),
+                     blocks.end());
+        emptyBlocks = 0;
+        rebuildLineTree();
+    }
+
+    // Lines that went away come out of the block holding line and those after it. Those
+    // blocks keep their old bits, which only costs false positives, and stay in place when
+    // emptied until there are enough to drop in one pass. The block holding the edited lines
+    // has new text, so it is re-indexed now or marked dirty for later.
+    void applyEdit(const LineEdit& edit, bool reindex) {
+        if (blocks.empty()) return;
+        int firstLine;
+        size_t b = blockAt(edit.line, firstLine);
+
+        int remaining = edit.removedLines;
+        int take = std::min(remaining, std::max(0, firstLine + blocks[b].lines - edit.line - 1));
+        setBlockLines(b, blocks[b].lines - take + edit.insertedLines);
+        remaining -= take;
+        for (size_t next = b + 1; remaining > 0 && next < blocks.size(); ++next) {
+            take = std::min(remaining, blocks[next].lines);
+            if (take == 0) continue;
+            setBlockLines(next, blocks[next].lines - take);
+            if (blocks[next].lines == 0) emptyBlocks++;
+            remaining -= take;
+        }
+
+        if (!reindex) {
+            blocks[b].dirty = true;
+        } else {
+            // Lines never share trigrams, so the fresh blocks' bits together are the block's
+            freshBlocks.clear();
+            size_t chars = indexLines(firstLine, blocks[b].lines, freshBlocks);
+            if (freshBlocks.size() == 1 || chars <= BLOCK_SPLIT_CHARS) {
+                TrigramBlock& block = blocks[b];
+                std::fill(std::begin(block.bits), std::end(block.bits), 0);
+                block.dirty = false;
+                for (const TrigramBlock& fresh : freshBlocks) {
+                    for (int w = 0; w < SIGNATURE_WORDS; ++w) block.bits[w] |= fresh.bits[w];
+                }
+            } else {
+                blocks.erase(blocks.begin() + b);
+                blocks.insert(blocks.begin() + b, freshBlocks.begin(), freshBlocks.end());
+                rebuildLineTree();
+            }
+        }
+        if (emptyBlocks * EMPTY_BLOCK_DIVISOR > blocks.size()) {
+            dropEmptyBlocks();
+        }
+    }
+
+    void reindexDirtyBlocks() {
+        std::vector<TrigramBlock> rebuilt;
+        rebuilt.reserve(blocks.size());
+        int firstLine = 0;
+        for (const TrigramBlock& block : blocks) {
+            if (block.dirty) {
+                indexLines(firstLine, block.lines, rebuilt);
+            } else if (block.lines > 0) {
+                rebuilt.push_back(block);
+            }
+            firstLine += block.lines;
+        }
+        blocks.swap(rebuilt);
+        emptyBlocks = 0;
+        rebuildLineTree();
+    }
+}
+
+void StartTrigramIndex(HWND hwnd) {
+    CancelTrigramIndex();
+    indexWindow = hwnd;
+    if (textBuffer.length() < INDEX_MIN_CHARS) return;
+
+    indexBuilding = true;
+    uint64_t generation = ++buildGeneration;
+    buildThread = std::thread([hwnd, snapshot = textBuffer.snapshot(), generation]() {
+        LARGE_INTEGER started, finished, frequency;
+        QueryPerformanceCounter(&started);
+        std::unique_ptr<IndexResult> result(new IndexResult{generation});
+        BlockBuilder builder(result->blocks);
+        bool cancelled = false;
+        snapshot.forEachRun([&](const wchar_t* text, size_t count) {
+            for (size_t i = 0; i < count && !cancelled; ++i) {
+                builder.put(text[i]);
+                if ((i & 0xFFFFF) == 0 && buildGeneration.load(std::memory_order_relaxed) != generation) {
+                    cancelled = true;
+                }
+            }
+        });
+        if (cancelled) return;
+        builder.endLine(); // The last line has no line break after it
+        builder.flush();
+
+        QueryPerformanceCounter(&finished);
+        QueryPerformanceFrequency(&frequency);
+        result->millis = (finished.QuadPart - started.QuadPart) * 1000.0 / frequency.QuadPart;
+        PostMessage(hwnd, WM_INDEX_READY, 0, (LPARAM)result.release());
+    });
+}
+
+void CancelTrigramIndex() {
+    ++buildGeneration;
+    if (buildThread.joinable()) {
+        buildThread.join();
+    }
+    blocks.clear();
+    blocks.shrink_to_fit();
+    lineTree.clear();
+    lineTree.shrink_to_fit();
+    emptyBlocks = 0;
+    pendingEdits.clear();
+    indexReady = false;
+    indexBuilding = false;
+    buildMillis = 0;
+}
+
+// The build saw the document as it was when it started, so the edits made since are
+// replayed on top and the blocks they touched re-indexed from the current text
+void FinishTrigramIndex(HWND hwnd, LPARAM lParam) {
+    std::unique_ptr<IndexResult> result((IndexResult*)lParam);
+    if (!indexBuilding || result->generation != buildGeneration) return;
+
+    blocks.swap(result->blocks);
+    rebuildLineTree();
+    for (const LineEdit& edit : pendingEdits) {
+        applyEdit(edit, false);
+    }
+    pendingEdits.clear();
+    reindexDirtyBlocks();
+    blocks.shrink_to_fit(); // Built by push_back, up to half of it is slack
+    indexBuilding = false;
+    indexReady = true;
+    buildMillis = result->millis;
+}
+
+// A replace-all across the document would re-index most of it on the UI thread, so one
+// that large starts a fresh build instead, and searches scan in full until it lands
+void TrigramLinesChanged(int line, int removedLines, int insertedLines) {
+    if ((indexReady || indexBuilding) && lineChars(line, insertedLines + 1) > REBUILD_EDIT_CHARS) {
+        StartTrigramIndex(indexWindow);
+    } else if (indexReady) {
+        applyEdit(LineEdit{line, removedLines, insertedLines}, true);
+    } else if (indexBuilding) {
+        pendingEdits.push_back(LineEdit{line, removedLines, insertedLines});
+    }
+}
+
+bool TrigramCandidateLines(const std::wstring& query, std::vector<std::pair<int, int>>& spans) {
+    if (!indexReady || query.length() < 3) return false;
+
+    std::vector<unsigned> needed;
+    for (size_t i = 0; i + 2 < query.length(); ++i) {
+        needed.push_back(trigramBit(FoldCase(query[i]), FoldCase(query[i + 1]), FoldCase(query[i + 2])));
+    }
+    std::sort(needed.begin(), needed.end());
+    needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+    int firstLine = 0;
+    for (const TrigramBlock& block : blocks) {
+        if (block.lines == 0) continue;
+        bool candidate = block.dirty || std::all_of(needed.begin(), needed.end(), [&](unsigned bit) {
+            return (block.bits[bit >> 6] >> (bit & 63)) & 1;
+        });
+        if (candidate) {
+            if (!spans.empty() && spans.back().first + spans.back().second == firstLine) {
+                spans.back().second += block.lines;
+            } else {
+                spans.emplace_back(firstLine, block.lines);
+            }
+        }
+        firstLine += block.lines;
+    }
+    return true;
+}
+
+size_t TrigramIndexBytes() {
+    return blocks.capacity() * sizeof(TrigramBlock) + lineTree.capacity() * sizeof(int);
+}
+
+double TrigramIndexMillis() {
+    return buildMillis;
+}
\ No newline at end of file
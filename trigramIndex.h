@@ -0,0 +1,28 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Posted when a background index build finishes, lParam owns the result (see FinishTrigramIndex)
+#define WM_INDEX_READY (WM_APP + 3)
+
+// Large documents get an index of the case-folded trigrams in each block of lines, so a
+// literal search only scans the blocks that hold every trigram of the query. Each block
+// keeps a fixed-size signature rather than posting lists, which bounds memory to a fraction
+// of the text and lets an edit rebuild just the block it lands in.
+
+// Builds the index for textBuffer on a worker thread; documents under the size threshold get none
+void StartTrigramIndex(HWND hwnd);
+// Drops the index and stops a build in flight (new document, exit)
+void CancelTrigramIndex();
+void FinishTrigramIndex(HWND hwnd, LPARAM lParam); // WM_INDEX_READY
+void TrigramLinesChanged(int line, int removedLines, int insertedLines); // From LinesChanged
+
+// Runs of lines, as (first line, line count), that may hold query. False when there is
+// no index or the query is too short to use it, and every line has to be searched.
+bool TrigramCandidateLines(const std::wstring& query, std::vector<std::pair<int, int>>& spans);
+
+size_t TrigramIndexBytes();   // Zero when there is no index
+double TrigramIndexMillis();  // How long the build took
\ No newline at end of file
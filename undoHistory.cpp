@@ -0,0 +1,667 @@
+#define NOMINMAX
+
+#include "undoHistory.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+    const size_t MIN_RECORDS = 256;
+    const size_t MIN_ARENA_BYTES = 64 * 1024;
+    const size_t MIN_OPEN_UNITS = 64;
+    // Payloads start on span boundaries; spans come first so nothing inside needs padding
+    const size_t PAYLOAD_ALIGN = alignof(ReplacedSpan);
+    // Spilled nodes are found from the offset of every GROUP_NODES-th one, so the index
+    // kept in memory is 8 bytes a group
+    const uint64_t GROUP_NODES = 256;
+    const uint32_t SPILL_VERSION = 2;
+    // A side file at least this big is compacted when more than half its nodes are dead
+    const uint64_t COMPACT_MIN_BYTES = 16 * 1024 * 1024;
+    const uint64_t UNKNOWN_NODE = UINT64_MAX;
+
+    size_t alignUp(size_t bytes) {
+        return (bytes + PAYLOAD_ALIGN - 1) & ~(PAYLOAD_ALIGN - 1);
+    }
+
+    // Start of the side file. clean is cleared while a history is attached, so a file
+    // left behind by a crash isn't trusted.
+    struct SpillHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t clean;
+        uint32_t recordBytes; // Guards against a file written by another build
+        uint64_t nodeCount;
+        uint64_t savedNode;
+        uint64_t savedHash;
+        uint64_t rootNewestChild;
+        uint64_t rootSelectedChild;
+        uint64_t indexOffset; // groupOffsets, at the end of the file
+        uint64_t groupCount;
+    };
+}
+
+UndoHistory::UndoHistory(size_t budgetBytes) : budgetBytes(budgetBytes) {}
+
+void UndoHistory::attach(const std::wstring& path, uint64_t textHash) {
+    detach();
+    spillPath = path;
+    savedHash = textHash;
+    if (path.empty()) return;
+    DeleteFileW((path + L".new").c_str()); // A compaction that didn't finish
+    if (!spill.openExisting(path)) return;
+
+    SpillHeader header;
+    bool ok = spill.size() >= sizeof(header) && spill.read(0, &header, sizeof(header)) &&
+              memcmp(header.magic, "UNDO", 4) == 0 && header.version == SPILL_VERSION && header.clean &&
+              header.recordBytes == sizeof(Record) && header.savedHash == textHash &&
+              header.savedNode <= header.nodeCount &&
+              header.groupCount == (header.nodeCount + GROUP_NODES - 1) / GROUP_NODES &&
+              header.indexOffset + header.groupCount * sizeof(uint64_t) == spill.size();
+    if (ok) {
+        groupOffsets.resize(header.groupCount);
+        ok = groupOffsets.empty() ||
+             spill.read(header.indexOffset, groupOffsets.data(), groupOffsets.size() * sizeof(uint64_t));
+    }
+    if (ok) {
+        // New nodes go where the index was, it is written again on detach
+        header.clean = 0;
+        ok = spill.truncate(header.indexOffset) && spill.write(0, &header, sizeof(header)) && spill.flush();
+    }
+    if (!ok) {
+        groupOffsets.clear();
+        spill.remove(); // Left by a crash or another build, or the file was changed since
+        return;
+    }
+    spilledThrough = header.nodeCount;
+    firstId = spilledThrough + 1;
+    current = savedNode = header.savedNode;
+    root.newestChild = header.rootNewestChild;
+    root.selectedChild = header.rootSelectedChild;
+}
+
+void UndoHistory::detach() {
+    sealLast();
+    bool keep = !spillPath.empty() && savedNode != UNKNOWN_NODE && (count > 0 || spilledThrough > 0);
+    while (keep && count > 0) {
+        keep = spillOldest();
+    }
+    if (keep && compactSpill() && writeIndex()) {
+        spill.close();
+    } else {
+        spill.remove();
+    }
+    resetMemory();
+    firstId = 1;
+    current = 0;
+    root = Record{};
+    spillPath.clear();
+    spillFailed = false;
+    spilledThrough = 0;
+    std::vector<uint64_t>().swap(groupOffsets);
+    savedNode = 0;
+    savedHash = 0;
+    savePointNode = 0;
+}
+
+void UndoHistory::removeStaleSpills() {
+    SpillFile::removeStaleTemps("UNDO");
+}
+
+void UndoHistory::moveTo(const std::wstring& path) {
+    if (path == spillPath) return;
+    if (spill.isOpen() && !spill.moveTo(path)) {
+        spillBroken();
+    }
+    spillPath = path;
+}
+
+// Sealed, so typing after the save starts a new node rather than growing the saved one
+void UndoHistory::markSaved(uint64_t position, uint64_t textHash) {
+    sealLast();
+    savedNode = position;
+    savedHash = textHash;
+}
+
+uint64_t UndoHistory::savePoint() {
+    sealLast();
+    savePointNode = current;
+    return current;
+}
+
+void UndoHistory::clear() {
+    resetMemory();
+    spill.remove();
+    spillFailed = false;
+    firstId = 1;
+    current = 0;
+    root = Record{};
+    spilledThrough = 0;
+    std::vector<uint64_t>().swap(groupOffsets);
+    savedNode = UNKNOWN_NODE; // Node 0 is now whatever the text is, not the saved file
+    savePointNode = 0;
+}
+
+// Hands back the memory, the side file is left alone
+void UndoHistory::resetMemory() {
+    std::vector<Record>().swap(records);
+    std::vector<char>().swap(arena);
+    std::vector<wchar_t>().swap(openText);
+    std::vector<char>().swap(loadedPayload);
+    std::vector<uint64_t>().swap(cachedOffsets);
+    open = false;
+    first = count = 0;
+    arenaHead = arenaTail = 0;
+    payloadTotal = 0;
+    loadedId = 0;
+    cachedGroup = UINT64_MAX;
+}
+
+void UndoHistory::setBudget(size_t bytes) {
+    sealLast();
+    budgetBytes = bytes;
+    while (count > 0 && liveBytes() > budgetBytes) {
+        spillOldest();
+    }
+    if (arena.size() > budgetBytes) {
+        resizeArena(alignUp(budgetBytes));
+    }
+}
+
+size_t UndoHistory::memoryUsed() const {
+    return arena.capacity() + records.capacity() * sizeof(Record) + openText.capacity() * sizeof(wchar_t) +
+           loadedPayload.capacity() + (groupOffsets.capacity() + cachedOffsets.capacity()) * sizeof(uint64_t);
+}
+
+size_t UndoHistory::payloadBytes(const Record& record) {
+    return record.spanCount * sizeof(ReplacedSpan) +
+           (record.textLength + record.replacementLength) * sizeof(wchar_t);
+}
+
+UndoEntry UndoHistory::entryOf(const Record& record) const {
+    const char* payload = &record == &loaded ? loadedPayload.data()
+                        : arena.empty()      ? nullptr
+                                             : arena.data() + record.offset % arena.size();
+    const ReplacedSpan* spans = (const ReplacedSpan*)payload;
+    const wchar_t* text = (const wchar_t*)(payload + record.spanCount * sizeof(ReplacedSpan));
+    return UndoEntry{record.type, record.line, record.col,
+                     std::wstring_view(text, record.textLength),
+                     std::wstring_view(text + record.textLength, record.replacementLength),
+                     spans, record.spanCount};
+}
+
+// In memory, or read back from the side file into loaded
+const UndoHistory::Record* UndoHistory::find(uint64_t id) const {
+    if (id == 0) return &root;
+    if (id >= firstId && id < firstId + count) return &recordAt(id - firstId);
+    if (id > spilledThrough) return nullptr;
+    if (id != loadedId) {
+        loadedId = 0;
+        uint64_t offset;
+        if (!spilledOffset(id, offset) || !spill.read(offset, &loaded, sizeof(Record))) return nullptr;
+        size_t bytes = payloadBytes(loaded);
+        if (loadedPayload.capacity() > std::max(bytes * 2, MIN_ARENA_BYTES)) {
+            std::vector<char>().swap(loadedPayload); // Don't hold on to a big paste
+        }
+        loadedPayload.resize(bytes);
+        if (bytes > 0 && !spill.read(offset + sizeof(Record), loadedPayload.data(), bytes)) return nullptr;
+        loadedId = id;
+    }
+    return &loaded;
+}
+
+void UndoHistory::setChildren(uint64_t id, uint64_t newestChild, uint64_t selectedChild) {
+    static_assert(offsetof(Record, selectedChild) == offsetof(Record, newestChild) + sizeof(uint64_t),
+                  "the links are written to the side file together");
+    Record* record = id == 0 ? &root : id >= firstId && id < firstId + count ? &recordAt(id - firstId) : nullptr;
+    if (record) {
+        record->newestChild = newestChild;
+        record->selectedChild = selectedChild;
+        return;
+    }
+    uint64_t offset;
+    if (id > spilledThrough || !spilledOffset(id, offset)) return;
+    uint64_t links[2] = {newestChild, selectedChild};
+    if (!spill.write(offset + offsetof(Record, newestChild), links, sizeof(links))) {
+        spillBroken();
+        return;
+    }
+    if (loadedId == id) {
+        loaded.newestChild = newestChild;
+        loaded.selectedChild = selectedChild;
+    }
+}
+
+size_t UndoHistory::liveBytes() const {
+    return payloadTotal + count * sizeof(Record);
+}
+
+void UndoHistory::dropOldest() {
+    payloadTotal -= alignUp(payloadBytes(recordAt(0)));
+    first = (first + 1) & (records.size() - 1);
+    count--;
+    firstId++;
+    arenaTail = count > 0 ? recordAt(0).offset : arenaHead;
+}
+
+bool UndoHistory::tryAllocate(size_t bytes, uint64_t& offset) {
+    if (bytes == 0) {
+        offset = arenaHead;
+        return true;
+    }
+    size_t size = arena.size();
+    if (size == 0) return false;
+    size_t at = (size_t)(arenaHead % size);
+    size_t skip = at + bytes > size ? size - at : 0; // Payloads never wrap, the end of the lap is left empty
+    if ((size_t)(arenaHead - arenaTail) + skip + bytes > size) return false;
+    offset = arenaHead + skip;
+    arenaHead = offset + bytes;
+    return true;
+}
+
+// Copies the live payloads to the front of a new arena in order, so the head has
+// size - live bytes of unbroken room
+void UndoHistory::resizeArena(size_t size) {
+    std::vector<char> resized(size);
+    uint64_t at = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Record& record = recordAt(i);
+        size_t bytes = alignUp(payloadBytes(record));
+        if (bytes > 0) {
+            memcpy(resized.data() + at, arena.data() + record.offset % arena.size(), bytes);
+        }
+        record.offset = at;
+        at += bytes;
+    }
+    arena.swap(resized);
+    arenaTail = 0;
+    arenaHead = at;
+}
+
+// Grows toward the budget, or only closes up the gaps once it is there
+void UndoHistory::growArenaFor(size_t bytes) {
+    size_t needed = payloadTotal + bytes;
+    resizeArena(alignUp(std::max(needed, std::min(std::max(arena.size() * 2, MIN_ARENA_BYTES), budgetBytes))));
+}
+
+uint64_t UndoHistory::allocate(size_t bytes) {
+    uint64_t offset;
+    if (!tryAllocate(bytes, offset)) {
+        growArenaFor(bytes);
+        tryAllocate(bytes, offset);
+    }
+    return offset;
+}
+
+void UndoHistory::push(const UndoEntry& entry) {
+    sealLast();
+    uint64_t parent = current;
+    const Record* parentRecord = find(parent);
+    uint64_t id = firstId + count;
+    Record record{entry.type, entry.line, entry.col, (uint32_t)entry.text.length(),
+                  (uint32_t)entry.replacement.length(), (uint32_t)entry.spanCount,
+                  parent, parentRecord ? parentRecord->newestChild : 0, 0, 0, 0,
+                  parentRecord ? parentRecord->depth + 1 : 1};
+    size_t bytes = alignUp(payloadBytes(record));
+    while (count > 0 && liveBytes() + bytes + sizeof(Record) > budgetBytes) {
+        spillOldest();
+    }
+
+    if (bytes + sizeof(Record) > budgetBytes) {
+        if (!spillEntry(record, entry)) {
+            clear(); // Undo can't skip over it
+            return;
+        }
+    } else {
+        if (count == records.size()) {
+            std::vector<Record> grown(std::max(records.size() * 2, MIN_RECORDS));
+            for (size_t i = 0; i < count; ++i) {
+                grown[i] = recordAt(i);
+            }
+            records.swap(grown);
+            first = 0;
+        }
+
+        record.offset = allocate(bytes);
+        payloadTotal += bytes;
+        char* payload = arena.empty() ? nullptr : arena.data() + record.offset % arena.size();
+        size_t spanBytes = entry.spanCount * sizeof(ReplacedSpan);
+        if (spanBytes > 0) memcpy(payload, entry.spans, spanBytes);
+        wchar_t* text = (wchar_t*)(payload + spanBytes);
+        std::copy(entry.text.begin(), entry.text.end(), text);
+        std::copy(entry.replacement.begin(), entry.replacement.end(), text + entry.text.length());
+
+        if (count == 0) arenaTail = record.offset;
+        recordAt(count) = record;
+        count++;
+    }
+    setChildren(parent, id, id);
+    current = id;
+}
+
+bool UndoHistory::canUndo() const {
+    return current != 0 && find(current) != nullptr;
+}
+
+bool UndoHistory::canRedo() const {
+    const Record* record = find(current);
+    uint64_t child = record ? record->selectedChild : 0;
+    return child != 0 && find(child) != nullptr;
+}
+
+UndoEntry UndoHistory::undo() {
+    sealLast();
+    const Record* record = find(current);
+    current = record->parent;
+    return entryOf(*record);
+}
+
+UndoEntry UndoHistory::redo() {
+    current = find(current)->selectedChild;
+    return entryOf(*find(current));
+}
+
+bool UndoHistory::nextBranch() {
+    sealLast();
+    const Record* record = find(current);
+    if (!record || record->newestChild == 0) return false;
+    uint64_t newest = record->newestChild;
+    uint64_t selected = record->selectedChild;
+    const Record* child = find(selected);
+    uint64_t next = child && child->olderSibling != 0 ? child->olderSibling : newest;
+    if (find(next) == nullptr) next = newest; // Older branches may have been dropped
+    if (next == selected) return false;
+    setChildren(current, newest, next);
+    return true;
+}
+
+bool UndoHistory::last(UndoEntry& entry) const {
+    if (count == 0 || current != firstId + count - 1 || current == savedNode || current == savePointNode) return false;
+    const Record& record = recordAt(count - 1);
+    if (open) {
+        entry = UndoEntry{record.type, record.line, record.col,
+                          std::wstring_view(openText.data() + openBegin, openEnd - openBegin)};
+    } else {
+        entry = entryOf(record);
+    }
+    return true;
+}
+
+// Moves the newest entry's text out of the arena into the middle of the open buffer. Its
+// payload is the newest, so handing it back just moves the head back to it.
+void UndoHistory::openLast() {
+    Record& record = recordAt(count - 1);
+    size_t length = record.textLength;
+    size_t size = std::max({openText.size(), length * 2, MIN_OPEN_UNITS});
+    if (size > openText.size()) {
+        std::vector<wchar_t>(size).swap(openText);
+    }
+    openBegin = (size - length) / 2;
+    openEnd = openBegin + length;
+    if (length > 0) {
+        const char* payload = arena.data() + record.offset % arena.size();
+        const wchar_t* text = (const wchar_t*)(payload + record.spanCount * sizeof(ReplacedSpan));
+        std::copy(text, text + length, openText.data() + openBegin);
+    }
+    arenaHead = record.offset;
+    open = true;
+}
+
+// Copies the open entry into the arena; the open buffer keeps its size for the next one
+void UndoHistory::sealLast() {
+    if (!open) return;
+    open = false;
+    Record& record = recordAt(count - 1);
+    size_t bytes = alignUp(payloadBytes(record));
+    // Left out while room is made, a compaction would otherwise copy it from the arena
+    count--;
+    payloadTotal -= bytes;
+    record.offset = allocate(bytes);
+    count++;
+    payloadTotal += bytes;
+    if (count == 1) arenaTail = record.offset;
+    if (bytes > 0) {
+        wchar_t* text = (wchar_t*)(arena.data() + record.offset % arena.size());
+        std::copy(openText.data() + openBegin, openText.data() + openEnd, text);
+    }
+}
+
+// Centres the open text again, in a buffer twice the size when it already fills half of
+// it, so a run at one end moves the text O(log n) times
+void UndoHistory::makeOpenRoom() {
+    size_t length = openEnd - openBegin;
+    size_t size = openText.size();
+    if (length * 2 > size) {
+        std::vector<wchar_t> grown(size * 2);
+        size_t begin = (grown.size() - length) / 2;
+        std::copy(openText.data() + openBegin, openText.data() + openEnd, grown.data() + begin);
+        openText.swap(grown);
+        openBegin = begin;
+    } else {
+        size_t begin = (size - length) / 2;
+        memmove(openText.data() + begin, openText.data() + openBegin, length * sizeof(wchar_t));
+        openBegin = begin;
+    }
+    openEnd = openBegin + length;
+}
+
+void UndoHistory::extendLast(wchar_t ch, bool atFront) {
+    if (!open) openLast();
+    size_t bytes = payloadBytes(recordAt(count - 1));
+    size_t grown = alignUp(bytes + sizeof(wchar_t)) - alignUp(bytes);
+    while (count > 1 && liveBytes() + grown > budgetBytes) {
+        spillOldest();
+    }
+    if (liveBytes() + grown > budgetBytes) {
+        clear();
+        return;
+    }
+
+    if (atFront ? openBegin == 0 : openEnd == openText.size()) {
+        makeOpenRoom();
+    }
+    Record& record = recordAt(count - 1);
+    if (atFront) {
+        openText[--openBegin] = ch;
+        record.col--;
+    } else {
+        openText[openEnd++] = ch;
+    }
+    record.textLength++;
+    payloadTotal += grown;
+}
+
+// Side file
+
+// Created on the first spill, starting with a header that marks it unfinished
+bool UndoHistory::openSpill() {
+    if (spill.isOpen()) return true;
+    if (spillFailed) return false;
+    SpillHeader header = {{'U', 'N', 'D', 'O'}, SPILL_VERSION, 0, sizeof(Record)};
+    bool ok = (spillPath.empty() ? spill.createTemp() : spill.create(spillPath)) &&
+              spill.append(&header, sizeof(header));
+    if (!ok) spillBroken();
+    return ok;
+}
+
+// Writes the oldest record in memory to the side file and lets it go. Without a side
+// file it is only dropped, and false is returned.
+bool UndoHistory::spillOldest() {
+    bool ok = firstId == spilledThrough + 1 && openSpill();
+    if (ok) {
+        const Record& record = recordAt(0);
+        size_t bytes = payloadBytes(record);
+        uint64_t offset = spill.size();
+        ok = spill.append(&record, sizeof(Record)) &&
+             (bytes == 0 || spill.append(arena.data() + record.offset % arena.size(), bytes));
+        if (ok) {
+            if ((firstId - 1) % GROUP_NODES == 0) groupOffsets.push_back(offset);
+            spilledThrough = firstId;
+        } else {
+            spillBroken();
+        }
+    }
+    dropOldest();
+    return ok;
+}
+
+// An entry too big for memory is written straight after the spilled ones, which needs
+// everything before it to be on disk already
+bool UndoHistory::spillEntry(const Record& record, const UndoEntry& entry) {
+    uint64_t id = firstId + count;
+    if (count > 0 || id != spilledThrough + 1 || !openSpill()) return false;
+    uint64_t offset = spill.size();
+    bool ok = spill.append(&record, sizeof(Record)) &&
+              spill.append(entry.spans, entry.spanCount * sizeof(ReplacedSpan)) &&
+              spill.append(entry.text.data(), entry.text.length() * sizeof(wchar_t)) &&
+              spill.append(entry.replacement.data(), entry.replacement.length() * sizeof(wchar_t));
+    if (!ok) {
+        spillBroken();
+        return false;
+    }
+    if ((id - 1) % GROUP_NODES == 0) groupOffsets.push_back(offset);
+    spilledThrough = id;
+    firstId = id + 1;
+    return true;
+}
+
+// Gives up on the side file, the nodes in it are lost and from now on the oldest ones
+// are dropped when the budget is reached
+void UndoHistory::spillBroken() {
+    spill.remove();
+    spillFailed = true;
+    spilledThrough = 0;
+    std::vector<uint64_t>().swap(groupOffsets);
+    loadedId = 0;
+    cachedGroup = UINT64_MAX;
+}
+
+// Reads the record headers of the node's group once, later lookups in it are direct
+bool UndoHistory::spilledOffset(uint64_t id, uint64_t& offset) const {
+    uint64_t group = (id - 1) / GROUP_NODES;
+    size_t index = (size_t)((id - 1) % GROUP_NODES);
+    if (group >= groupOffsets.size()) return false;
+    if (group != cachedGroup || index >= cachedOffsets.size()) {
+        cachedGroup = UINT64_MAX;
+        cachedOffsets.clear();
+        uint64_t at = groupOffsets[group];
+        uint64_t last = std::min(spilledThrough, (group + 1) * GROUP_NODES);
+        for (uint64_t node = group * GROUP_NODES + 1; node <= last; ++node) {
+            Record record;
+            if (!spill.read(at, &record, sizeof(Record))) return false;
+            cachedOffsets.push_back(at);
+            at += sizeof(Record) + payloadBytes(record);
+        }
+        cachedGroup = group;
+    }
+    offset = cachedOffsets[index];
+    return true;
+}
+
+// Rewrites the side file with only the nodes on the way to the current and the saved
+// text and the redo steps from them, when the other branches are most of it. Every node is
+// spilled by now. False when the side file was lost.
+bool UndoHistory::compactSpill() {
+    if (spill.size() < COMPACT_MIN_BYTES) return true;
+    // (id, parent) of every node kept; the redo steps first, then what an upper bound of
+    // the rest shows is worth going through
+    std::vector<std::pair<uint64_t, uint64_t>> live;
+    uint64_t bound = 0;
+    for (uint64_t start : {current, savedNode}) {
+        const Record* record = find(start);
+        if (!record) return true;
+        bound += record->depth;
+        for (uint64_t id = record->selectedChild; id != 0; id = record->selectedChild) {
+            record = find(id);
+            if (!record) return true;
+            live.emplace_back(id, record->parent);
+        }
+        if (savedNode == current) break;
+    }
+    if ((live.size() + bound) * 2 >= spilledThrough) return true;
+    for (uint64_t start : {current, savedNode}) {
+        for (uint64_t id = start; id != 0;) {
+            const Record* record = find(id);
+            if (!record) return true;
+            live.emplace_back(id, record->parent);
+            id = record->parent;
+        }
+        if (savedNode == current) break;
+    }
+    std::sort(live.begin(), live.end());
+    live.erase(std::unique(live.begin(), live.end()), live.end());
+
+    // Kept nodes are numbered again in the same order, so a parent still comes first
+    auto kept = [&](uint64_t id) -> uint64_t {
+        auto at = std::lower_bound(live.begin(), live.end(), std::make_pair(id, (uint64_t)0));
+        return id != 0 && at != live.end() && at->first == id ? (uint64_t)(at - live.begin()) + 1 : 0;
+    };
+    // Children come in the order they were made, so the last one met is the newest and
+    // each one's older sibling is the one met before it
+    std::vector<uint64_t> newestChild(live.size() + 1), olderSibling(live.size() + 1);
+    for (size_t i = 0; i < live.size(); ++i) {
+        uint64_t parent = kept(live[i].second);
+        olderSibling[i + 1] = newestChild[parent];
+        newestChild[parent] = i + 1;
+    }
+
+    SpillFile compacted;
+    SpillHeader header = {{'U', 'N', 'D', 'O'}, SPILL_VERSION, 0, sizeof(Record)};
+    bool ok = compacted.create(spillPath + L".new") && compacted.append(&header, sizeof(header));
+    std::vector<uint64_t> offsets;
+    for (size_t i = 0; ok && i < live.size(); ++i) {
+        const Record* found = find(live[i].first); // Read back into loaded, with its payload
+        if (!found) {
+            ok = false;
+            break;
+        }
+        Record record = *found;
+        uint64_t id = i + 1;
+        uint64_t selected = kept(record.selectedChild);
+        record.parent = kept(record.parent);
+        record.olderSibling = olderSibling[id];
+        record.newestChild = newestChild[id];
+        record.selectedChild = selected != 0 ? selected : newestChild[id];
+        size_t bytes = payloadBytes(record);
+        if ((id - 1) % GROUP_NODES == 0) offsets.push_back(compacted.size());
+        ok = compacted.append(&record, sizeof(Record)) &&
+             (bytes == 0 || compacted.append(loadedPayload.data(), bytes));
+    }
+    ok = ok && compacted.flush();
+    if (ok) {
+        spill.close(); // An open file can't be renamed over
+        ok = compacted.moveTo(spillPath);
+        compacted.close();
+        if (!spill.openExisting(spillPath)) {
+            spillBroken();
+            return false;
+        }
+    }
+    if (!ok) {
+        compacted.remove();
+        return true; // The side file is as it was
+    }
+
+    uint64_t selected = kept(root.selectedChild);
+    root.newestChild = newestChild[0];
+    root.selectedChild = selected != 0 ? selected : newestChild[0];
+    current = kept(current);
+    savedNode = kept(savedNode);
+    spilledThrough = live.size();
+    firstId = spilledThrough + 1;
+    groupOffsets.swap(offsets);
+    loadedId = 0;
+    cachedGroup = UINT64_MAX;
+    return true;
+}
+
+// Appends the group index and marks the file complete, flushing in between so a clean
+// header never points at an index that isn't there
+bool UndoHistory::writeIndex() {
+    if (!openSpill()) return false;
+    SpillHeader header = {{'U', 'N', 'D', 'O'}, SPILL_VERSION, 1, sizeof(Record), spilledThrough,
+                          savedNode, savedHash, root.newestChild, root.selectedChild,
+                          spill.size(), groupOffsets.size()};
+    return spill.append(groupOffsets.data(), groupOffsets.size() * sizeof(uint64_t)) && spill.flush() &&
+           spill.write(0, &header, sizeof(header)) && spill.flush();
+}
\ No newline at end of file
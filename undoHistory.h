@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "spillFile.h"
+
+enum class UndoActionType {
+    INSERT_TEXT, // User typed something (needs to be deleted on undo)
+    DELETE_TEXT, // User deleted something (needs to be inserted on undo)
+    LINE_SPLIT,  // User pressed Enter (line was split)
+    LINE_JOIN,   // User pressed Backspace to join lines
+    REPLACE      // Search matches were replaced, spans and text hold what they were
+    // Add other types as needed (PASTE, CUT)
+};
+
+// Where a replaced match was before the replace, none of them cross a line break
+struct ReplacedSpan {
+    int line;
+    int col;
+    int length;
+};
+
+// A history entry. Entries handed out by UndoHistory point into its own storage.
+struct UndoEntry {
+    UndoActionType type;
+    int line;
+    int col;
+    std::wstring_view text;
+    std::wstring_view replacement; // REPLACE: what every span became
+    const ReplacedSpan* spans;     // REPLACE: in document order, their old text is text back to back
+    size_t spanCount;
+};
+
+// Undo tree held to a memory budget. Every edit is a node whose parent is the text it was
+// made in, so an edit after undo starts a new branch rather than dropping the undone ones.
+// Nodes are numbered in the order they were made, the newest are fixed-size records in a
+// ring with their text and spans back to back in a second ring, the arena. Once both have
+// grown to their working size nothing is allocated per edit. While typing merges into the
+// newest entry its text is held apart, with room at both ends, and only goes into the
+// arena once something else happens.
+//
+// When the budget is reached the oldest records are written to a side file and read back
+// one at a time when undo or redo gets to them, so memory stays flat however long the
+// history grows. detach() completes the side file next to the document, and attach()
+// takes it up again the next time the same text is loaded. Branches off the way to the
+// current and saved text, which only nextBranch() could get back to, are left out of the
+// side file by detach() once they are most of it, so it doesn't grow for ever either.
+class UndoHistory {
+public:
+    explicit UndoHistory(size_t budgetBytes);
+
+    // Starts the history for a freshly loaded text, after detaching the previous one.
+    // spillPath is the document's side file, empty for an untitled document, which spills
+    // to a temp file. A side file saved with this text is taken up at its saved node.
+    void attach(const std::wstring& spillPath, uint64_t textHash);
+    // Writes out what is still in memory and closes the side file; a temp one is deleted
+    void detach();
+    // Deletes the temp side files of editors that crashed, the ones in use can't be opened
+    static void removeStaleSpills();
+    void moveTo(const std::wstring& spillPath);           // The document was saved under a new name
+    void markSaved(uint64_t position, uint64_t textHash); // The file on disk is the text at position
+    uint64_t position() const { return current; }         // Node of the current text, 0 before any edit
+    // position(), closed to typing so it stays the text a save started now writes
+    uint64_t savePoint();
+
+    // The budget covers records and payloads. The arena is never allocated past it, gaps
+    // left by wrapping or by a growing entry are closed up when space runs out.
+    void clear();                 // Forgets every node, the side file included
+    void setBudget(size_t bytes); // Spills the oldest entries until the rest fit
+    size_t budget() const { return budgetBytes; }
+    size_t memoryUsed() const;    // Allocated for records, arena and the side file's index
+    uint64_t spilledBytes() const { return spill.size(); }
+
+    // Adds a node under the current one and moves to it. An entry larger than the whole
+    // budget goes straight to the side file, or clears the history when there is none.
+    void push(const UndoEntry& entry);
+
+    // These may read the side file. Entries handed out stay valid until the history is next used.
+    bool canUndo() const;
+    bool canRedo() const;
+    UndoEntry undo(); // Moves to the parent and returns the node undone
+    UndoEntry redo(); // Moves to the selected child and returns it
+    // Selects the next older child of the current node for redo, wrapping round to the
+    // newest. False when there is no other branch.
+    bool nextBranch();
+
+    // The newest node, when it is the current one, so typing can be merged into it. Not
+    // the saved node or a save point, whose text has to stay what went to disk.
+    bool last(UndoEntry& entry) const;
+    // Adds ch to the end of last()'s text, or to the front, which moves its column back one.
+    // O(1) either way, and once the open buffer has grown to the longest run it allocates
+    // nothing. last() has to be a plain text entry, without spans or replacement.
+    void extendLast(wchar_t ch, bool atFront);
+
+private:
+    struct Record {
+        UndoActionType type;
+        int line;
+        int col;
+        uint32_t textLength;
+        uint32_t replacementLength;
+        uint32_t spanCount;
+        uint64_t parent;        // Node ids, 0 is the text before the first edit
+        uint64_t olderSibling;  // Next older child of the same parent
+        uint64_t newestChild;   // These two change after the node is made, they are patched
+        uint64_t selectedChild; // in place in the side file; redo follows selectedChild
+        uint64_t offset;        // Of the payload in the arena; offsets only grow, the arena index is offset % size
+        uint64_t depth;         // Edits from node 0 down to this one
+    };
+
+    std::vector<Record> records; // Ring, first is the oldest record
+    size_t first = 0;
+    size_t count = 0;
+    uint64_t firstId = 1;        // Of the oldest record in memory
+    uint64_t current = 0;
+    Record root = {};            // Links of node 0
+    std::vector<char> arena;     // Payloads: spans, then text, then replacement
+    uint64_t arenaHead = 0;      // Where the next payload goes
+    uint64_t arenaTail = 0;      // Start of the oldest payload
+    size_t payloadTotal = 0;     // Bytes of the payloads, without the gaps between them
+    size_t budgetBytes;
+
+    // The open entry is the newest record, its text is openText[openBegin, openEnd) and it
+    // has nothing in the arena; its offset is the head, where it goes when it is sealed
+    std::vector<wchar_t> openText;
+    size_t openBegin = 0;
+    size_t openEnd = 0;
+    bool open = false;
+
+    // Nodes [1, spilledThrough] are in the side file in order, each record followed by
+    // its payload. groupOffsets holds where every GROUP_NODES-th one starts.
+    SpillFile spill;
+    std::wstring spillPath;
+    bool spillFailed = false;    // After a write error older nodes are dropped instead
+    uint64_t spilledThrough = 0;
+    std::vector<uint64_t> groupOffsets;
+    uint64_t savedNode = 0;
+    uint64_t savedHash = 0;
+    uint64_t savePointNode = 0;
+    // The spilled node read back last, and the offsets of the nodes in its group
+    mutable uint64_t loadedId = 0;
+    mutable Record loaded = {};
+    mutable std::vector<char> loadedPayload;
+    mutable uint64_t cachedGroup = UINT64_MAX;
+    mutable std::vector<uint64_t> cachedOffsets;
+
+    Record& recordAt(size_t index) { return records[(first + index) & (records.size() - 1)]; }
+    const Record& recordAt(size_t index) const { return records[(first + index) & (records.size() - 1)]; }
+    static size_t payloadBytes(const Record& record);
+    UndoEntry entryOf(const Record& record) const;
+    const Record* find(uint64_t id) const; // Null when the node was dropped
+    void setChildren(uint64_t id, uint64_t newestChild, uint64_t selectedChild);
+    size_t liveBytes() const;
+    void resetMemory();
+    void dropOldest();
+    // bytes of unbroken payload at the head, from free space or by growing the arena
+    bool tryAllocate(size_t bytes, uint64_t& offset);
+    uint64_t allocate(size_t bytes);
+    void growArenaFor(size_t bytes);
+    void resizeArena(size_t size);
+    void openLast();
+    void sealLast();
+    void makeOpenRoom();
+
+    bool openSpill();
+    bool spillOldest();
+    bool spillEntry(const Record& record, const UndoEntry& entry);
+    void spillBroken();
+    bool spilledOffset(uint64_t id, uint64_t& offset) const;
+    bool compactSpill();
+    bool writeIndex();
+};
\ No newline at end of file
@@ -2,12 +2,25 @@
 
 #include "undoStack.h"
 #include "isModified.h"
+#include "textMetrics.h"
+#include "damageTracker.h"
+#include "frameScheduler.h"
+#include "glyphAdvances.h"
+#include "searchMode.h"
+#include "replaceText.h"
+#include "trigramIndex.h"
+#include "editJournal.h"
+#include "charScan.h" // For IsWordChar, CountChar
 
-std::stack<UndoAction> undoStack;
+#include <algorithm>
 
-// Helper function to determine if a character is a word character
-bool IsWordChar(wchar_t ch) {
-    return iswalnum(ch) || ch == L'_';
+// Enough for long sessions of typing and a good number of large replaces
+const size_t UNDO_BUDGET_BYTES = 64 * 1024 * 1024;
+
+UndoHistory undoHistory(UNDO_BUDGET_BYTES);
+
+std::wstring UndoSpillPath(const std::wstring& documentPath) {
+    return documentPath + L".undo";
 }
 
 // Helper function to determine if we should group characters together
@@ -25,106 +38,146 @@ bool ShouldGroupChars(wchar_t char1, wchar_t char2) {
     return false;
 }
 
-void InsertTextAt(int line, int col, const std::wstring& text) {
-    if (line < 0 || line >= textBuffer.size()) return;
+// Every change to textBuffer goes through these two, so the journal sees all of them
+void InsertAtOffset(size_t offset, const wchar_t* text, size_t count) {
+    textBuffer.insertAt(offset, text, count);
+    JournalInsert(offset, text, count);
+}
+
+void EraseAtOffset(size_t offset, size_t count) {
+    textBuffer.eraseAt(offset, count);
+    JournalErase(offset, count);
+}
+
+// Document offset of (line, col), with col clamped to the line
+static size_t OffsetOf(int line, int col) {
+    return textBuffer.lineStart(line) + std::min((size_t)col, textBuffer.lineLength(line));
+}
+
+void InsertTextAt(int line, int col, std::wstring_view text) {
+    if (line < 0 || line >= textBuffer.lineCount()) return;
     if (col < 0) col = 0;
-    if (col > textBuffer[line].length()) col = textBuffer[line].length();
-    textBuffer[line].insert(col, text);
+    InsertAtOffset(OffsetOf(line, col), text.data(), text.size());
+    LinesChanged(line, 0, (int)CountChar(text.data(), text.size(), L'\n'));
 }
 
-void DeleteTextAt(int line, int col, size_t length) {
-    if (line < 0 || line >= textBuffer.size()) return;
+// Takes out text that InsertTextAt put at (line, col), which may run over several lines
+void RemoveTextAt(int line, int col, std::wstring_view text) {
+    if (line < 0 || line >= textBuffer.lineCount()) return;
     if (col < 0) col = 0;
-    if (col >= textBuffer[line].length()) return;
+    EraseAtOffset(textBuffer.lineStart(line) + col, text.length());
+    LinesChanged(line, (int)CountChar(text.data(), text.size(), L'\n'), 0);
+}
 
-    size_t actualLength = std::min(length, textBuffer[line].length() - col);
-    if (actualLength > 0) {
-        textBuffer[line].erase(col, actualLength);
+void MoveCaretAfter(int line, int col, std::wstring_view text) {
+    size_t lastBreak = text.rfind(L'\n');
+    if (lastBreak == std::wstring_view::npos) {
+        caretLine = line;
+        caretCol = col + (int)text.length();
+    } else {
+        caretLine = line + (int)CountChar(text.data(), text.size(), L'\n');
+        caretCol = (int)(text.length() - lastBreak - 1);
     }
 }
 
+void InsertCharAt(int line, int col, wchar_t ch) {
+    if (line < 0 || line >= textBuffer.lineCount()) return;
+    if (col < 0) col = 0;
+    InsertAtOffset(OffsetOf(line, col), &ch, 1);
+    LinesChanged(line, 0, ch == L'\n' ? 1 : 0);
+}
+
+void DeleteTextAt(int line, int col, size_t length) {
+    if (line < 0 || line >= textBuffer.lineCount()) return;
+    if (col < 0) col = 0;
+    size_t lineLength = textBuffer.lineLength(line);
+    if ((size_t)col < lineLength) {
+        EraseAtOffset(textBuffer.lineStart(line) + col, std::min(length, lineLength - col));
+    }
+    LinesChanged(line, 0, 0);
+}
+
 void MergeLines(int targetLine) {
-    if (targetLine < 0 || targetLine >= textBuffer.size() - 1) return;
-    textBuffer[targetLine] += textBuffer[targetLine + 1];
-    textBuffer.erase(textBuffer.begin() + targetLine + 1);
+    if (targetLine < 0 || targetLine >= (int)textBuffer.lineCount() - 1) return;
+    EraseAtOffset(textBuffer.lineStart(targetLine + 1) - 1, 1);
+    LinesChanged(targetLine, 1, 0);
 }
 
-void SplitLine(int line, int col, const std::wstring& newRemainingText) {
-    if (line < 0 || line >= textBuffer.size()) return;
+void SplitLine(int line, int col) {
+    if (line < 0 || line >= textBuffer.lineCount()) return;
     if (col < 0) col = 0;
-    if (col > textBuffer[line].length()) col = textBuffer[line].length();
+    InsertAtOffset(OffsetOf(line, col), L"\n", 1);
+    LinesChanged(line, 0, 1);
+}
 
-    textBuffer[line].resize(col); 
-    textBuffer.insert(textBuffer.begin() + line + 1, newRemainingText); 
+// Everything that caches per-line state hears about an edit here
+void LinesChanged(int line, int removedLines, int insertedLines) {
+    updateLineWidths(line, removedLines, insertedLines);
+    invalidateGlyphAdvances(line, removedLines, insertedLines);
+    TrigramLinesChanged(line, removedLines, insertedLines); // First, a large edit searches again through it
+    SearchLinesChanged(line, removedLines, insertedLines);
+    if (removedLines == insertedLines) {
+        DamageLines(line, line + insertedLines);
+    } else {
+        DamageFromLine(line); // Later lines moved up or down
+    }
 }
 
 // Record a single character insertion for grouping
 void RecordTyping(int line, int col, wchar_t ch) {
-    if (undoStack.empty()) {
-        // First action - just push it
-        undoStack.push(UndoAction(UndoActionType::INSERT_TEXT, line, col, std::wstring(1, ch)));
-        return;
-    }
-    
-    UndoAction& lastAction = undoStack.top();
+    UndoEntry lastAction;
     
     // Check if we can merge with the last action
-    bool canMerge = (lastAction.type == UndoActionType::INSERT_TEXT) &&
+    bool canMerge = undoHistory.last(lastAction) &&
+                    (lastAction.type == UndoActionType::INSERT_TEXT) &&
                     (lastAction.line == line) &&
                     (lastAction.col + lastAction.text.length() == col) &&
                     ShouldGroupChars(lastAction.text.back(), ch);
     
     if (canMerge) {
         // Merge with existing action
-        lastAction.text += ch;
+        undoHistory.extendLast(ch, false);
     } else {
         // Create new action
-        undoStack.push(UndoAction(UndoActionType::INSERT_TEXT, line, col, std::wstring(1, ch)));
+        undoHistory.push(UndoEntry{UndoActionType::INSERT_TEXT, line, col, std::wstring_view(&ch, 1)});
     }
 }
 
 // Record a single character deletion for grouping
 void RecordDeletion(int line, int col, wchar_t ch) {
-    if (undoStack.empty()) {
-        // First action - just push it
-        undoStack.push(UndoAction(UndoActionType::DELETE_TEXT, line, col, std::wstring(1, ch)));
-        return;
-    }
-    
-    UndoAction& lastAction = undoStack.top();
+    UndoEntry lastAction;
     
     // Check if we can merge with the last action (for backspace - deleting backwards)
-    bool canMerge = (lastAction.type == UndoActionType::DELETE_TEXT) &&
+    bool canMerge = undoHistory.last(lastAction) &&
+                    (lastAction.type == UndoActionType::DELETE_TEXT) &&
                     (lastAction.line == line) &&
                     (lastAction.col == col + 1) && // Previous deletion was one position to the right
                     ShouldGroupChars(lastAction.text[0], ch); // Compare with first char of deletion
     
     if (canMerge) {
-        // Merge with existing action - prepend since we're going backwards
-        lastAction.text = ch + lastAction.text;
-        lastAction.col = col; // Update starting position
+        // Merge with existing action - prepend since we're going backwards, which moves its column to col
+        undoHistory.extendLast(ch, true);
     } else {
         // Create new action
-        undoStack.push(UndoAction(UndoActionType::DELETE_TEXT, line, col, std::wstring(1, ch)));
+        undoHistory.push(UndoEntry{UndoActionType::DELETE_TEXT, line, col, std::wstring_view(&ch, 1)});
     }
 }
 
 // Record other actions (line operations, etc.)
 void RecordAction(UndoActionType type, int line, int col, const std::wstring& text) {
-    undoStack.push(UndoAction(type, line, col, text));
+    undoHistory.push(UndoEntry{type, line, col, text});
 }
 
 void PerformUndo(HWND hwnd) {
-    if (undoStack.empty()) {
+    if (!undoHistory.canUndo()) {
         return;
     }
 
-    UndoAction action = undoStack.top();
-    undoStack.pop();
+    UndoEntry action = undoHistory.undo();
 
     switch (action.type) {
         case UndoActionType::INSERT_TEXT:
-            DeleteTextAt(action.line, action.col, action.text.length());
+            RemoveTextAt(action.line, action.col, action.text);
             caretLine = action.line;
             caretCol = action.col;
             break;
@@ -144,20 +197,69 @@ void PerformUndo(HWND hwnd) {
 
         case UndoActionType::LINE_JOIN:
             // To undo a line join, split the line back.
-            SplitLine(action.line, action.col, action.text);
+            SplitLine(action.line, action.col);
+            caretLine = action.line;
+            caretCol = action.col;
+            break;
+
+        case UndoActionType::REPLACE:
+            UndoReplace(action);
+            caretLine = action.line;
+            caretCol = action.col;
+            break;
+    }
+
+    isModifiedTag(textBuffer, hwnd);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
+}
+
+// Does the action again, the caret ends where it did the first time
+void PerformRedo(HWND hwnd) {
+    if (!undoHistory.canRedo()) {
+        return;
+    }
+
+    UndoEntry action = undoHistory.redo();
+
+    switch (action.type) {
+        case UndoActionType::INSERT_TEXT:
+            InsertTextAt(action.line, action.col, action.text);
+            MoveCaretAfter(action.line, action.col, action.text);
+            break;
+
+        case UndoActionType::DELETE_TEXT:
+            DeleteTextAt(action.line, action.col, action.text.length());
+            caretLine = action.line;
+            caretCol = action.col;
+            break;
+
+        case UndoActionType::LINE_SPLIT:
+            SplitLine(action.line, action.col);
+            caretLine = action.line + 1;
+            caretCol = 0;
+            break;
+
+        case UndoActionType::LINE_JOIN:
+            MergeLines(action.line);
+            caretLine = action.line;
+            caretCol = action.col;
+            break;
+
+        case UndoActionType::REPLACE:
+            RedoReplace(action);
             caretLine = action.line;
             caretCol = action.col;
             break;
     }
 
-    UpdateCaretPosition(hwnd);
     isModifiedTag(textBuffer, hwnd);
-    UpdateScrollBars(hwnd);
-    InvalidateRect(hwnd, NULL, TRUE);
+    ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
 }
 
-void clearStack(std::stack<UndoAction>& undoStack) {
-    while(!undoStack.empty()) {
-        undoStack.pop();
+// After undoing, an edit starts a new branch and the old one is kept; this chooses the
+// next older branch for redo, coming back round to the newest
+void SwitchRedoBranch(HWND hwnd) {
+    if (!undoHistory.nextBranch()) {
+        MessageBeep(MB_OK); // There is only the one
     }
 }
\ No newline at end of file
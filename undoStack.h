@@ -2,31 +2,17 @@
 #include "textEditorGlobals.h"
 #include "updateCaretAndScroll.h"
 #include <windows.h>
-#include <stack>
 #include <string>
+#include <string_view>
+#include "undoHistory.h"
 
-enum class UndoActionType {
-    INSERT_TEXT, // User typed something (needs to be deleted on undo)
-    DELETE_TEXT, // User deleted something (needs to be inserted on undo)
-    LINE_SPLIT,  // User pressed Enter (line was split)
-    LINE_JOIN    // User pressed Backspace to join lines
-    // Add other types as needed (PASTE, CUT, REPLACE)
-};
+// Undo tree, kept under its memory budget by spilling the oldest entries to the side file
+extern UndoHistory undoHistory;
 
-struct UndoAction {
-    UndoActionType type; // What kind of action was it?
-    int line;            
-    int col;            
-    std::wstring text;  
-    
-    UndoAction(UndoActionType type, int line, int col, const std::wstring& text = L"")
-        : type(type), line(line), col(col), text(text) {}
-};
+// Where a document's undo history is kept between sessions
+std::wstring UndoSpillPath(const std::wstring& documentPath);
 
-extern std::stack<UndoAction> undoStack;
-
-// Helper functions for character classification and grouping
-bool IsWordChar(wchar_t ch);
+// Helper function for grouping typed characters, words by IsWordChar (charScan.h)
 bool ShouldGroupChars(wchar_t char1, wchar_t char2);
 
 // Recording functions for undo actions
@@ -34,14 +20,20 @@ void RecordTyping(int line, int col, wchar_t ch);
 void RecordDeletion(int line, int col, wchar_t ch);
 void RecordAction(UndoActionType type, int line, int col, const std::wstring& text = L"");
 
-// Undo execution
+// Undo and redo execution
 void PerformUndo(HWND hwnd);
+void PerformRedo(HWND hwnd); // Ctrl+Y
+void SwitchRedoBranch(HWND hwnd); // Ctrl+B, picks which undone branch Ctrl+Y goes down
 
 // Text manipulation functions
-void InsertTextAt(int line, int col, const std::wstring& text);
-void DeleteTextAt(int line, int col, size_t length);
+void InsertAtOffset(size_t offset, const wchar_t* text, size_t count); // textBuffer edit, journaled
+void EraseAtOffset(size_t offset, size_t count);
+void InsertTextAt(int line, int col, std::wstring_view text);
+void InsertCharAt(int line, int col, wchar_t ch); // Typing, no string built per keystroke
+void DeleteTextAt(int line, int col, size_t length);       // Never crosses a line break
+void RemoveTextAt(int line, int col, std::wstring_view text); // Undoes InsertTextAt, line breaks and all
+void MoveCaretAfter(int line, int col, std::wstring_view text); // To the end of text inserted at (line, col)
 void MergeLines(int targetLine);
-void SplitLine(int line, int col, const std::wstring& newRemainingText);
-
-// Utility functions
-void clearStack(std::stack<UndoAction>& undoStack);
\ No newline at end of file
+void SplitLine(int line, int col);
+// Lines [line, line + removedLines] were replaced by [line, line + insertedLines]
+void LinesChanged(int line, int removedLines, int insertedLines);
@@ -4,20 +4,15 @@
 #include "textEditorGlobals.h" // For textBuffer, caretLine, caretCol, scrollOffsetX, scrollOffsetY
 #include "textMetrics.h"    // For charHeight, linesPerPage, font, maxLineWidthPixels
 #include "infoBar.h"
+#include "damageTracker.h"
+#include "frameScheduler.h"
+#include "glyphAdvances.h"
 
 #include <windows.h>
 #include <algorithm> // For std::max, std::min
 
 void UpdateCaretPosition(HWND hwnd) {
-    HDC hdc = GetDC(hwnd);
-    HFONT hOldFont = (HFONT)SelectObject(hdc, font);
-    
-    int x = 0;
-    if (caretLine < textBuffer.size()) {
-        SIZE size;
-        GetTextExtentPoint32W(hdc, textBuffer[caretLine].c_str(), caretCol, &size);
-        x = size.cx;
-    }
+    int x = caretXFromColumn(caretLine, caretCol);
     
     RECT clientRect;
     GetClientRect(hwnd, &clientRect);
@@ -79,13 +74,9 @@ void UpdateCaretPosition(HWND hwnd) {
     // Set caret position and visibility
     SetCaretPos(x, y);
     */
-    UpdateScrollBars(hwnd);
-    // Force redraw if needed
+    // Runs next in the same frame; auto-scroll is picked up by FlushDamage
+    ScheduleLayout(LAYOUT_SCROLLBARS);
     UpdateInfoBar(hwnd);
-    InvalidateRect(hwnd, NULL, TRUE);
-    
-    SelectObject(hdc, hOldFont);
-    ReleaseDC(hwnd, hdc);
 }
 
 void UpdateScrollBars(HWND hwnd) {
@@ -98,7 +89,7 @@ void UpdateScrollBars(HWND hwnd) {
     si_vert.fMask  = SIF_RANGE | SIF_PAGE | SIF_POS;
     si_vert.nMin   = 0;
     // Calculate total lines
-    LONG totalLines = (LONG)textBuffer.size();
+    LONG totalLines = (LONG)textBuffer.lineCount();
     si_vert.nMax   = std::max(0L, totalLines - 1);
     si_vert.nPage  = linesPerPage;
     si_vert.nPos   = scrollOffsetY;
@@ -140,10 +131,8 @@ void HandleMouseWheelScroll(HWND hwnd, WPARAM wParam){
 
         if (scrollOffsetX != oldScrollOffsetX) {
             trackCaret = false; 
-            UpdateScrollBars(hwnd);
-            ScrollWindowEx(hwnd, (oldScrollOffsetX - scrollOffsetX), 0,
-                        NULL, NULL, NULL, NULL, SW_INVALIDATE | SW_ERASE);
-            UpdateCaretPosition(hwnd);
+            ScrollContent(hwnd, oldScrollOffsetX, scrollOffsetY);
+            ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
         }
     } else { // Normal vertical scrolling
         int linesToScroll = zDelta / WHEEL_DELTA * 3;
@@ -151,14 +140,12 @@ void HandleMouseWheelScroll(HWND hwnd, WPARAM wParam){
 
         scrollOffsetY -= linesToScroll;
         scrollOffsetY = std::max(0, scrollOffsetY);
-        scrollOffsetY =std:: min(scrollOffsetY, std::max(0, (int)textBuffer.size() - linesPerPage));
+        scrollOffsetY =std:: min(scrollOffsetY, std::max(0, (int)textBuffer.lineCount() - linesPerPage));
 
         if (scrollOffsetY != oldScrollOffsetY) {
             trackCaret = false; 
-            UpdateScrollBars(hwnd);
-            ScrollWindowEx(hwnd, 0, (oldScrollOffsetY - scrollOffsetY) * charHeight,
-                        NULL, NULL, NULL, NULL, SW_INVALIDATE | SW_ERASE);
-            UpdateCaretPosition(hwnd);
+            ScrollContent(hwnd, scrollOffsetX, oldScrollOffsetY);
+            ScheduleLayout(LAYOUT_CARET | LAYOUT_SCROLLBARS);
         }
     }
 }
@@ -203,9 +190,8 @@ void HandleVerticalScroll(HWND hwnd, WPARAM wParam){
         si_update.nPos = scrollOffsetY;
         SetScrollInfo(hwnd, SB_VERT, &si_update, TRUE);
 
-        ScrollWindowEx(hwnd, (oldScrollOffsetY - scrollOffsetY), 0,
-                    NULL, NULL, NULL, NULL, SW_INVALIDATE | SW_ERASE);
-        UpdateCaretPosition(hwnd);
+        ScrollContent(hwnd, scrollOffsetX, oldScrollOffsetY);
+        ScheduleLayout(LAYOUT_CARET);
     }
 }
 void HandleHorizontalScroll(HWND hwnd, WPARAM wParam){
@@ -252,8 +238,7 @@ void HandleHorizontalScroll(HWND hwnd, WPARAM wParam){
         si_update.nPos = scrollOffsetX;
         SetScrollInfo(hwnd, SB_HORZ, &si_update, TRUE);
 
-        ScrollWindowEx(hwnd, (oldScrollOffsetX - scrollOffsetX), 0,
-                    NULL, NULL, NULL, NULL, SW_INVALIDATE | SW_ERASE);
-        UpdateCaretPosition(hwnd);
+        ScrollContent(hwnd, oldScrollOffsetX, scrollOffsetY);
+        ScheduleLayout(LAYOUT_CARET);
     }
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#define NOMINMAX
+
+#include "viewport.h"
+
+#include <algorithm>
+
+LineRange VisibleLineRange(int paintTop, int paintBottom, int lineHeight, int scrollOffsetY, int lineCount) {
+    LineRange range = {0, 0};
+    if (lineHeight <= 0 || paintBottom <= paintTop) return range;
+
+    paintTop = std::max(paintTop, 0);
+    range.first = scrollOffsetY + paintTop / lineHeight;
+    // Round up so a partially covered last line is still drawn
+    range.last = scrollOffsetY + (paintBottom + lineHeight - 1) / lineHeight;
+
+    range.first = std::clamp(range.first, 0, lineCount);
+    range.last = std::clamp(range.last, range.first, lineCount);
+    return range;
+}
+
+ColumnRange VisibleColumnRange(int paintLeft, int paintRight, int advance, int scrollOffsetX, int lineLength) {
+    ColumnRange range = {0, lineLength};
+    if (advance <= 0) return range; // Unknown advance, draw the whole line
+    if (paintRight <= paintLeft) {
+        range.last = 0;
+        return range;
+    }
+
+    // Document x of the paint rect edges
+    int left = std::max(paintLeft + scrollOffsetX, 0);
+    int right = std::max(paintRight + scrollOffsetX, 0);
+    range.first = left / advance;
+    range.last = (right + advance - 1) / advance;
+
+    range.first = std::clamp(range.first, 0, lineLength);
+    range.last = std::clamp(range.last, range.first, lineLength);
+    return range;
+}
+
+bool IsLowSurrogate(wchar_t ch) {
+    return ch >= 0xDC00 && ch <= 0xDFFF;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+// Visible range calculations for painting, kept free of Win32 so they can be
+// exercised headlessly. All coordinates are client pixels.
+
+struct LineRange {
+    int first;  // First visible line
+    int last;   // One past the last visible line
+};
+
+struct ColumnRange {
+    int first;  // First column to draw
+    int last;   // One past the last column to draw
+};
+
+// Lines whose band intersects [paintTop, paintBottom)
+LineRange VisibleLineRange(int paintTop, int paintBottom, int lineHeight, int scrollOffsetY, int lineCount);
+
+// Columns of a fixed-pitch line that intersect [paintLeft, paintRight)
+ColumnRange VisibleColumnRange(int paintLeft, int paintRight, int advance, int scrollOffsetX, int lineLength);
+
+// Second half of a UTF-16 surrogate pair, a span must not start or end on one
+bool IsLowSurrogate(wchar_t ch);
\ No newline at end of file
@@ -18,7 +18,7 @@ cd ..
 cd ..
 cd projects/textEditor
 windres textEditor.rc -O coff -o textEditor.res
-g++ wWinMain.cpp WindowProc.cpp textEditorGlobals.cpp textMetrics.cpp updateCaretAndScroll.cpp fileOperations.cpp undoStack.cpp characterCase.cpp isModified.cpp cursorControls.cpp searchMode.cpp infoBar.cpp textEditor.res -o textEditor.exe -mwindows -municode -lcomdlg32
+g++ wWinMain.cpp WindowProc.cpp textEditorGlobals.cpp pieceTable.cpp mappedText.cpp charScan.cpp textEncoding.cpp lineWidths.cpp viewport.cpp damageTracker.cpp frameScheduler.cpp textMetrics.cpp glyphAdvances.cpp updateCaretAndScroll.cpp fileOperations.cpp fileSave.cpp spillFile.cpp editJournal.cpp undoHistory.cpp undoStack.cpp characterCase.cpp isModified.cpp cursorControls.cpp replaceText.cpp searchMode.cpp matchList.cpp searchWorker.cpp regexSearch.cpp trigramIndex.cpp infoBar.cpp textEditor.res -o textEditor.exe -mwindows -municode -lcomdlg32
 textEditor.exe
 */
 